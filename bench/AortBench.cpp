@@ -0,0 +1,483 @@
+#include "AortLight.h"
+#include "AortMaterial.h"
+#include "AortMesh.h"
+#include "AortRenderer.h"
+#include "AortSceneNode.h"
+#include "AortTrace.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+
+#include <OGRE/OgreCamera.h>
+#include <OGRE/OgreColourValue.h>
+#include <OGRE/OgreLogManager.h>
+#include <OGRE/OgreMath.h>
+#include <OGRE/OgreQuaternion.h>
+#include <OGRE/OgreRoot.h>
+#include <OGRE/OgreSceneManager.h>
+#include <OGRE/OgreVector2.h>
+#include <OGRE/OgreVector3.h>
+
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#ifndef NO_OMP
+#include <omp.h>
+#endif // !NO_OMP
+
+class BenchInstance {
+public:
+  BenchInstance(const size_t mesh, const Ogre::Vector3 &position) : mesh(mesh), position(position) {
+  }
+
+  size_t mesh;
+  Ogre::Vector3 position;
+};
+
+class BenchLight {
+public:
+  BenchLight(const Aort::LightType type, const Ogre::Vector3 &position, const Ogre::ColourValue &colour) : type(type), position(position), colour(colour) {
+  }
+
+  Aort::LightType type;
+  Ogre::Vector3 position;
+  Ogre::ColourValue colour;
+};
+
+class BenchScene {
+public:
+  BenchScene(const QString &name) : name(name) {
+  }
+
+  ~BenchScene() {
+    for (size_t i = 0; i < meshes.size(); ++i)
+      delete meshes.at(i);
+    for (size_t i = 0; i < materials.size(); ++i)
+      delete materials.at(i);
+  }
+
+  Aort::Material *createMaterial(const Ogre::String &name, const Ogre::ColourValue &diffuse, const Ogre::Real reflectivity) {
+    Aort::Material *material = new Aort::Material(name);
+    material->setAmbient(diffuse);
+    material->setDiffuse(diffuse);
+    material->setSpecular(Ogre::ColourValue(0.5f, 0.5f, 0.5f));
+    material->setReflectivity(reflectivity);
+    materials.push_back(material);
+    return material;
+  }
+
+  size_t addPlane(const Ogre::Real size, const int segments, const bool facingDown, Aort::Material *material) {
+    Aort::Mesh *mesh = new Aort::Mesh((segments + 1) * (segments + 1), segments * segments * 2);
+    // create vertices on the xz plane
+    for (int z = 0; z <= segments; ++z) {
+      for (int x = 0; x <= segments; ++x) {
+        size_t i = z * (segments + 1) + x;
+        mesh->positions()[i] = Ogre::Vector3((Ogre::Real(x) / segments - 0.5f) * size, 0.0f, (Ogre::Real(z) / segments - 0.5f) * size);
+        mesh->normals()[i] = facingDown ? Ogre::Vector3::NEGATIVE_UNIT_Y : Ogre::Vector3::UNIT_Y;
+        mesh->texCoords()[i] = Ogre::Vector2(Ogre::Real(x) / segments, Ogre::Real(z) / segments);
+      }
+    }
+    // create two triangles for each cell
+    addGrid(mesh, segments, segments, facingDown);
+    mesh->addMaterial(material);
+    meshes.push_back(mesh);
+    return meshes.size() - 1;
+  }
+
+  size_t addSphere(const Ogre::Real radius, const int rings, const int segments, Aort::Material *material) {
+    Aort::Mesh *mesh = new Aort::Mesh((rings + 1) * (segments + 1), rings * segments * 2);
+    // create vertices ring by ring from the top
+    for (int r = 0; r <= rings; ++r) {
+      Ogre::Radian theta(Ogre::Math::PI * r / rings);
+      for (int s = 0; s <= segments; ++s) {
+        Ogre::Radian phi(Ogre::Math::TWO_PI * s / segments);
+        size_t i = r * (segments + 1) + s;
+        Ogre::Vector3 normal(Ogre::Math::Sin(theta) * Ogre::Math::Cos(phi), Ogre::Math::Cos(theta), Ogre::Math::Sin(theta) * Ogre::Math::Sin(phi));
+        mesh->positions()[i] = normal * radius;
+        mesh->normals()[i] = normal;
+        mesh->texCoords()[i] = Ogre::Vector2(Ogre::Real(s) / segments, Ogre::Real(r) / rings);
+      }
+    }
+    addGrid(mesh, segments, rings, true);
+    mesh->addMaterial(material);
+    meshes.push_back(mesh);
+    return meshes.size() - 1;
+  }
+
+  void addGrid(Aort::Mesh *mesh, const int columns, const int rows, const bool flip) {
+    Ogre::uint32 *indices = mesh->indices();
+    for (int y = 0; y < rows; ++y) {
+      for (int x = 0; x < columns; ++x) {
+        Ogre::uint32 i = y * (columns + 1) + x;
+        Ogre::uint32 quad[4] = { i, i + 1, i + columns + 2, i + columns + 1 };
+        *indices++ = quad[0];
+        *indices++ = flip ? quad[1] : quad[2];
+        *indices++ = flip ? quad[2] : quad[1];
+        *indices++ = quad[0];
+        *indices++ = flip ? quad[2] : quad[3];
+        *indices++ = flip ? quad[3] : quad[2];
+      }
+    }
+    std::fill(mesh->materialIndices(), mesh->materialIndices() + mesh->triangleCount(), 0);
+  }
+
+  void populate(Aort::Renderer *renderer) const {
+    for (size_t i = 0; i < instances.size(); ++i)
+      renderer->addMesh(meshes.at(instances.at(i).mesh), instances.at(i).position, Ogre::Quaternion::IDENTITY, Ogre::Vector3::UNIT_SCALE);
+    // the renderer owns the lights, create them for each run
+    for (size_t i = 0; i < lights.size(); ++i) {
+      Aort::Light *light = new Aort::Light();
+      light->setType(lights.at(i).type);
+      light->setPosition(lights.at(i).position);
+      light->setDirection(Ogre::Vector3::NEGATIVE_UNIT_Y);
+      light->setDiffuseColour(lights.at(i).colour);
+      light->setSpecularColour(lights.at(i).colour);
+      renderer->addLight(light);
+    }
+  }
+
+  QString name;
+  Ogre::Vector3 cameraPosition;
+  Ogre::Vector3 cameraTarget;
+  std::vector<Aort::Material *> materials;
+  std::vector<Aort::Mesh *> meshes;
+  std::vector<BenchInstance> instances;
+  std::vector<BenchLight> lights;
+};
+
+class BenchRun {
+public:
+  int threads;
+  int buildTime;
+  int renderTime;
+  size_t rayCount;
+  size_t triangleCount;
+  size_t memoryUsage;
+  size_t peakMemoryUsage;
+  Aort::TreeStatistics tree;
+  Aort::TreeOptions treeOptions;
+};
+
+// the room of the viewport, a floor and a ceiling 300 units apart lit from the ceiling
+BenchScene *createRoom(const QString &name) {
+  BenchScene *scene = new BenchScene(name);
+  Aort::Material *floor = scene->createMaterial("Bench/Floor", Ogre::ColourValue(0.8f, 0.8f, 0.8f), 0.0f);
+  Aort::Material *ceiling = scene->createMaterial("Bench/Ceiling", Ogre::ColourValue(1.0f, 1.0f, 1.0f), 0.0f);
+  scene->instances.push_back(BenchInstance(scene->addPlane(10000.0f, 50, false, floor), Ogre::Vector3::ZERO));
+  scene->instances.push_back(BenchInstance(scene->addPlane(10000.0f, 50, true, ceiling), Ogre::Vector3(0.0f, 300.0f, 0.0f)));
+  scene->cameraPosition = Ogre::Vector3(0.0f, 150.0f, 600.0f);
+  scene->cameraTarget = Ogre::Vector3(0.0f, 100.0f, 0.0f);
+  return scene;
+}
+
+BenchScene *createCornellScene() {
+  BenchScene *scene = createRoom("cornell");
+  Aort::Material *mirror = scene->createMaterial("Bench/Mirror", Ogre::ColourValue(0.9f, 0.9f, 0.9f), 0.5f);
+  Aort::Material *red = scene->createMaterial("Bench/Red", Ogre::ColourValue(0.8f, 0.2f, 0.2f), 0.0f);
+  size_t sphere = scene->addSphere(60.0f, 32, 64, mirror);
+  scene->instances.push_back(BenchInstance(sphere, Ogre::Vector3(-100.0f, 60.0f, 0.0f)));
+  scene->instances.push_back(BenchInstance(scene->addSphere(60.0f, 32, 64, red), Ogre::Vector3(100.0f, 60.0f, -100.0f)));
+  scene->lights.push_back(BenchLight(Aort::LT_AREA, Ogre::Vector3(0.0f, 295.0f, 0.0f), Ogre::ColourValue(0.5f, 0.5f, 0.5f)));
+  return scene;
+}
+
+BenchScene *createTriangleScene(const int scale) {
+  BenchScene *scene = createRoom("triangles");
+  Aort::Material *white = scene->createMaterial("Bench/White", Ogre::ColourValue(0.9f, 0.9f, 0.9f), 0.0f);
+  // 16x16 instances of a sphere with 16k triangles each at scale 1
+  size_t sphere = scene->addSphere(12.0f, 64 * scale, 128 * scale, white);
+  for (int z = 0; z < 16; ++z)
+    for (int x = 0; x < 16; ++x)
+      scene->instances.push_back(BenchInstance(sphere, Ogre::Vector3((x - 7.5f) * 30.0f, 12.0f, (z - 7.5f) * 30.0f)));
+  scene->lights.push_back(BenchLight(Aort::LT_POINT, Ogre::Vector3(0.0f, 295.0f, 0.0f), Ogre::ColourValue(0.8f, 0.8f, 0.8f)));
+  return scene;
+}
+
+BenchScene *createLightScene() {
+  BenchScene *scene = createRoom("lights");
+  Aort::Material *white = scene->createMaterial("Bench/White", Ogre::ColourValue(0.9f, 0.9f, 0.9f), 0.0f);
+  size_t sphere = scene->addSphere(40.0f, 32, 64, white);
+  for (int i = 0; i < 3; ++i)
+    scene->instances.push_back(BenchInstance(sphere, Ogre::Vector3((i - 1) * 120.0f, 40.0f, 0.0f)));
+  // 8x8 point lights under the ceiling
+  for (int z = 0; z < 8; ++z)
+    for (int x = 0; x < 8; ++x)
+      scene->lights.push_back(BenchLight(Aort::LT_POINT, Ogre::Vector3((x - 3.5f) * 80.0f, 280.0f, (z - 3.5f) * 80.0f), Ogre::ColourValue(0.02f, 0.02f, 0.02f)));
+  return scene;
+}
+
+size_t peakMemoryUsage() {
+#ifdef Q_OS_UNIX
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef Q_OS_MAC
+    return size_t(usage.ru_maxrss);
+#else
+    // linux reports kilobytes
+    return size_t(usage.ru_maxrss) * 1024;
+#endif
+  }
+#endif
+  return 0;
+}
+
+BenchRun runScene(const BenchScene *scene, Ogre::Camera *camera, const int threads, const int width, const int height, const bool compressed, const bool tune, const size_t treeBudget, const int lazyDepth, const bool rasterize, const bool trace, uchar *buffer) {
+  BenchRun run;
+  run.threads = threads;
+#ifndef NO_OMP
+  omp_set_num_threads(threads);
+#endif // !NO_OMP
+  // restart tracing, each run replaces the spans of the previous one
+  if (trace)
+    Aort::Trace::start();
+  // set up the camera
+  camera->setPosition(scene->cameraPosition);
+  camera->lookAt(scene->cameraTarget);
+  camera->setAspectRatio(Ogre::Real(width) / Ogre::Real(height));
+  // build and render the scene
+  Aort::Renderer *renderer = new Aort::Renderer();
+  renderer->setGeometryCompression(compressed);
+  Aort::TreeOptions treeOptions;
+  treeOptions.memoryBudget = treeBudget;
+  treeOptions.lazyDepth = lazyDepth;
+  renderer->setTreeOptions(treeOptions);
+  renderer->setTreeAutoTune(tune);
+  renderer->setRasterizedVisibility(rasterize);
+  scene->populate(renderer);
+  run.buildTime = renderer->preprocess(0);
+  run.renderTime = renderer->render(camera, width, height, buffer);
+  Aort::Trace::stop();
+  // read statistics before the scene is released
+  run.rayCount = renderer->getRayCount();
+  run.triangleCount = renderer->getTriangleCount();
+  run.memoryUsage = renderer->getMemoryUsage();
+  run.peakMemoryUsage = peakMemoryUsage();
+  run.tree = renderer->getTreeStatistics();
+  run.treeOptions = renderer->getTreeOptions();
+  delete renderer;
+  return run;
+}
+
+void writeUsage(QTextStream &out) {
+  out << "Usage: aort-bench [options]" << endl
+      << "  --scenes <list>     comma separated scenes to run: cornell, triangles, lights (default: all)" << endl
+      << "  --threads <list>    comma separated thread counts (default: 1, 2, 4, ... up to the processor count)" << endl
+      << "  --width <pixels>    image width (default: 640)" << endl
+      << "  --height <pixels>   image height (default: 480)" << endl
+      << "  --scale <factor>    tessellation factor of the triangles scene (default: 1)" << endl
+      << "  --repeat <count>    runs per thread count, the fastest render is reported (default: 1)" << endl
+      << "  --compressed        store the scene geometry quantized" << endl
+      << "  --tune              tune the tree options for each scene" << endl
+      << "  --rasterize         rasterize the primary visibility instead of tracing the primary rays" << endl
+      << "  --tree-budget <MB>  limit the memory of the scene tree, splits that do not fit become leaves" << endl
+      << "  --lazy-depth <depth> build the subtrees below the depth when the first ray enters them (default: 0, all upfront)" << endl
+      << "  --output <path>     write the json report to a file instead of the standard output" << endl
+      << "  --trace <path>      write a chrome trace event timeline of the last run to a file" << endl
+      << "The report includes the quality of each scene tree, leavesPerSize bucket i counts the leaves" << endl
+      << "with 2^(i-1) to 2^i - 1 triangles and bucket 0 the empty leaves." << endl;
+}
+
+int main(int argc, char **argv) {
+  QCoreApplication app(argc, argv);
+  QTextStream err(stderr);
+  // default settings
+  QStringList sceneNames = QStringList() << "cornell" << "triangles" << "lights";
+  QList<int> threadCounts;
+  int width = 640;
+  int height = 480;
+  int scale = 1;
+  int repeat = 1;
+  bool compressed = false;
+  bool tune = false;
+  bool rasterize = false;
+  size_t treeBudget = 0;
+  int lazyDepth = 0;
+  QString outputPath;
+  QString tracePath;
+  // parse arguments
+  QStringList arguments = app.arguments();
+  for (int i = 1; i < arguments.size(); ++i) {
+    QString argument = arguments.at(i);
+    QString value = (i + 1 < arguments.size()) ? arguments.at(i + 1) : QString();
+    if (argument == "--scenes") {
+      sceneNames = value.split(",");
+      ++i;
+    } else if (argument == "--threads") {
+      QStringList values = value.split(",");
+      for (int j = 0; j < values.size(); ++j)
+        if (values.at(j).toInt() > 0)
+          threadCounts.append(values.at(j).toInt());
+      ++i;
+    } else if (argument == "--width") {
+      width = std::max(1, value.toInt());
+      ++i;
+    } else if (argument == "--height") {
+      height = std::max(1, value.toInt());
+      ++i;
+    } else if (argument == "--scale") {
+      scale = std::max(1, value.toInt());
+      ++i;
+    } else if (argument == "--repeat") {
+      repeat = std::max(1, value.toInt());
+      ++i;
+    } else if (argument == "--compressed") {
+      compressed = true;
+    } else if (argument == "--tune") {
+      tune = true;
+    } else if (argument == "--rasterize") {
+      rasterize = true;
+    } else if (argument == "--tree-budget") {
+      treeBudget = size_t(std::max(0.0, value.toDouble()) * 1024 * 1024);
+      ++i;
+    } else if (argument == "--lazy-depth") {
+      lazyDepth = std::max(0, value.toInt());
+      ++i;
+    } else if (argument == "--output") {
+      outputPath = value;
+      ++i;
+    } else if (argument == "--trace") {
+      tracePath = value;
+      ++i;
+    } else {
+      writeUsage(err);
+      return 1;
+    }
+  }
+  // use powers of two up to the processor count by default
+  if (threadCounts.isEmpty()) {
+    int processorCount = 1;
+#ifndef NO_OMP
+    processorCount = omp_get_num_procs();
+#endif // !NO_OMP
+    for (int threads = 1; threads < processorCount; threads *= 2)
+      threadCounts.append(threads);
+    threadCounts.append(processorCount);
+  }
+  // create a silent log before ogre creates the default one
+  Ogre::LogManager *logManager = new Ogre::LogManager();
+  logManager->createLog("aort-bench.log", true, false, true);
+  // the camera is the only ogre object needed, no render system is loaded
+  Ogre::Root *root = new Ogre::Root("", "", "");
+  Ogre::SceneManager *sceneManager = root->createSceneManager(Ogre::ST_GENERIC);
+  Ogre::Camera *camera = sceneManager->createCamera("BenchCamera");
+  camera->setNearClipDistance(10.0f);
+  camera->setFarClipDistance(10000.0f);
+  // render the scenes
+  uchar *buffer = new uchar[width * height * 4];
+  QString report;
+  QTextStream json(&report);
+  json << "{" << endl;
+  json << "  \"width\": " << width << "," << endl;
+  json << "  \"height\": " << height << "," << endl;
+  json << "  \"compressed\": " << (compressed ? "true" : "false") << "," << endl;
+  json << "  \"tuned\": " << (tune ? "true" : "false") << "," << endl;
+  json << "  \"rasterized\": " << (rasterize ? "true" : "false") << "," << endl;
+  json << "  \"treeBudgetBytes\": " << (qulonglong)treeBudget << "," << endl;
+  json << "  \"lazyDepth\": " << lazyDepth << "," << endl;
+  json << "  \"scenes\": [";
+  for (int i = 0; i < sceneNames.size(); ++i) {
+    BenchScene *scene = 0;
+    if (sceneNames.at(i) == "cornell")
+      scene = createCornellScene();
+    else if (sceneNames.at(i) == "triangles")
+      scene = createTriangleScene(scale);
+    else if (sceneNames.at(i) == "lights")
+      scene = createLightScene();
+    if (!scene) {
+      err << "Unknown scene: " << sceneNames.at(i) << endl;
+      continue;
+    }
+    err << "Running " << scene->name << "..." << endl;
+    std::vector<BenchRun> runs;
+    for (int j = 0; j < threadCounts.size(); ++j) {
+      BenchRun best = runScene(scene, camera, threadCounts.at(j), width, height, compressed, tune, treeBudget, lazyDepth, rasterize, !tracePath.isEmpty(), buffer);
+      for (int k = 1; k < repeat; ++k) {
+        BenchRun run = runScene(scene, camera, threadCounts.at(j), width, height, compressed, tune, treeBudget, lazyDepth, rasterize, !tracePath.isEmpty(), buffer);
+        if (run.renderTime < best.renderTime)
+          best = run;
+      }
+      runs.push_back(best);
+    }
+    // write scene results, scaling is relative to the first thread count
+    json << (i ? "," : "") << endl;
+    json << "    {" << endl;
+    json << "      \"name\": \"" << scene->name << "\"," << endl;
+    json << "      \"triangles\": " << runs.front().triangleCount << "," << endl;
+    json << "      \"lights\": " << scene->lights.size() << "," << endl;
+    // tree of the first run, tuned options may differ slightly between runs
+    const Aort::TreeStatistics &tree = runs.front().tree;
+    json << "      \"tree\": {" << endl;
+    json << "        \"minimumTrianglesPerLeaf\": " << runs.front().treeOptions.minimumTrianglesPerLeaf << "," << endl;
+    json << "        \"traversalCost\": " << runs.front().treeOptions.traversalCost << "," << endl;
+    json << "        \"emptyBonus\": " << runs.front().treeOptions.emptyBonus << "," << endl;
+    json << "        \"nodes\": " << tree.nodeCount << "," << endl;
+    json << "        \"leaves\": " << tree.leafCount << "," << endl;
+    json << "        \"depth\": " << tree.depth << "," << endl;
+    json << "        \"emptyLeafRatio\": " << QString::number(tree.emptyLeafRatio(), 'f', 4) << "," << endl;
+    json << "        \"maximumDepthLeaves\": " << tree.maximumDepthLeafCount << "," << endl;
+    json << "        \"references\": " << tree.referenceCount << "," << endl;
+    json << "        \"duplicationFactor\": " << QString::number(tree.duplicationFactor(), 'f', 4) << "," << endl;
+    json << "        \"largestLeaf\": " << tree.largestLeafSize << "," << endl;
+    json << "        \"sahCost\": " << QString::number(tree.sahCost(), 'f', 3) << "," << endl;
+    json << "        \"memoryBytes\": " << tree.memoryUsage << "," << endl;
+    json << "        \"budgetLeaves\": " << tree.budgetLeafCount << "," << endl;
+    json << "        \"budgetSahCostIncrease\": " << QString::number(tree.budgetCostIncrease, 'f', 3) << "," << endl;
+    json << "        \"pendingLeaves\": " << tree.pendingLeafCount << "," << endl;
+    json << "        \"leavesPerDepth\": [";
+    for (size_t j = 0; j < tree.depthHistogram.size(); ++j)
+      json << (j ? ", " : "") << tree.depthHistogram.at(j);
+    json << "]," << endl;
+    json << "        \"leavesPerSize\": [";
+    for (size_t j = 0; j < tree.leafSizeHistogram.size(); ++j)
+      json << (j ? ", " : "") << tree.leafSizeHistogram.at(j);
+    json << "]" << endl;
+    json << "      }," << endl;
+    json << "      \"runs\": [";
+    double baseRaysPerSecond = runs.front().rayCount * 1000.0 / std::max(1, runs.front().renderTime);
+    for (size_t j = 0; j < runs.size(); ++j) {
+      const BenchRun &run = runs.at(j);
+      double raysPerSecond = run.rayCount * 1000.0 / std::max(1, run.renderTime);
+      double efficiency = (raysPerSecond / baseRaysPerSecond) / (double(run.threads) / runs.front().threads);
+      json << (j ? "," : "") << endl;
+      json << "        {" << endl;
+      json << "          \"threads\": " << run.threads << "," << endl;
+      json << "          \"buildTimeMs\": " << run.buildTime << "," << endl;
+      json << "          \"renderTimeMs\": " << run.renderTime << "," << endl;
+      json << "          \"rays\": " << run.rayCount << "," << endl;
+      json << "          \"raysPerSecond\": " << QString::number(raysPerSecond, 'f', 0) << "," << endl;
+      json << "          \"scalingEfficiency\": " << QString::number(efficiency, 'f', 3) << "," << endl;
+      json << "          \"sceneMemoryBytes\": " << run.memoryUsage << "," << endl;
+      json << "          \"peakMemoryBytes\": " << run.peakMemoryUsage << endl;
+      json << "        }";
+    }
+    json << endl << "      ]" << endl;
+    json << "    }";
+    delete scene;
+  }
+  json << endl << "  ]" << endl;
+  json << "}" << endl;
+  // clean up
+  delete[] buffer;
+  delete root;
+  delete logManager;
+  // write the timeline
+  if (!tracePath.isEmpty() && !Aort::Trace::write(tracePath.toStdString()))
+    err << "Could not write " << tracePath << endl;
+  // write the report
+  if (outputPath.isEmpty()) {
+    QTextStream(stdout) << report;
+  } else {
+    QFile file(outputPath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+      err << "Could not write " << outputPath << endl;
+      return 1;
+    }
+    QTextStream(&file) << report;
+  }
+  return 0;
+}
@@ -0,0 +1,365 @@
+#include "AortLight.h"
+#include "AortMesh.h"
+#include "AortSceneNode.h"
+#include "AortTexture.h"
+#include "AortTriangle.h"
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+#include <QTime>
+
+#include <OGRE/OgreAxisAlignedBox.h>
+#include <OGRE/OgreColourValue.h>
+#include <OGRE/OgreImage.h>
+#include <OGRE/OgreRay.h>
+#include <OGRE/OgreVector2.h>
+#include <OGRE/OgreVector3.h>
+
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// number of calls per measured pass, each kernel is measured over several passes and the fastest one is reported
+#define CALLS_PER_PASS (1 << 20)
+
+// time stamp counter, counts at a constant rate on current processors
+static inline unsigned long long readCycleCounter() {
+#if defined(_MSC_VER)
+  return __rdtsc();
+#elif defined(__i386__) || defined(__x86_64__)
+  unsigned int low, high;
+  __asm__ __volatile__("rdtsc" : "=a"(low), "=d"(high));
+  return ((unsigned long long)high << 32) | low;
+#else
+  return 0;
+#endif
+}
+
+// linear congruential generator, the data sets do not depend on the platform rand()
+class Random {
+public:
+  Random(const Ogre::uint32 seed) : state(seed) {
+  }
+
+  Ogre::uint32 next() {
+    state = state * 1664525u + 1013904223u;
+    return state;
+  }
+
+  Ogre::Real real() {
+    return (next() >> 8) * (1.0f / 16777216.0f);
+  }
+
+  Ogre::Vector3 vector() {
+    Ogre::Real x = real();
+    Ogre::Real y = real();
+    Ogre::Real z = real();
+    return Ogre::Vector3(x, y, z);
+  }
+
+private:
+  Ogre::uint32 state;
+};
+
+class Measurement {
+public:
+  Measurement() : calls(0), cycles(0), milliseconds(0) {
+  }
+
+  size_t calls;
+  unsigned long long cycles;
+  int milliseconds;
+};
+
+class MicroBench {
+public:
+  MicroBench(const int passes) : passes(passes), sink(0) {
+  }
+
+  // runs the kernel for the given number of passes and keeps the fastest one
+  template <class Kernel>
+  Measurement measure(Kernel &kernel) {
+    Measurement best;
+    // warm up caches and branch predictors
+    sink += kernel.run();
+    for (int i = 0; i < passes; ++i) {
+      QTime time;
+      time.start();
+      unsigned long long start = readCycleCounter();
+      sink += kernel.run();
+      unsigned long long cycles = readCycleCounter() - start;
+      int milliseconds = time.elapsed();
+      if (i == 0 || cycles < best.cycles || (cycles == 0 && milliseconds < best.milliseconds)) {
+        best.calls = kernel.calls();
+        best.cycles = cycles;
+        best.milliseconds = milliseconds;
+      }
+    }
+    return best;
+  }
+
+  int passes;
+  // accumulates kernel results so the calls are not optimized away
+  double sink;
+};
+
+using Aort::Triangle;
+
+// random rays from a sphere around the unit cube towards random points inside it
+class RaySet {
+public:
+  RaySet(const size_t count, const Ogre::uint32 seed) {
+    Random random(seed);
+    Ogre::Vector3 centre(0.5f, 0.5f, 0.5f);
+    for (size_t i = 0; i < count; ++i) {
+      Ogre::Vector3 origin = random.vector() - centre;
+      origin.normalise();
+      origin = centre + origin * 2.0f;
+      Ogre::Vector3 target = random.vector();
+      Ogre::Vector3 direction = target - origin;
+      lengths.push_back(direction.normalise());
+      rays.push_back(Ogre::Ray(origin, direction));
+    }
+  }
+
+  std::vector<Ogre::Ray> rays;
+  // distances to the target points, used as the maximum distance of the occlusion rays
+  std::vector<Ogre::Real> lengths;
+};
+
+// random triangles inside the unit cube
+class TriangleSet {
+public:
+  TriangleSet(const size_t count, const Ogre::Real size, const Ogre::uint32 seed) : mesh(count * 3, count) {
+    Random random(seed);
+    for (size_t i = 0; i < count; ++i) {
+      Ogre::Vector3 centre = random.vector() * (1.0f - size) + Ogre::Vector3(size * 0.5f, size * 0.5f, size * 0.5f);
+      for (int j = 0; j < 3; ++j) {
+        mesh.positions()[i * 3 + j] = centre + (random.vector() - Ogre::Vector3(0.5f, 0.5f, 0.5f)) * size;
+        mesh.indices()[i * 3 + j] = i * 3 + j;
+      }
+      mesh.materialIndices()[i] = 0;
+    }
+    for (size_t i = 0; i < count; ++i)
+      triangles.push_back(Triangle(&mesh, i));
+  }
+
+  Aort::Mesh mesh;
+  std::vector<Aort::Triangle> triangles;
+};
+
+class TriangleKernel {
+public:
+  TriangleKernel() : rays(CALLS_PER_PASS / 1024, 1), triangles(1024, 0.5f, 2) {
+  }
+
+  size_t calls() const {
+    return rays.rays.size() * triangles.triangles.size();
+  }
+
+  double run() {
+    size_t hits = 0;
+    for (size_t i = 0; i < rays.rays.size(); ++i) {
+      for (size_t j = 0; j < triangles.triangles.size(); ++j) {
+        Ogre::Real t, u, v;
+        if (triangles.triangles[j].intersects(rays.rays[i], t, u, v))
+          hits++;
+      }
+    }
+    return hits;
+  }
+
+  RaySet rays;
+  TriangleSet triangles;
+};
+
+class SceneNodeKernel {
+public:
+  SceneNodeKernel(const bool occlusion) : occlusion(occlusion), rays(CALLS_PER_PASS / 8, 3), triangles(65536, 0.05f, 4), tree(0) {
+    std::vector<Ogre::uint32> indices;
+    for (size_t i = 0; i < triangles.triangles.size(); ++i)
+      indices.push_back(i);
+    tree = new Aort::SceneTree(Ogre::AxisAlignedBox(Ogre::Vector3(0.0f, 0.0f, 0.0f), Ogre::Vector3(1.0f, 1.0f, 1.0f)), &triangles.triangles[0], indices);
+  }
+
+  ~SceneNodeKernel() {
+    delete tree;
+  }
+
+  size_t calls() const {
+    return rays.rays.size();
+  }
+
+  double run() {
+    size_t hits = 0;
+    for (size_t i = 0; i < rays.rays.size(); ++i) {
+      if (occlusion) {
+        if (tree->hit(rays.rays[i], 0.0f, rays.lengths[i]))
+          hits++;
+      } else {
+        Triangle *triangle = 0;
+        Ogre::Real t = FLT_MAX, u = 0, v = 0;
+        if (tree->hit(rays.rays[i], triangle, t, u, v))
+          hits++;
+      }
+    }
+    return hits;
+  }
+
+  bool occlusion;
+  RaySet rays;
+  TriangleSet triangles;
+  Aort::SceneTree *tree;
+};
+
+class TextureKernel {
+public:
+  TextureKernel(const Ogre::FilterOptions filter) : pixels(1024 * 1024 * 4) {
+    Random random(5);
+    for (size_t i = 0; i < pixels.size(); ++i)
+      pixels[i] = random.next() >> 24;
+    image.loadDynamicImage(&pixels[0], 1024, 1024, Ogre::PF_BYTE_RGBA);
+    texture.setImage(&image);
+    texture.setFilter(filter);
+    // coordinates stay inside the texture, the filters do not wrap negative coordinates
+    for (size_t i = 0; i < CALLS_PER_PASS; ++i) {
+      Ogre::Real u = random.real();
+      Ogre::Real v = random.real();
+      texCoords.push_back(Ogre::Vector2(u, v));
+    }
+  }
+
+  size_t calls() const {
+    return texCoords.size();
+  }
+
+  double run() {
+    Ogre::Real sum = 0.0f;
+    for (size_t i = 0; i < texCoords.size(); ++i)
+      sum += texture.getColourAt(texCoords[i]).g;
+    return sum;
+  }
+
+  std::vector<Ogre::uchar> pixels;
+  Ogre::Image image;
+  Aort::Texture texture;
+  std::vector<Ogre::Vector2> texCoords;
+};
+
+class LightKernel {
+public:
+  LightKernel() {
+    light.setType(Aort::LT_AREA);
+    light.setPosition(Ogre::Vector3(0.0f, 295.0f, 0.0f));
+    light.setDirection(Ogre::Vector3::NEGATIVE_UNIT_Y);
+  }
+
+  size_t calls() const {
+    return CALLS_PER_PASS / 16;
+  }
+
+  double run() {
+    Ogre::Real sum = 0.0f;
+    Ogre::Vector3 points[16];
+    for (size_t i = 0; i < calls(); ++i) {
+      light.getPoints(points, i);
+      sum += points[i % 16].x;
+    }
+    return sum;
+  }
+
+  Aort::Light light;
+};
+
+class Report {
+public:
+  Report(QTextStream &out, const bool json) : out(out), json(json), count(0) {
+    if (json)
+      out << "{" << endl << "  \"kernels\": [";
+    else
+      out << QString("%1 %2 %3 %4").arg("kernel", -28).arg("calls", 10).arg("cycles/call", 12).arg("ns/call", 10) << endl;
+  }
+
+  ~Report() {
+    if (json)
+      out << endl << "  ]" << endl << "}" << endl;
+  }
+
+  void add(const QString &name, const Measurement &measurement) {
+    double cycles = double(measurement.cycles) / measurement.calls;
+    double nanoseconds = measurement.milliseconds * 1000000.0 / measurement.calls;
+    if (json) {
+      out << (count ? "," : "") << endl;
+      out << "    { \"name\": \"" << name << "\", \"calls\": " << (qulonglong)measurement.calls
+          << ", \"cyclesPerCall\": " << QString::number(cycles, 'f', 2)
+          << ", \"nanosecondsPerCall\": " << QString::number(nanoseconds, 'f', 2) << " }";
+    } else {
+      out << QString("%1 %2 %3 %4").arg(name, -28).arg((qulonglong)measurement.calls, 10).arg(cycles, 12, 'f', 2).arg(nanoseconds, 10, 'f', 2) << endl;
+    }
+    count++;
+  }
+
+private:
+  QTextStream &out;
+  bool json;
+  int count;
+};
+
+int main(int argc, char **argv) {
+  QCoreApplication app(argc, argv);
+  QTextStream out(stdout);
+  QTextStream err(stderr);
+  int passes = 5;
+  bool json = false;
+  QStringList filter;
+  // parse arguments
+  QStringList arguments = app.arguments();
+  for (int i = 1; i < arguments.size(); ++i) {
+    if (arguments.at(i) == "--passes" && i + 1 < arguments.size()) {
+      passes = std::max(1, arguments.at(++i).toInt());
+    } else if (arguments.at(i) == "--json") {
+      json = true;
+    } else if (!arguments.at(i).startsWith("-")) {
+      filter << arguments.at(i);
+    } else {
+      err << "Usage: aort-microbench [--passes <count>] [--json] [kernel...]" << endl
+          << "Kernels: triangle, scenenode-closest, scenenode-occlusion, texture-none, texture-point," << endl
+          << "         texture-linear, texture-anisotropic, light-points" << endl
+          << "Cycles are read from the time stamp counter, which runs at a constant rate." << endl;
+      return 1;
+    }
+  }
+  MicroBench bench(passes);
+  Report report(out, json);
+  if (filter.isEmpty() || filter.contains("triangle")) {
+    TriangleKernel kernel;
+    report.add("triangle", bench.measure(kernel));
+  }
+  if (filter.isEmpty() || filter.contains("scenenode-closest")) {
+    SceneNodeKernel kernel(false);
+    report.add("scenenode-closest", bench.measure(kernel));
+  }
+  if (filter.isEmpty() || filter.contains("scenenode-occlusion")) {
+    SceneNodeKernel kernel(true);
+    report.add("scenenode-occlusion", bench.measure(kernel));
+  }
+  const char *filterNames[4] = { "texture-none", "texture-point", "texture-linear", "texture-anisotropic" };
+  const Ogre::FilterOptions filterOptions[4] = { Ogre::FO_NONE, Ogre::FO_POINT, Ogre::FO_LINEAR, Ogre::FO_ANISOTROPIC };
+  for (int i = 0; i < 4; ++i) {
+    if (filter.isEmpty() || filter.contains(filterNames[i])) {
+      TextureKernel kernel(filterOptions[i]);
+      report.add(filterNames[i], bench.measure(kernel));
+    }
+  }
+  if (filter.isEmpty() || filter.contains("light-points")) {
+    LightKernel kernel;
+    report.add("light-points", bench.measure(kernel));
+  }
+  // keep the results alive
+  if (bench.sink == -1.0)
+    err << bench.sink << endl;
+  return 0;
+}
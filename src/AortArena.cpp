@@ -0,0 +1,69 @@
+#include "AortArena.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+namespace Aort {
+  Arena::Arena(const size_t blockSize) : blockSize(blockSize), current(0), offset(0) {
+  }
+
+  Arena::~Arena() {
+    clear();
+  }
+
+  void *Arena::allocate(const size_t size, const size_t alignment) {
+    // try the current block and then the blocks left by a rewind
+    while (current < blocks.size()) {
+      Block &block = blocks[current];
+      size_t aligned = (size_t(block.data) + offset + alignment - 1) & ~(alignment - 1);
+      if (aligned + size <= size_t(block.data) + block.size) {
+        offset = aligned + size - size_t(block.data);
+        return reinterpret_cast<void *>(aligned);
+      }
+      current++;
+      offset = 0;
+    }
+    // allocate a new block, large requests get a block of their own size
+    Block block;
+    block.size = std::max(blockSize, size + alignment);
+    block.data = static_cast<char *>(malloc(block.size));
+    blocks.push_back(block);
+    current = blocks.size() - 1;
+    size_t aligned = (size_t(block.data) + alignment - 1) & ~(alignment - 1);
+    offset = aligned + size - size_t(block.data);
+    return reinterpret_cast<void *>(aligned);
+  }
+
+  const ArenaMarker Arena::mark() const {
+    ArenaMarker marker;
+    marker.block = current;
+    marker.offset = offset;
+    return marker;
+  }
+
+  void Arena::rewind(const ArenaMarker &marker) {
+    current = marker.block;
+    offset = marker.offset;
+  }
+
+  void Arena::reset() {
+    current = 0;
+    offset = 0;
+  }
+
+  void Arena::clear() {
+    for (size_t i = 0; i < blocks.size(); ++i)
+      free(blocks.at(i).data);
+    blocks.clear();
+    current = 0;
+    offset = 0;
+  }
+
+  const size_t Arena::memoryUsage() const {
+    size_t memoryUsage = 0;
+    for (size_t i = 0; i < blocks.size(); ++i)
+      memoryUsage += blocks.at(i).size;
+    return memoryUsage;
+  }
+}
@@ -0,0 +1,64 @@
+#ifndef AORTARENA_H
+#define AORTARENA_H
+
+#include <stddef.h>
+#include <vector>
+
+// size of the blocks the arena allocates from the heap
+#define ARENA_BLOCK_SIZE (1 << 20)
+
+namespace Aort {
+  // position of an arena, everything allocated after it is released by rewinding to it
+  class ArenaMarker {
+  public:
+    ArenaMarker() : block(0), offset(0) {
+    }
+
+    size_t block;
+    size_t offset;
+  };
+
+  // bump allocator, allocations are not freed one by one but released all at once, the blocks are kept for reuse
+  // objects placed in the arena are not destroyed
+  class Arena {
+  public:
+    Arena(const size_t blockSize = ARENA_BLOCK_SIZE);
+    ~Arena();
+
+    void *allocate(const size_t size, const size_t alignment = 16);
+
+    template <class T>
+    T *allocate(const size_t count) {
+      return static_cast<T *>(allocate(count * sizeof(T)));
+    }
+
+    const ArenaMarker mark() const;
+    void rewind(const ArenaMarker &marker);
+
+    // releases all allocations, keeps the blocks
+    void reset();
+    // releases all allocations and the blocks
+    void clear();
+
+    // bytes reserved from the heap
+    const size_t memoryUsage() const;
+
+  private:
+    Arena(const Arena &);
+    Arena &operator=(const Arena &);
+
+    class Block {
+    public:
+      char *data;
+      size_t size;
+    };
+
+    size_t blockSize;
+    std::vector<Block> blocks;
+    // block being allocated from and the offset of its first free byte
+    size_t current;
+    size_t offset;
+  };
+}
+
+#endif // AORTARENA_H
@@ -0,0 +1,704 @@
+#include "AortDistributed.h"
+
+#include "AortImageWriter.h"
+#include "AortMesh.h"
+#include "AortMeshLibrary.h"
+#include "AortRenderer.h"
+#include "AortSceneFile.h"
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QMutex>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <OGRE/OgreCamera.h>
+#include <OGRE/OgreCommon.h>
+#include <OGRE/OgreLogManager.h>
+#include <OGRE/OgreMath.h>
+#include <OGRE/OgreString.h>
+#include <OGRE/OgreStringConverter.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+
+// largest message accepted, the rgba floats of a tile of the largest size with some room
+#define MAX_MESSAGE_SIZE (MAX_TILE_SIZE * MAX_TILE_SIZE * 4 * 4 + (1 << 20))
+
+namespace Aort {
+  // messages are a 32-bit size and an 8-bit type followed by the payload, the payloads are written with QDataStream
+  enum MessageType {
+    // coordinator to worker, a render job, answered with MT_READY when the scene is prepared
+    MT_JOB,
+    MT_READY,
+    // coordinator to worker, the index and the rectangle of a tile, answered with MT_TILE_DATA
+    MT_TILE,
+    // the index of the tile and its rgba floats in row order
+    MT_TILE_DATA,
+    // a utf-8 message, the request could not be handled
+    MT_ERROR
+  };
+
+  static void setUpStream(QDataStream &stream) {
+    stream.setVersion(QDataStream::Qt_4_6);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+  }
+
+  static const bool writeMessage(QTcpSocket *socket, const MessageType type, const QByteArray &payload, const int timeout) {
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    setUpStream(stream);
+    stream << quint32(payload.size()) << quint8(type);
+    data.append(payload);
+    if (socket->write(data) != data.size())
+      return false;
+    while (socket->bytesToWrite() > 0)
+      if (!socket->waitForBytesWritten(timeout))
+        return false;
+    return true;
+  }
+
+  static const bool readBytes(QTcpSocket *socket, char *data, const qint64 size, const int timeout) {
+    qint64 received = 0;
+    while (received < size) {
+      if (socket->bytesAvailable() == 0 && !socket->waitForReadyRead(timeout))
+        return false;
+      qint64 count = socket->read(data + received, size - received);
+      if (count < 0)
+        return false;
+      received += count;
+    }
+    return true;
+  }
+
+  static const bool readMessage(QTcpSocket *socket, MessageType &type, QByteArray &payload, const int timeout) {
+    char header[5];
+    if (!readBytes(socket, header, 5, timeout))
+      return false;
+    QDataStream stream(QByteArray(header, 5));
+    setUpStream(stream);
+    quint32 size;
+    quint8 value;
+    stream >> size >> value;
+    if (size > MAX_MESSAGE_SIZE)
+      return false;
+    type = MessageType(value);
+    payload.resize(size);
+    return size == 0 || readBytes(socket, payload.data(), size, timeout);
+  }
+
+  static QDataStream &operator<<(QDataStream &stream, const Ogre::Vector3 &vector) {
+    return stream << vector.x << vector.y << vector.z;
+  }
+
+  static QDataStream &operator>>(QDataStream &stream, Ogre::Vector3 &vector) {
+    return stream >> vector.x >> vector.y >> vector.z;
+  }
+
+  static QDataStream &operator<<(QDataStream &stream, const Ogre::ColourValue &colour) {
+    return stream << colour.r << colour.g << colour.b << colour.a;
+  }
+
+  static QDataStream &operator>>(QDataStream &stream, Ogre::ColourValue &colour) {
+    return stream >> colour.r >> colour.g >> colour.b >> colour.a;
+  }
+
+  JobLight::JobLight() : type(LT_POINT), position(Ogre::Vector3::ZERO), direction(Ogre::Vector3::NEGATIVE_UNIT_Y), size(100.0f, 100.0f), diffuse(Ogre::ColourValue::White), specular(Ogre::ColourValue::Black) {
+  }
+
+  RenderJob::RenderJob() : cameraPosition(Ogre::Vector3::ZERO), cameraOrientation(Ogre::Quaternion::IDENTITY), cameraFovY(Ogre::Math::PI / 4.0f), cameraNearClip(1.0f), width(640), height(480), samplesPerPixel(1), supersampling(1) {
+  }
+
+  void RenderJob::setCamera(const Ogre::Camera *camera) {
+    cameraPosition = camera->getDerivedPosition();
+    cameraOrientation = camera->getDerivedOrientation();
+    cameraFovY = camera->getFOVy().valueRadians();
+    cameraNearClip = camera->getNearClipDistance();
+  }
+
+  void RenderJob::applyCamera(Ogre::Camera *camera) const {
+    camera->setPosition(cameraPosition);
+    camera->setOrientation(cameraOrientation);
+    camera->setFOVy(Ogre::Radian(cameraFovY));
+    camera->setNearClipDistance(cameraNearClip);
+    camera->setAspectRatio(Ogre::Real(width) / Ogre::Real(height));
+  }
+
+  Renderer *RenderJob::createRenderer(QString &error, std::vector<Ogre::String> &meshNames) const {
+    Renderer *renderer = new Renderer();
+    meshNames.clear();
+    if (Ogre::StringUtil::endsWith(scenePath, ".aort")) {
+      std::vector<SceneInstance> instances;
+      if (!MeshLibrary::instance()->loadScene(scenePath, meshNames, instances)) {
+        error = QString("Could not load the scene %1").arg(QString::fromStdString(scenePath));
+        delete renderer;
+        return 0;
+      }
+      for (size_t i = 0; i < instances.size(); ++i)
+        renderer->addMesh(MeshLibrary::instance()->getMesh(meshNames.at(instances.at(i).mesh)), instances.at(i).position, instances.at(i).orientation, instances.at(i).scale);
+    } else {
+      Mesh *mesh = MeshLibrary::instance()->load(scenePath);
+      if (!mesh) {
+        error = QString("Could not load the mesh %1").arg(QString::fromStdString(scenePath));
+        delete renderer;
+        return 0;
+      }
+      renderer->addMesh(mesh, Ogre::Vector3::ZERO, Ogre::Quaternion::IDENTITY, Ogre::Vector3::UNIT_SCALE);
+      meshNames.push_back(scenePath);
+    }
+    for (size_t i = 0; i < lights.size(); ++i) {
+      Light *light = new Light();
+      light->setType(lights.at(i).type);
+      light->setPosition(lights.at(i).position);
+      light->setDirection(lights.at(i).direction);
+      light->setSize(lights.at(i).size);
+      light->setDiffuseColour(lights.at(i).diffuse);
+      light->setSpecularColour(lights.at(i).specular);
+      renderer->addLight(light);
+    }
+    renderer->preprocess(0);
+    return renderer;
+  }
+
+  QDataStream &operator<<(QDataStream &stream, const RenderJob &job) {
+    stream << QByteArray(job.scenePath.c_str());
+    stream << quint32(job.lights.size());
+    for (size_t i = 0; i < job.lights.size(); ++i) {
+      const JobLight &light = job.lights.at(i);
+      stream << qint32(light.type) << light.position << light.direction << light.size.x << light.size.y << light.diffuse << light.specular;
+    }
+    stream << job.cameraPosition;
+    stream << job.cameraOrientation.w << job.cameraOrientation.x << job.cameraOrientation.y << job.cameraOrientation.z;
+    stream << job.cameraFovY << job.cameraNearClip;
+    stream << qint32(job.width) << qint32(job.height) << qint32(job.samplesPerPixel) << qint32(job.supersampling);
+    return stream;
+  }
+
+  QDataStream &operator>>(QDataStream &stream, RenderJob &job) {
+    QByteArray scenePath;
+    stream >> scenePath;
+    job.scenePath = Ogre::String(scenePath.constData(), scenePath.size());
+    quint32 lightCount;
+    stream >> lightCount;
+    job.lights.clear();
+    for (quint32 i = 0; i < lightCount && stream.status() == QDataStream::Ok; ++i) {
+      JobLight light;
+      qint32 type;
+      stream >> type >> light.position >> light.direction >> light.size.x >> light.size.y >> light.diffuse >> light.specular;
+      light.type = LightType(type);
+      job.lights.push_back(light);
+    }
+    stream >> job.cameraPosition;
+    stream >> job.cameraOrientation.w >> job.cameraOrientation.x >> job.cameraOrientation.y >> job.cameraOrientation.z;
+    stream >> job.cameraFovY >> job.cameraNearClip;
+    qint32 width, height, samplesPerPixel, supersampling;
+    stream >> width >> height >> samplesPerPixel >> supersampling;
+    job.width = width;
+    job.height = height;
+    job.samplesPerPixel = samplesPerPixel;
+    job.supersampling = supersampling;
+    return stream;
+  }
+
+  // keeps a rendered tile in memory
+  class TileWriter : public ImageWriter {
+  public:
+    TileWriter() : width(0) {
+    }
+
+    const bool begin(const int width, const int height) {
+      this->width = width;
+      colours.assign(width * height * 4, 0.0f);
+      return true;
+    }
+
+    const bool write(const int y, const int count, const float *colours) {
+      std::copy(colours, colours + count * width * 4, this->colours.begin() + y * width * 4);
+      return true;
+    }
+
+    const bool end() {
+      return true;
+    }
+
+    int width;
+    std::vector<float> colours;
+  };
+
+  class RenderWorkerPrivate {
+  public:
+    RenderWorkerPrivate(Ogre::Camera *camera) : camera(camera), renderer(0), timeout(600000) {
+    }
+
+    ~RenderWorkerPrivate() {
+      delete renderer;
+      MeshLibrary::instance()->release(meshNames);
+    }
+
+    // loads and preprocesses the scene of the job, unless it is the scene of the previous job
+    const bool prepare(const RenderJob &job, QString &error) {
+      // the scene depends on the scene file and the lights only
+      QByteArray key;
+      QDataStream stream(&key, QIODevice::WriteOnly);
+      setUpStream(stream);
+      RenderJob sceneJob;
+      sceneJob.scenePath = job.scenePath;
+      sceneJob.lights = job.lights;
+      stream << sceneJob;
+      if (renderer && key == sceneKey)
+        return true;
+      // the meshes of the previous scene are dropped unless the new scene uses them as well
+      delete renderer;
+      sceneKey.clear();
+      std::vector<Ogre::String> previousMeshNames = meshNames;
+      renderer = job.createRenderer(error, meshNames);
+      MeshLibrary::instance()->release(previousMeshNames);
+      if (!renderer)
+        return false;
+      sceneKey = key;
+      return true;
+    }
+
+    // answers the requests of a coordinator until it disconnects or stays silent for longer than the timeout
+    void serve(QTcpSocket *socket) {
+      RenderJob job;
+      bool prepared = false;
+      MessageType type;
+      QByteArray payload;
+      while (readMessage(socket, type, payload, timeout)) {
+        QByteArray reply;
+        QDataStream out(&reply, QIODevice::WriteOnly);
+        setUpStream(out);
+        MessageType replyType = MT_ERROR;
+        QDataStream in(payload);
+        setUpStream(in);
+        if (type == MT_JOB) {
+          in >> job;
+          QString error;
+          prepared = in.status() == QDataStream::Ok && job.width > 0 && job.height > 0 && prepare(job, error);
+          if (prepared) {
+            renderer->setSamplesPerPixel(std::max(1, job.samplesPerPixel));
+            job.applyCamera(camera);
+            replyType = MT_READY;
+          } else {
+            reply = (error.isEmpty() ? QString("Invalid job") : error).toUtf8();
+          }
+        } else if (type == MT_TILE && prepared) {
+          qint32 index, left, top, right, bottom;
+          in >> index >> left >> top >> right >> bottom;
+          renderer->setRegion(Ogre::Rect(left, top, right, bottom));
+          TileWriter writer;
+          if (in.status() == QDataStream::Ok && renderer->render(camera, job.width, job.height, &writer, job.supersampling) >= 0) {
+            replyType = MT_TILE_DATA;
+            out << index;
+            for (size_t i = 0; i < writer.colours.size(); ++i)
+              out << writer.colours[i];
+          } else {
+            reply = QString("Could not render the tile").toUtf8();
+          }
+        } else {
+          reply = QString("Unexpected message").toUtf8();
+        }
+        if (!writeMessage(socket, replyType, reply, timeout))
+          break;
+      }
+      if (socket->error() == QAbstractSocket::SocketTimeoutError) {
+        Ogre::LogManager::getSingletonPtr()->logMessage("Dropping " + socket->peerAddress().toString().toStdString() + " after " + Ogre::StringConverter::toString(timeout) + " ms without progress");
+        socket->abort();
+        return;
+      }
+      socket->disconnectFromHost();
+    }
+
+    QTcpServer server;
+    Ogre::Camera *camera;
+    Renderer *renderer;
+    // meshes of the prepared scene held in the mesh library
+    std::vector<Ogre::String> meshNames;
+    // serialized scene path and lights of the prepared scene
+    QByteArray sceneKey;
+    int timeout;
+  };
+
+  RenderWorker::RenderWorker(Ogre::Camera *camera) : d(new RenderWorkerPrivate(camera)) {
+  }
+
+  RenderWorker::~RenderWorker() {
+    delete d;
+  }
+
+  const bool RenderWorker::listen(const quint16 port) {
+    return d->server.listen(QHostAddress::Any, port);
+  }
+
+  const quint16 RenderWorker::getPort() const {
+    return d->server.serverPort();
+  }
+
+  void RenderWorker::setTimeout(const int milliseconds) {
+    d->timeout = milliseconds;
+  }
+
+  const int RenderWorker::getTimeout() const {
+    return d->timeout;
+  }
+
+  void RenderWorker::exec() {
+    while (d->server.isListening()) {
+      if (!d->server.waitForNewConnection(-1))
+        continue;
+      QTcpSocket *socket = d->server.nextPendingConnection();
+      if (!socket)
+        continue;
+      Ogre::LogManager::getSingletonPtr()->logMessage("Serving " + socket->peerAddress().toString().toStdString());
+      d->serve(socket);
+      delete socket;
+    }
+  }
+
+  class Tile {
+  public:
+    Tile(const int index, const Ogre::Rect &rect) : index(index), rect(rect), attempts(0) {
+    }
+
+    int index;
+    Ogre::Rect rect;
+    int attempts;
+  };
+
+  class TileResult {
+  public:
+    TileResult(const Tile &tile) : tile(tile) {
+    }
+
+    Tile tile;
+    std::vector<float> colours;
+  };
+
+  // state of a render shared by the connection threads and the assembling thread
+  class RenderState {
+  public:
+    RenderState(const RenderJob &job, const int maxAttempts, const int timeout) : job(job), maxAttempts(maxAttempts), timeout(timeout), remaining(0), activeWorkers(0), retries(0), failed(false) {
+    }
+
+    // waits for a tile to render, returns false when there is nothing left to do
+    const bool takeTile(Tile &tile) {
+      QMutexLocker locker(&mutex);
+      while (pending.empty() && remaining > 0 && !failed)
+        changed.wait(&mutex);
+      if (pending.empty() || failed)
+        return false;
+      tile = pending.front();
+      pending.pop_front();
+      return true;
+    }
+
+    // gives a tile back after a failure, the render fails when the tile has been tried too often
+    void returnTile(Tile tile, const QString &reason) {
+      QMutexLocker locker(&mutex);
+      tile.attempts++;
+      retries++;
+      if (tile.attempts >= maxAttempts) {
+        fail(QString("Tile %1 failed %2 times: %3").arg(tile.index).arg(tile.attempts).arg(reason));
+        return;
+      }
+      pending.push_front(tile);
+      changed.wakeAll();
+    }
+
+    void addResult(TileResult *result) {
+      QMutexLocker locker(&mutex);
+      results.push_back(result);
+      remaining--;
+      changed.wakeAll();
+    }
+
+    void removeWorker(const QString &reason) {
+      QMutexLocker locker(&mutex);
+      activeWorkers--;
+      lastWorkerError = reason;
+      changed.wakeAll();
+    }
+
+    // must be called with the mutex locked
+    void fail(const QString &reason) {
+      if (!failed)
+        error = reason;
+      failed = true;
+      changed.wakeAll();
+    }
+
+    const RenderJob &job;
+    int maxAttempts;
+    int timeout;
+    QMutex mutex;
+    QWaitCondition changed;
+    std::deque<Tile> pending;
+    std::deque<TileResult *> results;
+    // tiles without a result
+    int remaining;
+    int activeWorkers;
+    int retries;
+    bool failed;
+    QString error;
+    QString lastWorkerError;
+  };
+
+  // renders tiles on one worker, the blocking socket is used from the thread only
+  class WorkerConnection : public QThread {
+  public:
+    WorkerConnection(RenderState *state, const QString &host, const quint16 port) : state(state), host(host), port(port) {
+    }
+
+  protected:
+    void run() {
+      QString name = QString("%1:%2").arg(host).arg(port);
+      // connection attempts in a row that failed before a tile was rendered
+      int failures = 0;
+      QString reason;
+      while (failures < state->maxAttempts) {
+        QTcpSocket socket;
+        if (!connectWorker(socket, reason)) {
+          failures++;
+          QThread::msleep(100 * failures);
+          continue;
+        }
+        Tile tile(0, Ogre::Rect());
+        while (state->takeTile(tile)) {
+          TileResult *result = renderTile(socket, tile, reason);
+          if (!result) {
+            state->returnTile(tile, name + ": " + reason);
+            break;
+          }
+          state->addResult(result);
+          failures = 0;
+        }
+        if (reason.isEmpty())
+          return;
+        failures++;
+      }
+      state->removeWorker(name + ": " + reason);
+    }
+
+  private:
+    // connects and sends the job, waits until the worker has prepared the scene
+    const bool connectWorker(QTcpSocket &socket, QString &reason) {
+      socket.connectToHost(host, port);
+      if (!socket.waitForConnected(state->timeout)) {
+        reason = socket.errorString();
+        return false;
+      }
+      QByteArray payload;
+      QDataStream stream(&payload, QIODevice::WriteOnly);
+      setUpStream(stream);
+      stream << state->job;
+      MessageType type;
+      if (!writeMessage(&socket, MT_JOB, payload, state->timeout) || !readMessage(&socket, type, payload, state->timeout)) {
+        reason = "Could not send the job";
+        return false;
+      }
+      if (type != MT_READY) {
+        reason = type == MT_ERROR ? QString::fromUtf8(payload.constData(), payload.size()) : QString("Unexpected message");
+        return false;
+      }
+      reason = QString();
+      return true;
+    }
+
+    TileResult *renderTile(QTcpSocket &socket, const Tile &tile, QString &reason) {
+      QByteArray payload;
+      QDataStream out(&payload, QIODevice::WriteOnly);
+      setUpStream(out);
+      out << qint32(tile.index) << qint32(tile.rect.left) << qint32(tile.rect.top) << qint32(tile.rect.right) << qint32(tile.rect.bottom);
+      MessageType type;
+      if (!writeMessage(&socket, MT_TILE, payload, state->timeout) || !readMessage(&socket, type, payload, state->timeout)) {
+        reason = "Connection lost or timed out";
+        return 0;
+      }
+      if (type != MT_TILE_DATA) {
+        reason = type == MT_ERROR ? QString::fromUtf8(payload.constData(), payload.size()) : QString("Unexpected message");
+        return 0;
+      }
+      QDataStream in(payload);
+      setUpStream(in);
+      qint32 index;
+      in >> index;
+      TileResult *result = new TileResult(tile);
+      result->colours.resize(tile.rect.width() * tile.rect.height() * 4);
+      for (size_t i = 0; i < result->colours.size(); ++i)
+        in >> result->colours[i];
+      if (index != tile.index || in.status() != QDataStream::Ok || !in.atEnd()) {
+        delete result;
+        reason = "Invalid tile data";
+        return 0;
+      }
+      return result;
+    }
+
+    RenderState *state;
+    QString host;
+    quint16 port;
+  };
+
+  // rows of tiles, written as soon as they are complete and all bands above them have been written
+  class Band {
+  public:
+    Band() : remaining(0) {
+    }
+
+    std::vector<float> colours;
+    int remaining;
+  };
+
+  class RenderCoordinatorPrivate {
+  public:
+    RenderCoordinatorPrivate() : tileSize(64), maxAttempts(3), timeout(120000), retries(0) {
+    }
+
+    std::vector<std::pair<QString, quint16> > workers;
+    int tileSize;
+    int maxAttempts;
+    int timeout;
+    QString error;
+    int retries;
+  };
+
+  RenderCoordinator::RenderCoordinator() : d(new RenderCoordinatorPrivate()) {
+  }
+
+  RenderCoordinator::~RenderCoordinator() {
+    delete d;
+  }
+
+  void RenderCoordinator::addWorker(const QString &host, const quint16 port) {
+    d->workers.push_back(std::make_pair(host, port));
+  }
+
+  const int RenderCoordinator::getWorkerCount() const {
+    return d->workers.size();
+  }
+
+  void RenderCoordinator::setTileSize(const int size) {
+    d->tileSize = std::min(std::max(1, size), MAX_TILE_SIZE);
+  }
+
+  const int RenderCoordinator::getTileSize() const {
+    return d->tileSize;
+  }
+
+  void RenderCoordinator::setMaxAttempts(const int attempts) {
+    d->maxAttempts = std::max(1, attempts);
+  }
+
+  const int RenderCoordinator::getMaxAttempts() const {
+    return d->maxAttempts;
+  }
+
+  void RenderCoordinator::setTimeout(const int milliseconds) {
+    d->timeout = milliseconds;
+  }
+
+  const int RenderCoordinator::getTimeout() const {
+    return d->timeout;
+  }
+
+  const bool RenderCoordinator::render(const RenderJob &job, ImageWriter *writer) {
+    d->error = QString();
+    d->retries = 0;
+    if (d->workers.empty()) {
+      d->error = "No workers";
+      return false;
+    }
+    if (job.width <= 0 || job.height <= 0 || !writer->begin(job.width, job.height)) {
+      d->error = "Could not begin the image";
+      return false;
+    }
+    // split the frame into tiles in row order, so that the bands are completed from the top
+    RenderState state(job, d->maxAttempts, d->timeout);
+    int bandCount = (job.height + d->tileSize - 1) / d->tileSize;
+    std::map<int, Band> bands;
+    for (int top = 0, index = 0; top < job.height; top += d->tileSize) {
+      for (int left = 0; left < job.width; left += d->tileSize)
+        state.pending.push_back(Tile(index++, Ogre::Rect(left, top, std::min(left + d->tileSize, job.width), std::min(top + d->tileSize, job.height))));
+    }
+    state.remaining = state.pending.size();
+    int tilesPerBand = (job.width + d->tileSize - 1) / d->tileSize;
+    // start a connection for each worker
+    state.activeWorkers = d->workers.size();
+    std::vector<WorkerConnection *> connections;
+    for (size_t i = 0; i < d->workers.size(); ++i) {
+      connections.push_back(new WorkerConnection(&state, d->workers.at(i).first, d->workers.at(i).second));
+      connections.back()->start();
+    }
+    // assemble the tiles into bands and write the complete bands in order
+    bool writerFailed = false;
+    int nextBand = 0;
+    state.mutex.lock();
+    for (;;) {
+      while (state.results.empty() && state.remaining > 0 && state.activeWorkers > 0 && !state.failed)
+        state.changed.wait(&state.mutex);
+      std::deque<TileResult *> results;
+      results.swap(state.results);
+      bool finished = state.remaining == 0 || state.activeWorkers == 0 || state.failed;
+      state.mutex.unlock();
+      for (size_t i = 0; i < results.size(); ++i) {
+        const TileResult *result = results.at(i);
+        const Ogre::Rect &rect = result->tile.rect;
+        int bandIndex = rect.top / d->tileSize;
+        int bandTop = bandIndex * d->tileSize;
+        Band &band = bands[bandIndex];
+        if (band.colours.empty()) {
+          band.colours.resize(job.width * std::min(d->tileSize, job.height - bandTop) * 4);
+          band.remaining = tilesPerBand;
+        }
+        for (long y = rect.top; y < rect.bottom; ++y)
+          std::copy(result->colours.begin() + (y - rect.top) * rect.width() * 4, result->colours.begin() + (y - rect.top + 1) * rect.width() * 4, band.colours.begin() + ((y - bandTop) * job.width + rect.left) * 4);
+        band.remaining--;
+        delete result;
+      }
+      // write the bands that are complete and next in order
+      while (!writerFailed && bands.count(nextBand) && bands[nextBand].remaining == 0) {
+        Band &band = bands[nextBand];
+        writerFailed = !writer->write(nextBand * d->tileSize, band.colours.size() / (job.width * 4), &band.colours[0]);
+        bands.erase(nextBand);
+        nextBand++;
+      }
+      state.mutex.lock();
+      if (writerFailed)
+        state.fail("Could not write the image");
+      if (finished && state.results.empty())
+        break;
+    }
+    // let the connections finish
+    state.changed.wakeAll();
+    state.mutex.unlock();
+    for (size_t i = 0; i < connections.size(); ++i) {
+      connections.at(i)->wait();
+      delete connections.at(i);
+    }
+    for (size_t i = 0; i < state.results.size(); ++i)
+      delete state.results.at(i);
+    d->retries = state.retries;
+    bool result = writer->end();
+    if (state.failed) {
+      d->error = state.error;
+      return false;
+    }
+    if (nextBand < bandCount) {
+      d->error = "No workers left, last error: " + state.lastWorkerError;
+      return false;
+    }
+    return result;
+  }
+
+  const QString &RenderCoordinator::getError() const {
+    return d->error;
+  }
+
+  const int RenderCoordinator::getRetryCount() const {
+    return d->retries;
+  }
+}
@@ -0,0 +1,139 @@
+#ifndef AORTDISTRIBUTED_H
+#define AORTDISTRIBUTED_H
+
+#include "AortLight.h"
+
+#include <QString>
+
+#include <OGRE/OgreColourValue.h>
+#include <OGRE/OgrePrerequisites.h>
+#include <OGRE/OgreQuaternion.h>
+#include <OGRE/OgreVector2.h>
+#include <OGRE/OgreVector3.h>
+
+#include <vector>
+
+// largest edge length of a tile, the data of a tile has to fit into one message
+#define MAX_TILE_SIZE (1024)
+
+class QDataStream;
+
+namespace Ogre {
+  class Camera;
+}
+
+namespace Aort {
+  class ImageWriter;
+  class Renderer;
+
+  class JobLight {
+  public:
+    JobLight();
+
+    LightType type;
+    Ogre::Vector3 position;
+    Ogre::Vector3 direction;
+    Ogre::Vector2 size;
+    Ogre::ColourValue diffuse;
+    Ogre::ColourValue specular;
+  };
+
+  // a frame to be rendered by the workers, the workers load the scene file themselves, so it has to be readable by
+  // them at the same path
+  class RenderJob {
+  public:
+    RenderJob();
+
+    // copies the position, orientation, field of view and near clip distance of the camera
+    void setCamera(const Ogre::Camera *camera);
+    // sets up a camera of a worker to generate the same rays as the camera of the job
+    void applyCamera(Ogre::Camera *camera) const;
+    // creates a renderer with the scene and the lights of the job and preprocesses it, returns 0 and sets the error
+    // if the scene cannot be loaded, the mesh library is used, so it must not be called from several threads at once,
+    // the names of the loaded meshes are returned and have to be released from the mesh library after the renderer
+    // has been deleted
+    Renderer *createRenderer(QString &error, std::vector<Ogre::String> &meshNames) const;
+
+    // aort scene or a mesh file readable by assimp
+    Ogre::String scenePath;
+    std::vector<JobLight> lights;
+    Ogre::Vector3 cameraPosition;
+    Ogre::Quaternion cameraOrientation;
+    // vertical field of view in radians
+    Ogre::Real cameraFovY;
+    Ogre::Real cameraNearClip;
+    int width;
+    int height;
+    int samplesPerPixel;
+    int supersampling;
+  };
+
+  QDataStream &operator<<(QDataStream &stream, const RenderJob &job);
+  QDataStream &operator>>(QDataStream &stream, RenderJob &job);
+
+  class RenderWorkerPrivate;
+
+  // renders tiles of the jobs of a coordinator connected over tcp, one connection is served at a time, the scene of
+  // the last job stays prepared for the next job with the same scene and lights
+  class RenderWorker {
+  public:
+    // the camera is set up for each job, it is not owned
+    RenderWorker(Ogre::Camera *camera);
+    ~RenderWorker();
+
+    const bool listen(const quint16 port);
+    const quint16 getPort() const;
+
+    // time to wait for the next request of a coordinator or for a reply to be sent before the connection is dropped,
+    // so that a coordinator that went away does not keep the worker from serving the next one
+    void setTimeout(const int milliseconds);
+    const int getTimeout() const;
+
+    // serves the connections until the process is stopped
+    void exec();
+
+  private:
+    RenderWorkerPrivate *d;
+  };
+
+  class RenderCoordinatorPrivate;
+
+  // splits frames into tiles and renders them on the workers in parallel, a tile that fails is given to the next free
+  // worker, a worker that cannot be reached is dropped, the tiles are assembled into bands of rows which are written
+  // in order, so only the bands that are not complete yet are kept in memory
+  class RenderCoordinator {
+  public:
+    RenderCoordinator();
+    ~RenderCoordinator();
+
+    void addWorker(const QString &host, const quint16 port);
+    const int getWorkerCount() const;
+
+    // edge length of the square tiles in pixels, at most MAX_TILE_SIZE
+    void setTileSize(const int size);
+    const int getTileSize() const;
+
+    // times a tile is tried before the render fails, also the number of failed connections after which a worker is
+    // dropped
+    void setMaxAttempts(const int attempts);
+    const int getMaxAttempts() const;
+
+    // time to wait for a worker to prepare the scene or to render a tile before it is treated as failed
+    void setTimeout(const int milliseconds);
+    const int getTimeout() const;
+
+    // renders the job on the workers into the writer, returns false if a tile failed on every attempt, no worker is
+    // left or the writer fails
+    const bool render(const RenderJob &job, ImageWriter *writer);
+
+    // reason of the last failed render
+    const QString &getError() const;
+    // tiles of the last render that had to be rendered again after a failure
+    const int getRetryCount() const;
+
+  private:
+    RenderCoordinatorPrivate *d;
+  };
+}
+
+#endif // AORTDISTRIBUTED_H
@@ -0,0 +1,112 @@
+#include "AortFrameBuffer.h"
+
+#include "AortImageWriter.h"
+
+#include <OGRE/OgreMath.h>
+
+#include <math.h>
+
+#include <algorithm>
+
+#ifndef NO_OMP
+#include <omp.h>
+#endif // !NO_OMP
+
+namespace Aort {
+  FrameBuffer::FrameBuffer() : width(0), height(0) {
+  }
+
+  void FrameBuffer::resize(const int width, const int height) {
+    this->width = width;
+    this->height = height;
+    colours.assign(width * height * 4, 0.0f);
+    sampleCounts.assign(width * height, 0);
+  }
+
+  void FrameBuffer::clear() {
+    std::fill(colours.begin(), colours.end(), 0.0f);
+    std::fill(sampleCounts.begin(), sampleCounts.end(), 0);
+  }
+
+  void FrameBuffer::clear(const Ogre::Rect &region) {
+    for (long y = region.top; y < region.bottom; ++y) {
+      std::fill(colours.begin() + (y * width + region.left) * 4, colours.begin() + (y * width + region.right) * 4, 0.0f);
+      std::fill(sampleCounts.begin() + y * width + region.left, sampleCounts.begin() + y * width + region.right, 0);
+    }
+  }
+
+  const int FrameBuffer::getWidth() const {
+    return width;
+  }
+
+  const int FrameBuffer::getHeight() const {
+    return height;
+  }
+
+  void FrameBuffer::addSample(const int x, const int y, const Ogre::ColourValue &colour) {
+    float *sum = &colours[(y * width + x) * 4];
+    sum[0] += colour.r;
+    sum[1] += colour.g;
+    sum[2] += colour.b;
+    sum[3] += colour.a;
+    sampleCounts[y * width + x]++;
+  }
+
+  const Ogre::uint32 FrameBuffer::getSampleCount(const int x, const int y) const {
+    return sampleCounts[y * width + x];
+  }
+
+  const Ogre::ColourValue FrameBuffer::getColour(const int x, const int y) const {
+    Ogre::uint32 count = sampleCounts[y * width + x];
+    if (count == 0)
+      return Ogre::ColourValue(0.0f, 0.0f, 0.0f, 0.0f);
+    const float *sum = &colours[(y * width + x) * 4];
+    float scale = 1.0f / count;
+    return Ogre::ColourValue(sum[0] * scale, sum[1] * scale, sum[2] * scale, sum[3] * scale);
+  }
+
+  void FrameBuffer::tonemap(uchar *buffer, const Ogre::Real exposure) const {
+    tonemap(buffer, exposure, Ogre::Rect(0, 0, width, height));
+  }
+
+  void FrameBuffer::tonemap(uchar *buffer, const Ogre::Real exposure, const Ogre::Rect &region) const {
+    Ogre::Real scale = powf(2.0f, exposure);
+#ifndef NO_OMP
+    #pragma omp parallel for
+#endif // !NO_OMP
+    for (int y = region.top; y < region.bottom; ++y) {
+      uchar *scanline = buffer + y * width * 4;
+      for (int x = region.left; x < region.right; ++x) {
+        Ogre::ColourValue colour = getColour(x, y);
+        scanline[x * 4 + 0] = Ogre::Math::Clamp(colour.b * scale, 0.0f, 1.0f) * 255;
+        scanline[x * 4 + 1] = Ogre::Math::Clamp(colour.g * scale, 0.0f, 1.0f) * 255;
+        scanline[x * 4 + 2] = Ogre::Math::Clamp(colour.r * scale, 0.0f, 1.0f) * 255;
+        scanline[x * 4 + 3] = Ogre::Math::Clamp(colour.a, 0.0f, 1.0f) * 255;
+      }
+    }
+  }
+
+  const bool FrameBuffer::write(ImageWriter &writer) const {
+    if (!writer.begin(width, height))
+      return false;
+    std::vector<float> row(width * 4);
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        Ogre::ColourValue colour = getColour(x, y);
+        row[x * 4 + 0] = colour.r;
+        row[x * 4 + 1] = colour.g;
+        row[x * 4 + 2] = colour.b;
+        row[x * 4 + 3] = colour.a;
+      }
+      if (!writer.write(y, 1, &row[0])) {
+        writer.end();
+        return false;
+      }
+    }
+    return writer.end();
+  }
+
+  const size_t FrameBuffer::memoryUsage() const {
+    return colours.capacity() * sizeof(float) + sampleCounts.capacity() * sizeof(Ogre::uint32);
+  }
+}
@@ -0,0 +1,56 @@
+#ifndef AORTFRAMEBUFFER_H
+#define AORTFRAMEBUFFER_H
+
+#include <OGRE/OgreColourValue.h>
+#include <OGRE/OgreCommon.h>
+#include <OGRE/OgrePrerequisites.h>
+
+#include <QtGlobal>
+
+#include <vector>
+
+namespace Aort {
+  class ImageWriter;
+
+  // linear colours of the rendered pixels, the samples of each pixel are summed so that more samples and passes can
+  // be added later, the colours are only clamped and quantized when they are tonemapped
+  class FrameBuffer {
+  public:
+    FrameBuffer();
+
+    // resizes the buffer and removes all samples
+    void resize(const int width, const int height);
+    void clear();
+    // removes the samples of the pixels inside the region, right and bottom are exclusive
+    void clear(const Ogre::Rect &region);
+
+    const int getWidth() const;
+    const int getHeight() const;
+
+    // adds a sample to a pixel, a pixel must not be written by more than one thread at a time
+    void addSample(const int x, const int y, const Ogre::ColourValue &colour);
+    const Ogre::uint32 getSampleCount(const int x, const int y) const;
+    // average of the samples of a pixel, black if it has none
+    const Ogre::ColourValue getColour(const int x, const int y) const;
+
+    // scales the colours by two to the power of exposure, clamps them to [0, 1] and writes them as a 32-bit argb
+    // image, that is bgra byte order on little endian machines
+    void tonemap(uchar *buffer, const Ogre::Real exposure = 0.0f) const;
+    // tonemaps the pixels inside the region only, the buffer has the size of the frame buffer
+    void tonemap(uchar *buffer, const Ogre::Real exposure, const Ogre::Rect &region) const;
+
+    // writes the average colours, row by row
+    const bool write(ImageWriter &writer) const;
+
+    const size_t memoryUsage() const;
+
+  private:
+    int width;
+    int height;
+    // sums of the samples, four floats per pixel in row order, and the sample count of each pixel
+    std::vector<float> colours;
+    std::vector<Ogre::uint32> sampleCounts;
+  };
+}
+
+#endif // AORTFRAMEBUFFER_H
@@ -0,0 +1,284 @@
+#include "AortImageWriter.h"
+
+#include <QFile>
+
+#include <OGRE/OgreMath.h>
+#include <OGRE/OgreString.h>
+#include <OGRE/OgreStringConverter.h>
+
+#include <math.h>
+#include <string.h>
+
+#include <vector>
+
+#include <zlib.h>
+
+// size of the compressed data collected before it is written as a png chunk
+#define PNG_CHUNK_SIZE (1 << 16)
+
+namespace Aort {
+  // appenders of little endian values, openexr and pfm are little endian on all platforms
+  static void appendUInt32(std::vector<char> &data, const Ogre::uint32 value) {
+    for (int i = 0; i < 4; ++i)
+      data.push_back(char((value >> (i * 8)) & 0xff));
+  }
+
+  static void appendUInt64(std::vector<char> &data, const Ogre::uint64 value) {
+    for (int i = 0; i < 8; ++i)
+      data.push_back(char((value >> (i * 8)) & 0xff));
+  }
+
+  static void appendFloat(std::vector<char> &data, const float value) {
+    Ogre::uint32 bits;
+    memcpy(&bits, &value, 4);
+    appendUInt32(data, bits);
+  }
+
+  static void appendString(std::vector<char> &data, const char *text) {
+    data.insert(data.end(), text, text + strlen(text) + 1);
+  }
+
+  // openexr header attribute, the name and type are followed by the size of the value
+  static void appendAttribute(std::vector<char> &data, const char *name, const char *type, const Ogre::uint32 size) {
+    appendString(data, name);
+    appendString(data, type);
+    appendUInt32(data, size);
+  }
+
+  // png is big endian
+  static void appendBigEndian(std::vector<char> &data, const Ogre::uint32 value) {
+    for (int i = 3; i >= 0; --i)
+      data.push_back(char((value >> (i * 8)) & 0xff));
+  }
+
+  ImageWriter::~ImageWriter() {
+  }
+
+  class ImageFileWriterPrivate {
+  public:
+    ImageFileWriterPrivate(const ImageFormat format, const Ogre::Real exposure) : device(&file), format(format), scale(powf(2.0f, exposure)), width(0), height(0), headerSize(0), nextRow(0), deflating(false) {
+    }
+
+    const bool writeData(const std::vector<char> &data) {
+      return data.empty() || device->write(&data[0], data.size()) == qint64(data.size());
+    }
+
+    const bool writePngChunk(const char *type, const char *data, const size_t size) {
+      // the checksum covers the type and the data
+      std::vector<char> chunk;
+      appendBigEndian(chunk, size);
+      chunk.insert(chunk.end(), type, type + 4);
+      chunk.insert(chunk.end(), data, data + size);
+      uLong crc = crc32(0, reinterpret_cast<const Bytef *>(&chunk[4]), size + 4);
+      appendBigEndian(chunk, crc);
+      return writeData(chunk);
+    }
+
+    // compresses the input and writes the output in chunks whenever the output buffer is full, or all of it when finishing
+    const bool deflateRows(const int flush) {
+      do {
+        stream.next_out = reinterpret_cast<Bytef *>(&compressed[0]);
+        stream.avail_out = compressed.size();
+        if (deflate(&stream, flush) == Z_STREAM_ERROR)
+          return false;
+        size_t size = compressed.size() - stream.avail_out;
+        if (size > 0 && !writePngChunk("IDAT", &compressed[0], size))
+          return false;
+      } while (stream.avail_out == 0);
+      return true;
+    }
+
+    QFile file;
+    // the file or the device given by the user, which is not owned
+    QIODevice *device;
+    ImageFormat format;
+    Ogre::Real scale;
+    int width;
+    int height;
+    // size of the header before the pixels of pfm and openexr
+    size_t headerSize;
+    // png is compressed as a stream, its rows are accepted in order only
+    int nextRow;
+    bool deflating;
+    z_stream stream;
+    std::vector<char> compressed;
+  };
+
+  ImageFileWriter::ImageFileWriter(const Ogre::String &path, const ImageFormat format, const Ogre::Real exposure) : d(new ImageFileWriterPrivate(format, exposure)) {
+    d->file.setFileName(path.c_str());
+  }
+
+  ImageFileWriter::ImageFileWriter(QIODevice *device, const ImageFormat format, const Ogre::Real exposure) : d(new ImageFileWriterPrivate(format, exposure)) {
+    d->device = device;
+  }
+
+  ImageFileWriter::~ImageFileWriter() {
+    if (d->deflating)
+      deflateEnd(&d->stream);
+    delete d;
+  }
+
+  const bool ImageFileWriter::begin(const int width, const int height) {
+    d->width = width;
+    d->height = height;
+    d->nextRow = 0;
+    if (!d->device->isOpen() && !d->device->open(QIODevice::WriteOnly))
+      return false;
+    std::vector<char> data;
+    if (d->format == IF_PNG) {
+      const char signature[8] = { char(0x89), 'P', 'N', 'G', '\r', '\n', char(0x1a), '\n' };
+      data.insert(data.end(), signature, signature + 8);
+      if (!d->writeData(data))
+        return false;
+      // 8-bit rgb, deflate compression, adaptive filtering, no interlacing
+      std::vector<char> header;
+      appendBigEndian(header, width);
+      appendBigEndian(header, height);
+      header.push_back(8);
+      header.push_back(2);
+      header.push_back(0);
+      header.push_back(0);
+      header.push_back(0);
+      if (!d->writePngChunk("IHDR", &header[0], header.size()))
+        return false;
+      memset(&d->stream, 0, sizeof(z_stream));
+      if (deflateInit(&d->stream, Z_DEFAULT_COMPRESSION) != Z_OK)
+        return false;
+      d->deflating = true;
+      d->compressed.resize(PNG_CHUNK_SIZE);
+      return true;
+    } else if (d->format == IF_EXR) {
+      // magic number and version 2 of a single part scanline image
+      appendUInt32(data, 20000630);
+      appendUInt32(data, 2);
+      // 32-bit float channels, sorted by name as the format requires
+      const char *channelNames[4] = { "A", "B", "G", "R" };
+      appendAttribute(data, "channels", "chlist", 4 * 18 + 1);
+      for (int i = 0; i < 4; ++i) {
+        appendString(data, channelNames[i]);
+        appendUInt32(data, 2);
+        // linear flag and reserved bytes
+        appendUInt32(data, 0);
+        // sampling
+        appendUInt32(data, 1);
+        appendUInt32(data, 1);
+      }
+      data.push_back(0);
+      appendAttribute(data, "compression", "compression", 1);
+      data.push_back(0);
+      appendAttribute(data, "dataWindow", "box2i", 16);
+      appendUInt32(data, 0);
+      appendUInt32(data, 0);
+      appendUInt32(data, width - 1);
+      appendUInt32(data, height - 1);
+      appendAttribute(data, "displayWindow", "box2i", 16);
+      appendUInt32(data, 0);
+      appendUInt32(data, 0);
+      appendUInt32(data, width - 1);
+      appendUInt32(data, height - 1);
+      appendAttribute(data, "lineOrder", "lineOrder", 1);
+      data.push_back(0);
+      appendAttribute(data, "pixelAspectRatio", "float", 4);
+      appendFloat(data, 1.0f);
+      appendAttribute(data, "screenWindowCenter", "v2f", 8);
+      appendFloat(data, 0.0f);
+      appendFloat(data, 0.0f);
+      appendAttribute(data, "screenWindowWidth", "float", 4);
+      appendFloat(data, 1.0f);
+      // end of the header
+      data.push_back(0);
+      // offsets of the uncompressed scanlines, each one is its own block with its row and size before the channels,
+      // the sizes are known in advance so the rows can be written in any order
+      Ogre::uint64 offset = data.size() + height * sizeof(Ogre::uint64);
+      for (int y = 0; y < height; ++y)
+        appendUInt64(data, offset + Ogre::uint64(y) * (8 + width * 4 * sizeof(float)));
+    } else if (d->format == IF_PFM) {
+      // the negative scale marks little endian data
+      Ogre::String header = "PF\n" + Ogre::StringConverter::toString(width) + " " + Ogre::StringConverter::toString(height) + "\n-1.0\n";
+      data.assign(header.begin(), header.end());
+    }
+    d->headerSize = data.size();
+    return d->writeData(data);
+  }
+
+  const bool ImageFileWriter::write(const int y, const int count, const float *colours) {
+    std::vector<char> data;
+    if (d->format == IF_PNG) {
+      if (y != d->nextRow)
+        return false;
+      d->nextRow += count;
+      // each row starts with its filter type, the sub filter stores the difference to the pixel on the left
+      data.reserve((d->width * 3 + 1) * count);
+      for (int i = 0; i < count; ++i) {
+        const float *row = colours + i * d->width * 4;
+        data.push_back(1);
+        uchar previous[3] = { 0, 0, 0 };
+        for (int x = 0; x < d->width; ++x) {
+          for (int c = 0; c < 3; ++c) {
+            uchar value = Ogre::Math::Clamp(row[x * 4 + c] * d->scale, 0.0f, 1.0f) * 255;
+            data.push_back(char(value - previous[c]));
+            previous[c] = value;
+          }
+        }
+      }
+      d->stream.next_in = reinterpret_cast<Bytef *>(&data[0]);
+      d->stream.avail_in = data.size();
+      return d->deflateRows(Z_NO_FLUSH);
+    } else if (d->format == IF_EXR) {
+      Ogre::uint32 lineSize = d->width * 4 * sizeof(float);
+      data.reserve((8 + lineSize) * count);
+      for (int i = 0; i < count; ++i) {
+        const float *row = colours + i * d->width * 4;
+        appendUInt32(data, y + i);
+        appendUInt32(data, lineSize);
+        // channels are stored one after the other
+        for (int c = 3; c >= 0; --c)
+          for (int x = 0; x < d->width; ++x)
+            appendFloat(data, row[x * 4 + c]);
+      }
+      return d->device->seek(d->headerSize + qint64(y) * (8 + lineSize)) && d->writeData(data);
+    } else if (d->format == IF_PFM) {
+      // the rows are stored from the bottom to the top, each one is written at its place
+      qint64 lineSize = d->width * 3 * sizeof(float);
+      for (int i = 0; i < count; ++i) {
+        const float *row = colours + i * d->width * 4;
+        data.clear();
+        for (int x = 0; x < d->width; ++x)
+          for (int c = 0; c < 3; ++c)
+            appendFloat(data, row[x * 4 + c]);
+        if (!d->device->seek(d->headerSize + (d->height - 1 - (y + i)) * lineSize) || !d->writeData(data))
+          return false;
+      }
+      return true;
+    }
+    return false;
+  }
+
+  const bool ImageFileWriter::end() {
+    bool result = true;
+    if (d->format == IF_PNG) {
+      // flush the compressed stream, a png missing rows is not valid
+      d->stream.next_in = 0;
+      d->stream.avail_in = 0;
+      result = d->nextRow == d->height && d->deflateRows(Z_FINISH) && d->writePngChunk("IEND", 0, 0);
+      deflateEnd(&d->stream);
+      d->deflating = false;
+    }
+    // a device of the user is left open
+    if (d->device == &d->file)
+      d->file.close();
+    return result;
+  }
+
+  const bool ImageFileWriter::formatFromPath(const Ogre::String &path, ImageFormat &format) {
+    if (Ogre::StringUtil::endsWith(path, ".png"))
+      format = IF_PNG;
+    else if (Ogre::StringUtil::endsWith(path, ".exr"))
+      format = IF_EXR;
+    else if (Ogre::StringUtil::endsWith(path, ".pfm"))
+      format = IF_PFM;
+    else
+      return false;
+    return true;
+  }
+}
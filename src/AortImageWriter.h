@@ -0,0 +1,53 @@
+#ifndef AORTIMAGEWRITER_H
+#define AORTIMAGEWRITER_H
+
+#include <OGRE/OgrePrerequisites.h>
+
+class QIODevice;
+
+namespace Aort {
+  // receives an image as rows of linear rgba floats while it is rendered, so that it does not have to be kept in memory
+  class ImageWriter {
+  public:
+    virtual ~ImageWriter();
+
+    virtual const bool begin(const int width, const int height) = 0;
+    // writes count rows starting at row y, width * 4 floats per row
+    virtual const bool write(const int y, const int count, const float *colours) = 0;
+    virtual const bool end() = 0;
+  };
+
+  enum ImageFormat {
+    // 8-bit rgb, the colours are tonemapped, the rows have to be written from the top to the bottom
+    IF_PNG,
+    // uncompressed 32-bit float scanline openexr
+    IF_EXR,
+    // 32-bit float portable float map
+    IF_PFM
+  };
+
+  class ImageFileWriterPrivate;
+
+  // writes the rows directly to the file, only the compression state of png is kept in memory
+  class ImageFileWriter : public ImageWriter {
+  public:
+    // the exposure in stops is applied when the colours are tonemapped for 8-bit formats
+    ImageFileWriter(const Ogre::String &path, const ImageFormat format, const Ogre::Real exposure = 0.0f);
+    // writes to a device instead of a file, the device is opened for writing if it is not open, it has to be seekable
+    // for pfm and openexr, it is not owned
+    ImageFileWriter(QIODevice *device, const ImageFormat format, const Ogre::Real exposure = 0.0f);
+    ~ImageFileWriter();
+
+    const bool begin(const int width, const int height);
+    const bool write(const int y, const int count, const float *colours);
+    const bool end();
+
+    // picks the format from the extension of the path, returns false if it is not known
+    static const bool formatFromPath(const Ogre::String &path, ImageFormat &format);
+
+  private:
+    ImageFileWriterPrivate *d;
+  };
+}
+
+#endif // AORTIMAGEWRITER_H
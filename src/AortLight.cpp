@@ -7,11 +7,24 @@
 namespace Aort {
   class LightPrivate {
   public:
-    LightPrivate() : type(LT_POINT), diffuseColour(1.0f, 1.0f, 1.0f), specularColour(0.0f, 0.0f, 0.0f), size(100.0f, 100.0f), modified(true) {
+    LightPrivate() : type(LT_POINT), diffuseColour(1.0f, 1.0f, 1.0f), specularColour(0.0f, 0.0f, 0.0f), position(0.0f, 0.0f, 0.0f), size(100.0f, 100.0f) {
+      updateGrid();
     }
     ~LightPrivate() {
     }
 
+    // the grid is updated when the light changes, so that reading it from several threads is safe
+    void updateGrid() {
+      // calculate cell size
+      cellSizeX = size.x * 0.25f;
+      cellSizeY = size.y * 0.25f;
+      // calculate top left point
+      Ogre::Vector3 p1(position.x - size.x * 0.5f, position.y, position.z - size.y * 0.5f);
+      // calculate top left of each cell
+      for (int i = 0; i < 16; ++i)
+        grid[i] = p1 + Ogre::Vector3((i / 4) * cellSizeX, 0, (i % 4) * cellSizeY);
+    }
+
     LightType type;
     Ogre::ColourValue diffuseColour;
     Ogre::ColourValue specularColour;
@@ -21,8 +34,6 @@ namespace Aort {
     Ogre::Real cellSizeX;
     Ogre::Real cellSizeY;
     Ogre::Vector3 grid[16];
-    Ogre::Vector3 points[16];
-    bool modified;
   };
 
   Light::Light() : d(new LightPrivate()) {
@@ -62,8 +73,7 @@ namespace Aort {
 
   void Light::setPosition(const Ogre::Vector3 &position) {
     d->position = position;
-    // set modified flag
-    d->modified = true;
+    d->updateGrid();
   }
 
   const Ogre::Vector3 &Light::getDirection() const {
@@ -72,8 +82,6 @@ namespace Aort {
 
   void Light::setDirection(const Ogre::Vector3 &direction) {
     d->direction = direction;
-    // set modified flag
-    d->modified = true;
   }
 
   const Ogre::Vector2 &Light::getSize() const {
@@ -82,31 +90,19 @@ namespace Aort {
 
   void Light::setSize(const Ogre::Vector2 &size) {
     d->size = size;
-    // set modified flag
-    d->modified = true;
-  }
-
-  float randf() {
-    return float(rand()) / float(RAND_MAX);
-  }
-
-  const Ogre::Vector3 *Light::getPoints() const {
-    if (d->modified) {
-      // calculate cell size
-      d->cellSizeX = d->size.x * 0.25f;
-      d->cellSizeY = d->size.y * 0.25f;
-      // calculate top left point
-      Ogre::Vector3 p1(d->position.x - d->size.x * 0.5f, d->position.y, d->position.z - d->size.y * 0.5f);
-      // calculate top left of each cell
-      for (int i = 0; i < 16; ++i)
-        d->grid[i] = p1 + Ogre::Vector3((i / 4) * d->cellSizeX, 0, (i % 4) * d->cellSizeY);
-      // unset modified flag
-      d->modified = false;
+    d->updateGrid();
+  }
+
+  void Light::getPoints(Ogre::Vector3 *points, const Ogre::uint32 seed) const {
+    // jitter a point inside each cell, a linear congruential generator seeded by the caller keeps the points
+    // independent of other threads
+    Ogre::uint32 state = seed;
+    for (int i = 0; i < 16; ++i) {
+      state = state * 1664525u + 1013904223u;
+      Ogre::Real x = (state >> 8) * (1.0f / 16777216.0f);
+      state = state * 1664525u + 1013904223u;
+      Ogre::Real y = (state >> 8) * (1.0f / 16777216.0f);
+      points[i] = d->grid[i] + Ogre::Vector3(x * d->cellSizeX, 0.0f, y * d->cellSizeY);
     }
-    // calculate points
-    for (int i = 0; i < 16; ++i)
-      d->points[i] = d->grid[i] + Ogre::Vector3(randf() * d->cellSizeX, 0.0f, randf() * d->cellSizeY);
-    // return result
-    return d->points;
   }
 }
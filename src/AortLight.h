@@ -34,7 +34,8 @@ namespace Aort {
     const Ogre::Vector2 &getSize() const;
     void setSize(const Ogre::Vector2 &size);
 
-    const Ogre::Vector3 *getPoints() const;
+    // fills 16 points jittered inside the cells of a 4 by 4 grid over an area light, the seed picks the jitter
+    void getPoints(Ogre::Vector3 *points, const Ogre::uint32 seed) const;
 
   private:
     LightPrivate *d;
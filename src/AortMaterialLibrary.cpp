@@ -0,0 +1,139 @@
+#include "AortMaterialLibrary.h"
+
+#include "AortMaterial.h"
+#include "AortTexture.h"
+#include "AortTrace.h"
+
+#include <OGRE/OgreImage.h>
+#include <OGRE/OgreMaterial.h>
+#include <OGRE/OgreMaterialManager.h>
+#include <OGRE/OgrePass.h>
+#include <OGRE/OgreResourceGroupManager.h>
+#include <OGRE/OgreTechnique.h>
+#include <OGRE/OgreTextureUnitState.h>
+
+#include <map>
+
+namespace Aort {
+  class MaterialLibraryPrivate {
+  public:
+    MaterialLibraryPrivate() {
+    }
+
+    ~MaterialLibraryPrivate() {
+      clear();
+    }
+
+    void clear() {
+      // delete materials
+      for (std::map<Ogre::String, Material *>::iterator it = materials.begin(); it != materials.end(); ++it)
+        delete it->second;
+      materials.clear();
+      // delete textures
+      for (size_t i = 0; i < textures.size(); ++i)
+        delete textures.at(i);
+      textures.clear();
+      // delete images
+      for (std::map<Ogre::String, Ogre::Image *>::iterator it = images.begin(); it != images.end(); ++it)
+        delete it->second;
+      images.clear();
+    }
+
+    Material *readMaterial(MaterialLibrary *library, const Ogre::String &materialName) {
+      // create a material
+      Material *material = new Material(materialName);
+      // get ogre material
+      Ogre::MaterialPtr materialPtr = Ogre::MaterialManager::getSingletonPtr()->getByName(materialName);
+      // if ogre material is null, return a default material
+      if (materialPtr.isNull())
+        return material;
+      Ogre::Material *ogreMaterial = materialPtr.getPointer();
+      // get first pass of the best technique
+      if (ogreMaterial->getNumTechniques() && ogreMaterial->getBestTechnique()->getNumPasses()) {
+        Ogre::Pass *pass = ogreMaterial->getBestTechnique()->getPass(0);
+        // parse material properties
+        material->setAmbient(pass->getAmbient());
+        material->setDiffuse(pass->getDiffuse());
+        material->setSpecular(pass->getSpecular());
+        material->setShininess(pass->getShininess());
+        // TODO: read reflectivity
+        material->setReflectivity(0.25f);
+        // parse first texture
+        if (pass->getNumTextureUnitStates() && pass->getTextureUnitState(0)->getTextureName() != "") {
+          // get texture unit state object
+          Ogre::TextureUnitState *tus = pass->getTextureUnitState(0);
+          // create texture object, image is shared between all textures using it
+          Texture *texture = library->createTexture(tus->getTextureName());
+          // parse texture properties
+          texture->setTransform(tus->getTextureTransform());
+          texture->setFilter(tus->getTextureFiltering(Ogre::FT_MIN));
+          texture->setAnisotropy(tus->getTextureAnisotropy());
+          // set material texture
+          material->setTexture(texture);
+        }
+      }
+      return material;
+    }
+
+    std::map<Ogre::String, Material *> materials;
+    std::map<Ogre::String, Ogre::Image *> images;
+    std::vector<Texture *> textures;
+  };
+
+  MaterialLibrary::MaterialLibrary() : d(new MaterialLibraryPrivate()) {
+  }
+
+  MaterialLibrary::~MaterialLibrary() {
+    delete d;
+  }
+
+  Material *MaterialLibrary::getMaterial(const Ogre::String &name) {
+    // return the material if it has already been read
+    std::map<Ogre::String, Material *>::const_iterator it = d->materials.find(name);
+    if (it != d->materials.end())
+      return it->second;
+    // read material and save it
+    TraceSpan span("preprocess", "read material", name);
+    Material *material = d->readMaterial(this, name);
+    d->materials[name] = material;
+    // return material
+    return material;
+  }
+
+  Ogre::Image *MaterialLibrary::getImage(const Ogre::String &name) {
+    // return the image if it has already been loaded
+    std::map<Ogre::String, Ogre::Image *>::const_iterator it = d->images.find(name);
+    if (it != d->images.end())
+      return it->second;
+    // load image and save it
+    TraceSpan span("preprocess", "load image", name);
+    Ogre::Image *image = new Ogre::Image();
+    image->load(name, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+    d->images[name] = image;
+    // return image
+    return image;
+  }
+
+  Texture *MaterialLibrary::createTexture(const Ogre::String &imageName) {
+    // create texture object
+    Texture *texture = new Texture();
+    texture->setName(imageName);
+    texture->setImage(getImage(imageName));
+    // save texture
+    d->textures.push_back(texture);
+    // return texture
+    return texture;
+  }
+
+  const size_t MaterialLibrary::materialCount() const {
+    return d->materials.size();
+  }
+
+  const size_t MaterialLibrary::imageCount() const {
+    return d->images.size();
+  }
+
+  void MaterialLibrary::clear() {
+    d->clear();
+  }
+}
@@ -0,0 +1,31 @@
+#ifndef AORTMATERIALLIBRARY_H
+#define AORTMATERIALLIBRARY_H
+
+#include <OGRE/OgrePrerequisites.h>
+
+namespace Aort {
+  class Material;
+  class Texture;
+
+  class MaterialLibraryPrivate;
+
+  class MaterialLibrary {
+  public:
+    MaterialLibrary();
+    ~MaterialLibrary();
+
+    Material *getMaterial(const Ogre::String &name);
+    Ogre::Image *getImage(const Ogre::String &name);
+    Texture *createTexture(const Ogre::String &imageName);
+
+    const size_t materialCount() const;
+    const size_t imageCount() const;
+
+    void clear();
+
+  private:
+    MaterialLibraryPrivate *d;
+  };
+}
+
+#endif // AORTMATERIALLIBRARY_H
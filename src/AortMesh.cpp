@@ -0,0 +1,229 @@
+#include "AortMesh.h"
+
+#include <algorithm>
+#include <math.h>
+
+namespace Aort {
+  Mesh::Mesh(const size_t vertexCount, const size_t triangleCount) : mVertexCount(vertexCount), mTriangleCount(triangleCount), mOwnsData(true), mCompressed(false), mQuantizedPositions(0), mQuantizedNormals(0), mQuantizedTexCoords(0), mTransformed(false) {
+    // create vertex attribute arrays, vectors are initialized to zero
+    mPositions = new Ogre::Vector3[vertexCount];
+    mNormals = new Ogre::Vector3[vertexCount];
+    mTexCoords = new Ogre::Vector2[vertexCount];
+    // create index arrays
+    mIndices = new Ogre::uint32[triangleCount * 3];
+    mMaterialIndices = new Ogre::uint16[triangleCount];
+  }
+
+  // copies an external array into an owned one
+  template <class T>
+  static T *copyArray(const T *source, const size_t count) {
+    if (!source)
+      return 0;
+    T *copy = new T[count];
+    std::copy(source, source + count, copy);
+    return copy;
+  }
+
+  Mesh::Mesh(const size_t vertexCount, const size_t triangleCount, const Ogre::Vector3 *positions, const Ogre::Vector3 *normals, const Ogre::Vector2 *texCoords, const Ogre::uint32 *indices, const Ogre::uint16 *materialIndices) :
+    mVertexCount(vertexCount), mTriangleCount(triangleCount), mOwnsData(false), mCompressed(false), mQuantizedPositions(0), mQuantizedNormals(0), mQuantizedTexCoords(0), mTransformed(false) {
+    // the arrays of a view are only written after detach has copied them
+    mPositions = const_cast<Ogre::Vector3 *>(positions);
+    mNormals = const_cast<Ogre::Vector3 *>(normals);
+    mTexCoords = const_cast<Ogre::Vector2 *>(texCoords);
+    mIndices = const_cast<Ogre::uint32 *>(indices);
+    mMaterialIndices = const_cast<Ogre::uint16 *>(materialIndices);
+  }
+
+  Mesh::Mesh(const Mesh *mesh, const Ogre::Vector3 &position, const Ogre::Quaternion &orientation, const Ogre::Vector3 &scale) :
+    mVertexCount(mesh->mVertexCount), mTriangleCount(mesh->mTriangleCount), mMaterials(mesh->mMaterials), mOwnsData(false), mCompressed(false), mQuantizedPositions(0), mQuantizedNormals(0), mQuantizedTexCoords(0), mTransformed(true), mTranslation(position) {
+    mPositions = mesh->mPositions;
+    mNormals = mesh->mNormals;
+    mTexCoords = mesh->mTexCoords;
+    mIndices = mesh->mIndices;
+    mMaterialIndices = mesh->mMaterialIndices;
+    // rotate the scaled positions
+    orientation.ToRotationMatrix(mRotation);
+    mTransform = mRotation * Ogre::Matrix3(scale.x, 0.0f, 0.0f, 0.0f, scale.y, 0.0f, 0.0f, 0.0f, scale.z);
+  }
+
+  Mesh::~Mesh() {
+    // quantized arrays are always owned
+    delete[] mQuantizedPositions;
+    delete[] mQuantizedNormals;
+    delete[] mQuantizedTexCoords;
+    // return if the arrays are not owned
+    if (!mOwnsData)
+      return;
+    delete[] mPositions;
+    delete[] mNormals;
+    delete[] mTexCoords;
+    delete[] mIndices;
+    delete[] mMaterialIndices;
+  }
+
+  const size_t Mesh::vertexCount() const {
+    return mVertexCount;
+  }
+
+  const size_t Mesh::triangleCount() const {
+    return mTriangleCount;
+  }
+
+  Ogre::Vector3 *Mesh::positions() {
+    detach();
+    return mPositions;
+  }
+
+  Ogre::Vector3 *Mesh::normals() {
+    detach();
+    return mNormals;
+  }
+
+  Ogre::Vector2 *Mesh::texCoords() {
+    detach();
+    return mTexCoords;
+  }
+
+  Ogre::uint32 *Mesh::indices() {
+    detach();
+    return mIndices;
+  }
+
+  Ogre::uint16 *Mesh::materialIndices() {
+    detach();
+    return mMaterialIndices;
+  }
+
+  const Ogre::Vector3 *Mesh::positions() const {
+    return mPositions;
+  }
+
+  const Ogre::Vector3 *Mesh::normals() const {
+    return mNormals;
+  }
+
+  const Ogre::Vector2 *Mesh::texCoords() const {
+    return mTexCoords;
+  }
+
+  const Ogre::uint32 *Mesh::indices() const {
+    return mIndices;
+  }
+
+  const Ogre::uint16 *Mesh::materialIndices() const {
+    return mMaterialIndices;
+  }
+
+  const Ogre::uint16 Mesh::addMaterial(Material *material) {
+    // reuse the slot if the material has already been added
+    for (size_t i = 0; i < mMaterials.size(); ++i)
+      if (mMaterials.at(i) == material)
+        return i;
+    // add material
+    mMaterials.push_back(material);
+    // return its index
+    return mMaterials.size() - 1;
+  }
+
+  const std::vector<Material *> &Mesh::materials() const {
+    return mMaterials;
+  }
+
+  void Mesh::compress() {
+    if (mCompressed)
+      return;
+    // calculate the bounds of the mesh
+    Ogre::Vector3 minimum = mVertexCount ? mPositions[0] : Ogre::Vector3::ZERO;
+    Ogre::Vector3 maximum = minimum;
+    for (size_t i = 1; i < mVertexCount; ++i) {
+      minimum.makeFloor(mPositions[i]);
+      maximum.makeCeil(mPositions[i]);
+    }
+    // positions are stored as 16-bit fractions of the bounds
+    mPositionOffset = minimum;
+    mPositionScale = (maximum - minimum) / 65535.0f;
+    Ogre::Vector3 inverseScale(0.0f, 0.0f, 0.0f);
+    for (int j = 0; j < 3; ++j)
+      if (mPositionScale[j] > 0.0f)
+        inverseScale[j] = 1.0f / mPositionScale[j];
+    mQuantizedPositions = new Ogre::uint16[mVertexCount * 3];
+    mQuantizedNormals = new Ogre::int16[mVertexCount * 2];
+    mQuantizedTexCoords = new Ogre::uint16[mVertexCount * 2];
+    for (size_t i = 0; i < mVertexCount; ++i) {
+      // quantize position
+      Ogre::Vector3 p = (mPositions[i] - mPositionOffset) * inverseScale;
+      for (int j = 0; j < 3; ++j)
+        mQuantizedPositions[i * 3 + j] = Ogre::uint16(std::min(std::max(p[j] + 0.5f, 0.0f), 65535.0f));
+      // project the normal onto the octahedron and fold the lower hemisphere
+      Ogre::Vector3 n = mNormals[i];
+      Ogre::Real length = Ogre::Math::Abs(n.x) + Ogre::Math::Abs(n.y) + Ogre::Math::Abs(n.z);
+      if (length == 0.0f) {
+        // reserved code for vertices without a normal
+        mQuantizedNormals[i * 2 + 0] = -32768;
+        mQuantizedNormals[i * 2 + 1] = -32768;
+      } else {
+        n /= length;
+        if (n.z < 0.0f) {
+          Ogre::Real x = n.x;
+          n.x = (1.0f - Ogre::Math::Abs(n.y)) * (x >= 0.0f ? 1.0f : -1.0f);
+          n.y = (1.0f - Ogre::Math::Abs(x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+        }
+        mQuantizedNormals[i * 2 + 0] = Ogre::int16(floorf(std::min(std::max(n.x, -1.0f), 1.0f) * 32767.0f + 0.5f));
+        mQuantizedNormals[i * 2 + 1] = Ogre::int16(floorf(std::min(std::max(n.y, -1.0f), 1.0f) * 32767.0f + 0.5f));
+      }
+      // convert texture coordinates to half floats
+      mQuantizedTexCoords[i * 2 + 0] = Ogre::Bitwise::floatToHalf(mTexCoords[i].x);
+      mQuantizedTexCoords[i * 2 + 1] = Ogre::Bitwise::floatToHalf(mTexCoords[i].y);
+    }
+    // release the full precision arrays
+    if (mOwnsData) {
+      delete[] mPositions;
+      delete[] mNormals;
+      delete[] mTexCoords;
+    }
+    mPositions = 0;
+    mNormals = 0;
+    mTexCoords = 0;
+    mCompressed = true;
+  }
+
+  void Mesh::detach() {
+    if (mOwnsData)
+      return;
+    // the arrays of a compressed view have already been released
+    mPositions = copyArray<Ogre::Vector3>(mPositions, mVertexCount);
+    mNormals = copyArray<Ogre::Vector3>(mNormals, mVertexCount);
+    mTexCoords = copyArray<Ogre::Vector2>(mTexCoords, mVertexCount);
+    mIndices = copyArray<Ogre::uint32>(mIndices, mTriangleCount * 3);
+    mMaterialIndices = copyArray<Ogre::uint16>(mMaterialIndices, mTriangleCount);
+    mOwnsData = true;
+  }
+
+  const bool Mesh::isCompressed() const {
+    return mCompressed;
+  }
+
+  const size_t Mesh::memoryUsage() const {
+    // quantized arrays are always owned
+    size_t vertexSize = mCompressed ? 3 * sizeof(Ogre::uint16) + 2 * sizeof(Ogre::int16) + 2 * sizeof(Ogre::uint16) : mOwnsData ? 2 * sizeof(Ogre::Vector3) + sizeof(Ogre::Vector2) : 0;
+    size_t triangleSize = mOwnsData ? 3 * sizeof(Ogre::uint32) + sizeof(Ogre::uint16) : 0;
+    return mVertexCount * vertexSize + mTriangleCount * triangleSize;
+  }
+
+  const bool Mesh::isValid() const {
+    for (size_t i = 0; i < mTriangleCount * 3; ++i)
+      if (mIndices[i] >= mVertexCount)
+        return false;
+    for (size_t i = 0; i < mTriangleCount; ++i)
+      if (mMaterialIndices[i] >= mMaterials.size())
+        return false;
+    return true;
+  }
+
+  const Ogre::AxisAlignedBox Mesh::bounds() const {
+    Ogre::AxisAlignedBox bounds;
+    for (Ogre::uint32 i = 0; i < mVertexCount; ++i)
+      bounds.merge(vertexPosition(i));
+    return bounds;
+  }
+}
@@ -0,0 +1,160 @@
+#ifndef AORTMESH_H
+#define AORTMESH_H
+
+#include <OGRE/OgreAxisAlignedBox.h>
+#include <OGRE/OgreBitwise.h>
+#include <OGRE/OgreMath.h>
+#include <OGRE/OgreMatrix3.h>
+#include <OGRE/OgrePrerequisites.h>
+#include <OGRE/OgreQuaternion.h>
+#include <OGRE/OgreVector2.h>
+#include <OGRE/OgreVector3.h>
+
+namespace Aort {
+  class Material;
+
+  class Mesh {
+  public:
+    Mesh(const size_t vertexCount, const size_t triangleCount);
+    // a view to external arrays, which can be read only, the arrays are copied before they are first written
+    Mesh(const size_t vertexCount, const size_t triangleCount, const Ogre::Vector3 *positions, const Ogre::Vector3 *normals, const Ogre::Vector2 *texCoords, const Ogre::uint32 *indices, const Ogre::uint16 *materialIndices);
+    // an instance of an uncompressed mesh, a view to its arrays whose positions and normals are returned transformed
+    // into world space by the per triangle accessors, the mesh has to be alive as long as the instance
+    Mesh(const Mesh *mesh, const Ogre::Vector3 &position, const Ogre::Quaternion &orientation, const Ogre::Vector3 &scale);
+    ~Mesh();
+
+    const size_t vertexCount() const;
+    const size_t triangleCount() const;
+
+    // writable arrays, a view copies the external arrays first, the arrays of an instance are not transformed
+    Ogre::Vector3 *positions();
+    Ogre::Vector3 *normals();
+    Ogre::Vector2 *texCoords();
+    Ogre::uint32 *indices();
+    Ogre::uint16 *materialIndices();
+
+    const Ogre::Vector3 *positions() const;
+    const Ogre::Vector3 *normals() const;
+    const Ogre::Vector2 *texCoords() const;
+    const Ogre::uint32 *indices() const;
+    const Ogre::uint16 *materialIndices() const;
+
+    const Ogre::uint16 addMaterial(Material *material);
+    const std::vector<Material *> &materials() const;
+
+    // replaces the vertex attribute arrays with quantized ones, attribute array accessors return 0 afterwards, the
+    // positions keep 1/65535 of the extent of the mesh bounds on each axis, so details much smaller than a large mesh
+    // snap together, the normals are 16-bit octahedral and the texture coordinates half floats
+    void compress();
+    const bool isCompressed() const;
+    // bytes of the arrays owned by the mesh, the external arrays of a view are not counted
+    const size_t memoryUsage() const;
+
+    // checks that the indices refer to vertices and materials of the mesh, it reads all indices, so it is done once
+    // before the triangles are used instead of when a mesh is loaded
+    const bool isValid() const;
+    // bounds of the vertices, transformed if the mesh is an instance
+    const Ogre::AxisAlignedBox bounds() const;
+
+    const Ogre::Vector3 position(const Ogre::uint32 triangle, const int i) const;
+    const Ogre::Vector3 normal(const Ogre::uint32 triangle, const int i) const;
+    const Ogre::Vector2 texCoord(const Ogre::uint32 triangle, const int i) const;
+    Material *material(const Ogre::uint32 triangle) const;
+
+  private:
+    void detach();
+
+    const Ogre::Vector3 decodePosition(const Ogre::uint32 vertex) const;
+    const Ogre::Vector3 decodeNormal(const Ogre::uint32 vertex) const;
+    const Ogre::Vector2 decodeTexCoord(const Ogre::uint32 vertex) const;
+    const Ogre::Vector3 vertexPosition(const Ogre::uint32 vertex) const;
+    const Ogre::Vector3 vertexNormal(const Ogre::uint32 vertex) const;
+
+    size_t mVertexCount;
+    size_t mTriangleCount;
+    Ogre::Vector3 *mPositions;
+    Ogre::Vector3 *mNormals;
+    Ogre::Vector2 *mTexCoords;
+    Ogre::uint32 *mIndices;
+    Ogre::uint16 *mMaterialIndices;
+    std::vector<Material *> mMaterials;
+    // arrays are not owned if the mesh is a view to an external memory
+    bool mOwnsData;
+    // quantized vertex attributes, positions are relative to the mesh bounds,
+    // normals are octahedral encoded and texture coordinates are half floats
+    bool mCompressed;
+    Ogre::uint16 *mQuantizedPositions;
+    Ogre::int16 *mQuantizedNormals;
+    Ogre::uint16 *mQuantizedTexCoords;
+    Ogre::Vector3 mPositionOffset;
+    Ogre::Vector3 mPositionScale;
+    // world transform of an instance, the rotation and scale are applied to the positions and the rotation only to
+    // the normals, like the transform of the parsed entities
+    bool mTransformed;
+    Ogre::Matrix3 mTransform;
+    Ogre::Matrix3 mRotation;
+    Ogre::Vector3 mTranslation;
+  };
+
+  // per triangle accessors are used by the intersection and shading code, keep them inline
+  inline const Ogre::Vector3 Mesh::position(const Ogre::uint32 triangle, const int i) const {
+    return vertexPosition(mIndices[triangle * 3 + i]);
+  }
+
+  inline const Ogre::Vector3 Mesh::normal(const Ogre::uint32 triangle, const int i) const {
+    return vertexNormal(mIndices[triangle * 3 + i]);
+  }
+
+  inline const Ogre::Vector2 Mesh::texCoord(const Ogre::uint32 triangle, const int i) const {
+    if (mCompressed)
+      return decodeTexCoord(mIndices[triangle * 3 + i]);
+    return mTexCoords[mIndices[triangle * 3 + i]];
+  }
+
+  inline Material *Mesh::material(const Ogre::uint32 triangle) const {
+    return mMaterials[mMaterialIndices[triangle]];
+  }
+
+  inline const Ogre::Vector3 Mesh::decodePosition(const Ogre::uint32 vertex) const {
+    const Ogre::uint16 *q = mQuantizedPositions + vertex * 3;
+    return mPositionOffset + mPositionScale * Ogre::Vector3(q[0], q[1], q[2]);
+  }
+
+  inline const Ogre::Vector3 Mesh::decodeNormal(const Ogre::uint32 vertex) const {
+    const Ogre::int16 *q = mQuantizedNormals + vertex * 2;
+    // vertices without a normal are stored with a reserved code
+    if (q[0] == -32768)
+      return Ogre::Vector3::ZERO;
+    Ogre::Vector3 n(q[0] / 32767.0f, q[1] / 32767.0f, 0.0f);
+    n.z = 1.0f - Ogre::Math::Abs(n.x) - Ogre::Math::Abs(n.y);
+    // unfold the lower hemisphere
+    if (n.z < 0.0f) {
+      Ogre::Real x = n.x;
+      n.x = (1.0f - Ogre::Math::Abs(n.y)) * (x >= 0.0f ? 1.0f : -1.0f);
+      n.y = (1.0f - Ogre::Math::Abs(x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    n.normalise();
+    return n;
+  }
+
+  inline const Ogre::Vector2 Mesh::decodeTexCoord(const Ogre::uint32 vertex) const {
+    const Ogre::uint16 *q = mQuantizedTexCoords + vertex * 2;
+    return Ogre::Vector2(Ogre::Bitwise::halfToFloat(q[0]), Ogre::Bitwise::halfToFloat(q[1]));
+  }
+
+  inline const Ogre::Vector3 Mesh::vertexPosition(const Ogre::uint32 vertex) const {
+    Ogre::Vector3 position = mCompressed ? decodePosition(vertex) : mPositions[vertex];
+    if (mTransformed)
+      return mTransform * position + mTranslation;
+    return position;
+  }
+
+  inline const Ogre::Vector3 Mesh::vertexNormal(const Ogre::uint32 vertex) const {
+    Ogre::Vector3 normal = mCompressed ? decodeNormal(vertex) : mNormals[vertex];
+    if (mTransformed)
+      return mRotation * normal;
+    return normal;
+  }
+}
+
+#endif // AORTMESH_H
@@ -0,0 +1,426 @@
+#include "AortMeshLibrary.h"
+
+#include "AortMaterial.h"
+#include "AortMaterialLibrary.h"
+#include "AortMesh.h"
+#include "AortSceneFile.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+
+#include <OGRE/OgreMaterial.h>
+#include <OGRE/OgreHardwareBufferManager.h>
+#include <OGRE/OgreMaterialManager.h>
+#include <OGRE/OgreMesh.h>
+#include <OGRE/OgreMeshManager.h>
+#include <OGRE/OgrePass.h>
+#include <OGRE/OgreResourceGroupManager.h>
+#include <OGRE/OgreString.h>
+#include <OGRE/OgreStringConverter.h>
+#include <OGRE/OgreSubMesh.h>
+#include <OGRE/OgreTechnique.h>
+#include <OGRE/OgreTextureUnitState.h>
+
+#include <assimp/Importer.hpp>
+#include <assimp/material.h>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+
+#include <map>
+
+namespace Aort {
+  // a mapped scene file and what was loaded from it
+  class LoadedScene {
+  public:
+    LoadedScene() : file(0), size(0), revision(0) {
+    }
+
+    SceneFile *file;
+    // size and modification time of the file when it was mapped
+    qint64 size;
+    QDateTime modified;
+    // number of times the file was mapped again after it changed
+    int revision;
+    std::vector<Ogre::String> meshNames;
+    std::vector<SceneInstance> instances;
+  };
+
+  class MeshLibraryPrivate {
+  public:
+    MeshLibraryPrivate() {
+    }
+
+    ~MeshLibraryPrivate() {
+      clear();
+    }
+
+    void clear() {
+      // delete meshes
+      for (std::map<Ogre::String, Mesh *>::iterator it = meshes.begin(); it != meshes.end(); ++it)
+        delete it->second;
+      meshes.clear();
+      meshUsers.clear();
+      // close scene files
+      for (std::map<Ogre::String, LoadedScene>::iterator it = scenes.begin(); it != scenes.end(); ++it)
+        delete it->second.file;
+      scenes.clear();
+      for (size_t i = 0; i < retiredScenes.size(); ++i)
+        delete retiredScenes.at(i).file;
+      retiredScenes.clear();
+      // delete materials
+      materialLibrary.clear();
+    }
+
+    Material *readMaterial(const Ogre::String &name, const aiMaterial *aimaterial) {
+      SceneMaterial material;
+      material.name = name;
+      // parse material properties
+      aiColor3D colour;
+      if (aimaterial->Get(AI_MATKEY_COLOR_AMBIENT, colour) == AI_SUCCESS)
+        material.ambient = Ogre::ColourValue(colour.r, colour.g, colour.b);
+      if (aimaterial->Get(AI_MATKEY_COLOR_DIFFUSE, colour) == AI_SUCCESS)
+        material.diffuse = Ogre::ColourValue(colour.r, colour.g, colour.b);
+      if (aimaterial->Get(AI_MATKEY_COLOR_SPECULAR, colour) == AI_SUCCESS)
+        material.specular = Ogre::ColourValue(colour.r, colour.g, colour.b);
+      aimaterial->Get(AI_MATKEY_SHININESS, material.shininess);
+      aimaterial->Get(AI_MATKEY_REFLECTIVITY, material.reflectivity);
+      // parse first diffuse texture
+      aiString texture;
+      if (aimaterial->GetTexture(aiTextureType_DIFFUSE, 0, &texture) == AI_SUCCESS)
+        material.texture = texture.data;
+      // create material
+      return createMaterial(material);
+    }
+
+    Material *createMaterial(const SceneMaterial &sceneMaterial) {
+      // create an ogre material for the viewport, if it does not exist
+      Ogre::MaterialPtr materialPtr = Ogre::MaterialManager::getSingletonPtr()->getByName(sceneMaterial.name);
+      if (materialPtr.isNull()) {
+        materialPtr = Ogre::MaterialManager::getSingletonPtr()->create(sceneMaterial.name, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+        Ogre::Pass *pass = materialPtr->getTechnique(0)->getPass(0);
+        // set material properties
+        pass->setAmbient(sceneMaterial.ambient);
+        pass->setDiffuse(sceneMaterial.diffuse);
+        pass->setSpecular(sceneMaterial.specular);
+        pass->setShininess(sceneMaterial.shininess);
+        // set texture
+        if (sceneMaterial.texture != "") {
+          Ogre::TextureUnitState *tus = pass->createTextureUnitState(sceneMaterial.texture);
+          tus->setTextureFiltering(sceneMaterial.filter, sceneMaterial.filter, Ogre::FO_NONE);
+          tus->setTextureAnisotropy(sceneMaterial.anisotropy);
+        }
+      }
+      // read the renderer material from the ogre material
+      Material *material = materialLibrary.getMaterial(sceneMaterial.name);
+      // set reflectivity, which ogre materials do not have
+      material->setReflectivity(sceneMaterial.reflectivity);
+      // return material
+      return material;
+    }
+
+    // deletes a mesh that is held by no load anymore
+    void releaseMesh(const Ogre::String &name) {
+      std::map<Ogre::String, int>::iterator users = meshUsers.find(name);
+      if (users == meshUsers.end() || --users->second > 0)
+        return;
+      meshUsers.erase(users);
+      std::map<Ogre::String, Mesh *>::iterator it = meshes.find(name);
+      if (it != meshes.end()) {
+        delete it->second;
+        meshes.erase(it);
+      }
+    }
+
+    // a scene file whose meshes have all been deleted is not needed anymore
+    const bool isUnused(const LoadedScene &scene) const {
+      for (size_t i = 0; i < scene.meshNames.size(); ++i)
+        if (meshes.find(scene.meshNames.at(i)) != meshes.end())
+          return false;
+      return true;
+    }
+
+    std::map<Ogre::String, Mesh *> meshes;
+    // loads holding the meshes, meshes added with addMesh are not counted and kept until clear
+    std::map<Ogre::String, int> meshUsers;
+    // mapped scene files by path, meshes loaded from them are views to the mapped data
+    std::map<Ogre::String, LoadedScene> scenes;
+    // scene files that changed since they were mapped, they are kept while their meshes are used
+    std::vector<LoadedScene> retiredScenes;
+    // materials of the loaded meshes
+    MaterialLibrary materialLibrary;
+  };
+
+  MeshLibrary::MeshLibrary() : d(new MeshLibraryPrivate()) {
+  }
+
+  MeshLibrary::~MeshLibrary() {
+    delete d;
+  }
+
+  MeshLibrary *MeshLibrary::instance() {
+    static MeshLibrary instance;
+    return &instance;
+  }
+
+  Mesh *MeshLibrary::load(const Ogre::String &path) {
+    // return the mesh if it has already been loaded
+    Mesh *mesh = getMesh(path);
+    if (mesh) {
+      d->meshUsers[path]++;
+      return mesh;
+    }
+    // make textures next to the file available
+    Ogre::String baseName, directory;
+    Ogre::StringUtil::splitFilename(path, baseName, directory);
+    Ogre::ResourceGroupManager::getSingleton().addResourceLocation(directory, "FileSystem", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+    // load the file using assimp
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(path.c_str(),
+                           aiProcess_CalcTangentSpace |
+                           aiProcess_JoinIdenticalVertices |
+                           aiProcess_Triangulate |
+                           aiProcess_GenSmoothNormals |
+                           aiProcess_ImproveCacheLocality |
+                           aiProcess_RemoveRedundantMaterials |
+                           aiProcess_FixInfacingNormals |
+                           aiProcess_SortByPType |
+                           aiProcess_FindDegenerates |
+                           aiProcess_FindInvalidData |
+                           aiProcess_GenUVCoords |
+                           aiProcess_TransformUVCoords |
+                           aiProcess_OptimizeMeshes |
+                           aiProcess_OptimizeGraph |
+                           aiProcess_FlipUVs);
+    if (!scene)
+      return 0;
+    // read materials
+    std::vector<Material *> materials(scene->mNumMaterials);
+    for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
+      materials[i] = d->readMaterial(path + "/" + Ogre::StringConverter::toString(i), scene->mMaterials[i]);
+    // calculate total number of vertices and triangles
+    size_t vertexCount = 0;
+    size_t triangleCount = 0;
+    for (unsigned int i = 0; i < scene->mNumMeshes; ++i) {
+      const aiMesh *aimesh = scene->mMeshes[i];
+      // skip meshes containing primitives other than triangles
+      if (aimesh->mPrimitiveTypes & (aiPrimitiveType_POINT | aiPrimitiveType_LINE | aiPrimitiveType_POLYGON))
+        continue;
+      vertexCount += aimesh->mNumVertices;
+      triangleCount += aimesh->mNumFaces;
+    }
+    // create the mesh
+    mesh = new Mesh(vertexCount, triangleCount);
+    size_t vertexOffset = 0;
+    size_t triangleOffset = 0;
+    for (unsigned int i = 0; i < scene->mNumMeshes; ++i) {
+      const aiMesh *aimesh = scene->mMeshes[i];
+      // skip meshes containing primitives other than triangles
+      if (aimesh->mPrimitiveTypes & (aiPrimitiveType_POINT | aiPrimitiveType_LINE | aiPrimitiveType_POLYGON))
+        continue;
+      // copy vertex attributes
+      for (unsigned int j = 0; j < aimesh->mNumVertices; ++j) {
+        mesh->positions()[vertexOffset + j] = Ogre::Vector3(aimesh->mVertices[j].x, aimesh->mVertices[j].y, aimesh->mVertices[j].z);
+        if (aimesh->HasNormals())
+          mesh->normals()[vertexOffset + j] = Ogre::Vector3(aimesh->mNormals[j].x, aimesh->mNormals[j].y, aimesh->mNormals[j].z);
+        if (aimesh->HasTextureCoords(0))
+          mesh->texCoords()[vertexOffset + j] = Ogre::Vector2(aimesh->mTextureCoords[0][j].x, aimesh->mTextureCoords[0][j].y);
+      }
+      // get material of the faces
+      Ogre::uint16 materialIndex = mesh->addMaterial(materials.size() ? materials.at(aimesh->mMaterialIndex) : d->materialLibrary.getMaterial("BaseWhite"));
+      // copy faces
+      for (unsigned int j = 0; j < aimesh->mNumFaces; ++j) {
+        mesh->indices()[(triangleOffset + j) * 3 + 0] = aimesh->mFaces[j].mIndices[0] + vertexOffset;
+        mesh->indices()[(triangleOffset + j) * 3 + 1] = aimesh->mFaces[j].mIndices[1] + vertexOffset;
+        mesh->indices()[(triangleOffset + j) * 3 + 2] = aimesh->mFaces[j].mIndices[2] + vertexOffset;
+        mesh->materialIndices()[triangleOffset + j] = materialIndex;
+      }
+      // update vertex and triangle offsets
+      vertexOffset += aimesh->mNumVertices;
+      triangleOffset += aimesh->mNumFaces;
+    }
+    // save mesh
+    d->meshes[path] = mesh;
+    d->meshUsers[path] = 1;
+    // return mesh
+    return mesh;
+  }
+
+  const bool MeshLibrary::loadScene(const Ogre::String &path, std::vector<Ogre::String> &meshNames, std::vector<SceneInstance> &instances) {
+    QFileInfo info(QString::fromStdString(path));
+    // reuse the meshes of the file while it is unchanged
+    std::map<Ogre::String, LoadedScene>::iterator it = d->scenes.find(path);
+    if (it != d->scenes.end() && it->second.size == info.size() && it->second.modified == info.lastModified()) {
+      meshNames = it->second.meshNames;
+      instances = it->second.instances;
+      for (size_t i = 0; i < meshNames.size(); ++i)
+        d->meshUsers[meshNames.at(i)]++;
+      return true;
+    }
+    // make textures next to the file available
+    Ogre::String baseName, directory;
+    Ogre::StringUtil::splitFilename(path, baseName, directory);
+    Ogre::ResourceGroupManager::getSingleton().addResourceLocation(directory, "FileSystem", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+    // map the scene file
+    LoadedScene scene;
+    scene.file = new SceneFile();
+    if (!scene.file->open(path)) {
+      delete scene.file;
+      return false;
+    }
+    scene.size = info.size();
+    scene.modified = info.lastModified();
+    // replace the meshes of the changed file under new names, the old ones keep the old mapping while they are used,
+    // which holds the old data if the file was replaced like SceneFile::write does, a file rewritten in place changes
+    // under the old meshes
+    if (it != d->scenes.end()) {
+      scene.revision = it->second.revision + 1;
+      if (d->isUnused(it->second))
+        delete it->second.file;
+      else
+        d->retiredScenes.push_back(it->second);
+      d->scenes.erase(it);
+    }
+    // create materials
+    std::vector<Material *> materials(scene.file->materialCount());
+    for (size_t i = 0; i < scene.file->materialCount(); ++i)
+      materials[i] = d->createMaterial(scene.file->material(i));
+    // create meshes, names of the meshes of a file are unique
+    for (size_t i = 0; i < scene.file->meshCount(); ++i) {
+      Ogre::String name = path + "#" + Ogre::StringConverter::toString(i);
+      if (scene.revision > 0)
+        name += "@" + Ogre::StringConverter::toString(scene.revision);
+      Mesh *mesh = scene.file->createMesh(i);
+      // add materials in the order of the material indices
+      std::vector<Ogre::uint32> meshMaterials = scene.file->meshMaterials(i);
+      for (size_t j = 0; j < meshMaterials.size(); ++j)
+        mesh->addMaterial(materials.at(meshMaterials.at(j)));
+      addMesh(name, mesh);
+      d->meshUsers[name] = 1;
+      scene.meshNames.push_back(name);
+    }
+    // read instances
+    for (size_t i = 0; i < scene.file->instanceCount(); ++i)
+      if (scene.file->instance(i).mesh < scene.meshNames.size())
+        scene.instances.push_back(scene.file->instance(i));
+    meshNames = scene.meshNames;
+    instances = scene.instances;
+    // a file without meshes is not kept mapped
+    if (scene.meshNames.empty())
+      delete scene.file;
+    else
+      d->scenes[path] = scene;
+    return true;
+  }
+
+  void MeshLibrary::release(const std::vector<Ogre::String> &meshNames) {
+    for (size_t i = 0; i < meshNames.size(); ++i)
+      d->releaseMesh(meshNames.at(i));
+    // unmap the files whose meshes have all been deleted
+    for (std::map<Ogre::String, LoadedScene>::iterator it = d->scenes.begin(); it != d->scenes.end();) {
+      if (d->isUnused(it->second)) {
+        delete it->second.file;
+        d->scenes.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+    for (size_t i = 0; i < d->retiredScenes.size();) {
+      if (d->isUnused(d->retiredScenes.at(i))) {
+        delete d->retiredScenes.at(i).file;
+        d->retiredScenes.erase(d->retiredScenes.begin() + i);
+      } else {
+        ++i;
+      }
+    }
+  }
+
+  void MeshLibrary::addMesh(const Ogre::String &name, Mesh *mesh) {
+    // replace the mesh with the same name
+    std::map<Ogre::String, Mesh *>::iterator it = d->meshes.find(name);
+    if (it != d->meshes.end() && it->second != mesh)
+      delete it->second;
+    d->meshes[name] = mesh;
+  }
+
+  Material *MeshLibrary::createMaterial(const SceneMaterial &material) {
+    return d->createMaterial(material);
+  }
+
+  Ogre::MeshPtr MeshLibrary::createOgreMesh(const Ogre::String &name) const {
+    // read through the const accessors, so that mapped meshes are not copied
+    const Mesh *mesh = getMesh(name);
+    if (!mesh || !mesh->isValid())
+      return Ogre::MeshPtr();
+    // create an ogre mesh with a shared vertex buffer and a submesh for each material
+    Ogre::MeshPtr meshPtr = Ogre::MeshManager::getSingletonPtr()->createManual(name, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+    meshPtr->sharedVertexData = new Ogre::VertexData();
+    meshPtr->sharedVertexData->vertexStart = 0;
+    meshPtr->sharedVertexData->vertexCount = mesh->vertexCount();
+    // create vertex declaration
+    Ogre::VertexDeclaration* declaration = meshPtr->sharedVertexData->vertexDeclaration;
+    unsigned short start = 0;
+    size_t offset = 0;
+    offset += declaration->addElement(start, offset, Ogre::VET_FLOAT3, Ogre::VES_POSITION).getSize();
+    offset += declaration->addElement(start, offset, Ogre::VET_FLOAT3, Ogre::VES_NORMAL).getSize();
+    offset += declaration->addElement(start, offset, Ogre::VET_FLOAT2, Ogre::VES_TEXTURE_COORDINATES).getSize();
+    // create vertex buffer
+    Ogre::HardwareVertexBufferSharedPtr vertexBuffer = Ogre::HardwareBufferManager::getSingletonPtr()->createVertexBuffer(declaration->getVertexSize(start),
+        meshPtr->sharedVertexData->vertexCount,
+        Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+    // get vertex buffer
+    float* vertexData = static_cast<float*>(vertexBuffer->lock(Ogre::HardwareBuffer::HBL_DISCARD));
+    Ogre::AxisAlignedBox aabb;
+    // parse vertices
+    for (size_t j = 0; j < mesh->vertexCount(); ++j) {
+      // vertex position
+      *vertexData++ = mesh->positions()[j].x;
+      *vertexData++ = mesh->positions()[j].y;
+      *vertexData++ = mesh->positions()[j].z;
+      // vertex normal
+      *vertexData++ = mesh->normals()[j].x;
+      *vertexData++ = mesh->normals()[j].y;
+      *vertexData++ = mesh->normals()[j].z;
+      // texture coordinates
+      *vertexData++ = mesh->texCoords()[j].x;
+      *vertexData++ = mesh->texCoords()[j].y;
+      // update bounding box
+      aabb.merge(mesh->positions()[j]);
+    }
+    vertexBuffer->unlock();
+    // bind the buffer
+    meshPtr->sharedVertexData->vertexBufferBinding->setBinding(start, vertexBuffer);
+    // create index buffer
+    Ogre::HardwareIndexBufferSharedPtr indexBuffer = Ogre::HardwareBufferManager::getSingletonPtr()->createIndexBuffer(Ogre::HardwareIndexBuffer::IT_32BIT,
+        mesh->triangleCount() * 3,
+        Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+    indexBuffer->writeData(0, indexBuffer->getSizeInBytes(), mesh->indices(), true);
+    // create a submesh for each run of triangles sharing the same material
+    for (size_t j = 0; j < mesh->triangleCount();) {
+      size_t first = j;
+      while (j < mesh->triangleCount() && mesh->materialIndices()[j] == mesh->materialIndices()[first])
+        j++;
+      // create a submesh
+      Ogre::SubMesh *submesh = meshPtr->createSubMesh();
+      submesh->useSharedVertices = true;
+      submesh->indexData->indexBuffer = indexBuffer;
+      submesh->indexData->indexStart = first * 3;
+      submesh->indexData->indexCount = (j - first) * 3;
+      // assign material
+      submesh->setMaterialName(mesh->material(first)->getName());
+    }
+    meshPtr->_setBounds(aabb);
+    meshPtr->_setBoundingSphereRadius((aabb.getMaximum() - aabb.getMinimum()).length() * 0.5f);
+    return meshPtr;
+  }
+
+  Mesh *MeshLibrary::getMesh(const Ogre::String &name) const {
+    std::map<Ogre::String, Mesh *>::const_iterator it = d->meshes.find(name);
+    if (it != d->meshes.end())
+      return it->second;
+    return 0;
+  }
+
+  void MeshLibrary::clear() {
+    d->clear();
+  }
+}
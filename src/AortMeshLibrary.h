@@ -0,0 +1,43 @@
+#ifndef AORTMESHLIBRARY_H
+#define AORTMESHLIBRARY_H
+
+#include <OGRE/OgrePrerequisites.h>
+
+namespace Aort {
+  class Material;
+  class Mesh;
+  class SceneInstance;
+  class SceneMaterial;
+
+  class MeshLibraryPrivate;
+
+  class MeshLibrary {
+  public:
+    MeshLibrary();
+    ~MeshLibrary();
+
+    static MeshLibrary *instance();
+
+    // loads a mesh file readable by assimp, the mesh is named by the path and loaded once
+    Mesh *load(const Ogre::String &path);
+    // maps a scene file, the meshes and instances of a file are reused while its size and modification time stay
+    // the same, a changed file is mapped again and its meshes get new names, the old meshes stay valid until released
+    const bool loadScene(const Ogre::String &path, std::vector<Ogre::String> &meshNames, std::vector<SceneInstance> &instances);
+    // each load and loadScene holds its meshes until they are released, the last release deletes a mesh and the last
+    // mesh of a scene file unmaps the file
+    void release(const std::vector<Ogre::String> &meshNames);
+    void addMesh(const Ogre::String &name, Mesh *mesh);
+    Mesh *getMesh(const Ogre::String &name) const;
+
+    Material *createMaterial(const SceneMaterial &material);
+    // creates an ogre mesh from a library mesh for the viewport
+    Ogre::MeshPtr createOgreMesh(const Ogre::String &name) const;
+
+    void clear();
+
+  private:
+    MeshLibraryPrivate *d;
+  };
+}
+
+#endif // AORTMESHLIBRARY_H
@@ -1,233 +1,347 @@
 #include "AortMeshParser.h"
 
-#include "AortMaterial.h"
-#include "AortTexture.h"
-#include "AortTriangle.h"
+#include "AortMaterialLibrary.h"
+#include "AortMesh.h"
+#include "AortMeshLibrary.h"
 
 #include <OGRE/OgreEntity.h>
-#include <OGRE/OgreImage.h>
-#include <OGRE/OgreMaterial.h>
-#include <OGRE/OgreMaterialManager.h>
 #include <OGRE/OgreMath.h>
 #include <OGRE/OgreMesh.h>
-#include <OGRE/OgrePass.h>
 #include <OGRE/OgreSceneNode.h>
 #include <OGRE/OgreSubEntity.h>
 #include <OGRE/OgreSubMesh.h>
-#include <OGRE/OgreTechnique.h>
-#include <OGRE/OgreTexture.h>
-#include <OGRE/OgreTextureManager.h>
 #include <OGRE/OgreVector2.h>
 #include <OGRE/OgreVector3.h>
 
+#include <map>
+
+#define MAXIMUM_ELEMENTS_PER_JOB (65536)
+
 namespace Aort {
-  class Vertex {
+  enum ParseJobType {
+    PJT_VERTICES,
+    PJT_INDICES,
+    PJT_LOADED_VERTICES,
+    PJT_LOADED_TRIANGLES
+  };
+
+  class ParseJob {
   public:
-    Vertex() : position(0.0f, 0.0f, 0.0f), normal(0.0f, 0.0f, 0.0f), texCoord(0.0f, 0.0f) {
+    ParseJob(ParseJobType type, Ogre::VertexData *vertexData, Ogre::IndexData *indexData, size_t first, size_t count, size_t vertexOffset, size_t triangleOffset) :
+      type(type), vertexData(vertexData), indexData(indexData), first(first), count(count), vertexOffset(vertexOffset), triangleOffset(triangleOffset) {
     }
 
-    Ogre::Vector3 position;
-    Ogre::Vector3 normal;
-    Ogre::Vector2 texCoord;
+    ParseJobType type;
+    Ogre::VertexData *vertexData;
+    Ogre::IndexData *indexData;
+    // range of vertices or triangles to read from the source
+    size_t first;
+    size_t count;
+    // offset of the first vertex and triangle of the source in the mesh
+    size_t vertexOffset;
+    size_t triangleOffset;
   };
 
   class MeshParserPrivate {
   public:
-    MeshParserPrivate() : vertexCount(0), vertices(0), indexCount(0), indices(0) {
+    MeshParserPrivate() : mesh(0), loadedMesh(0), animatedEntity(0) {
     }
 
     ~MeshParserPrivate() {
-      delete[] vertices;
-      delete[] indices;
-    }
-    // vertices
-    size_t vertexCount;
-    Vertex *vertices;
-    // indices
-    size_t indexCount;
-    Ogre::uint32 *indices;
-    // triangles
-    std::vector<Triangle *> triangles;
-  };
+    }
+
+    void *lock(Ogre::HardwareBuffer *buffer) {
+      // each buffer can be locked once, elements and submeshes may share the same buffer
+      std::map<Ogre::HardwareBuffer *, void *>::const_iterator it = lockedBuffers.find(buffer);
+      if (it != lockedBuffers.end())
+        return it->second;
+      // lock and save the buffer
+      void *data = buffer->lock(Ogre::HardwareBuffer::HBL_READ_ONLY);
+      lockedBuffers[buffer] = data;
+      // return locked data
+      return data;
+    }
+
+    void unlock() {
+      for (std::map<Ogre::HardwareBuffer *, void *>::iterator it = lockedBuffers.begin(); it != lockedBuffers.end(); ++it)
+        it->first->unlock();
+      lockedBuffers.clear();
+    }
+
+    void addVertexJobs(Ogre::VertexData *vertexData, size_t vertexOffset) {
+      // lock the buffers of the vertex elements
+      const Ogre::VertexElement *elements[3] = {
+        vertexData->vertexDeclaration->findElementBySemantic(Ogre::VES_POSITION),
+        vertexData->vertexDeclaration->findElementBySemantic(Ogre::VES_NORMAL),
+        vertexData->vertexDeclaration->findElementBySemantic(Ogre::VES_TEXTURE_COORDINATES)
+      };
+      for (int i = 0; i < 3; ++i)
+        if (elements[i])
+          lock(vertexData->vertexBufferBinding->getBuffer(elements[i]->getSource()).getPointer());
+      // split vertices into jobs
+      for (size_t i = 0; i < vertexData->vertexCount; i += MAXIMUM_ELEMENTS_PER_JOB)
+        jobs.push_back(ParseJob(PJT_VERTICES, vertexData, 0, i, std::min<size_t>(MAXIMUM_ELEMENTS_PER_JOB, vertexData->vertexCount - i), vertexOffset, 0));
+    }
+
+    void addIndexJobs(Ogre::IndexData *indexData, size_t vertexOffset, size_t triangleOffset) {
+      // lock the index buffer
+      lock(indexData->indexBuffer.getPointer());
+      // split triangles into jobs
+      size_t triangleCount = indexData->indexCount / 3;
+      for (size_t i = 0; i < triangleCount; i += MAXIMUM_ELEMENTS_PER_JOB)
+        jobs.push_back(ParseJob(PJT_INDICES, 0, indexData, i, std::min<size_t>(MAXIMUM_ELEMENTS_PER_JOB, triangleCount - i), vertexOffset, triangleOffset));
+    }
 
-  Material *readMaterial(Ogre::String materialName) {
-    // get ogre material
-    Ogre::MaterialPtr materialPtr = Ogre::MaterialManager::getSingletonPtr()->getByName(materialName);
-    // if ogre material is null, return a default material
-    if (materialPtr.isNull())
-      return new Material(materialName);
-    // create a material
-    Material *material = new Material(materialName);
-    Ogre::Material *ogreMaterial = materialPtr.getPointer();
-    // get first pass of the best technique
-    if (ogreMaterial->getNumTechniques() && ogreMaterial->getBestTechnique()->getNumPasses()) {
-      Ogre::Pass *pass = ogreMaterial->getBestTechnique()->getPass(0);
-      // parse material properties
-      material->setAmbient(pass->getAmbient());
-      material->setDiffuse(pass->getDiffuse());
-      material->setSpecular(pass->getSpecular());
-      material->setShininess(pass->getShininess());
-      // TODO: read reflectivity
-      material->setReflectivity(0.25f);
-      // parse first texture
-      if (pass->getNumTextureUnitStates() && pass->getTextureUnitState(0)->getTextureName() != "") {
-        // create texture object
-        Texture *texture = new Texture();
-        // get texture unit state object
-        Ogre::TextureUnitState *tus = pass->getTextureUnitState(0);
-        // create an image
-        Ogre::Image *image = new Ogre::Image();
-        // load image
-        image->load(tus->getTextureName(), Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
-        // set texture image
-        texture->setImage(image);
-        // parse texture properties
-        texture->setTransform(tus->getTextureTransform());
-        texture->setFilter(tus->getTextureFiltering(Ogre::FT_MIN));
-        texture->setAnisotropy(tus->getTextureAnisotropy());
-        // set material texture
-        material->setTexture(texture);
+    const unsigned char *elementData(Ogre::VertexData *vertexData, const Ogre::VertexElement *element, size_t first, size_t &vertexSize) const {
+      Ogre::HardwareVertexBuffer *buffer = vertexData->vertexBufferBinding->getBuffer(element->getSource()).getPointer();
+      vertexSize = buffer->getVertexSize();
+      // data of the first vertex of the range
+      return static_cast<const unsigned char *>(lockedBuffers.find(buffer)->second) + (vertexData->vertexStart + first) * vertexSize + element->getOffset();
+    }
+
+    void readVertices(const ParseJob &job) const {
+      size_t vertexSize = 0;
+      // get position data
+      const Ogre::VertexElement *positionElement = job.vertexData->vertexDeclaration->findElementBySemantic(Ogre::VES_POSITION);
+      if (positionElement) {
+        const unsigned char *positionData = elementData(job.vertexData, positionElement, job.first, vertexSize);
+        Ogre::Vector3 *positions = mesh->positions() + job.vertexOffset + job.first;
+        for (size_t j = 0; j < job.count; ++j) {
+          const float *start = reinterpret_cast<const float *>(positionData);
+          positions[j] = (orientation * (Ogre::Vector3(start[0], start[1], start[2]) * scale)) + position;
+          // advance by vertex size
+          positionData += vertexSize;
+        }
+      }
+      // get normal data
+      const Ogre::VertexElement *normalElement = job.vertexData->vertexDeclaration->findElementBySemantic(Ogre::VES_NORMAL);
+      if (normalElement) {
+        const unsigned char *normalData = elementData(job.vertexData, normalElement, job.first, vertexSize);
+        Ogre::Vector3 *normals = mesh->normals() + job.vertexOffset + job.first;
+        for (size_t j = 0; j < job.count; ++j) {
+          const float *start = reinterpret_cast<const float *>(normalData);
+          normals[j] = orientation * Ogre::Vector3(start[0], start[1], start[2]);
+          // advance by vertex size
+          normalData += vertexSize;
+        }
+      }
+      // get texCoord data
+      const Ogre::VertexElement *texCoordElement = job.vertexData->vertexDeclaration->findElementBySemantic(Ogre::VES_TEXTURE_COORDINATES);
+      if (texCoordElement) {
+        const unsigned char *texCoordData = elementData(job.vertexData, texCoordElement, job.first, vertexSize);
+        Ogre::Vector2 *texCoords = mesh->texCoords() + job.vertexOffset + job.first;
+        for (size_t j = 0; j < job.count; ++j) {
+          const float *start = reinterpret_cast<const float *>(texCoordData);
+          texCoords[j] = Ogre::Vector2(start[0], start[1]);
+          // advance by vertex size
+          texCoordData += vertexSize;
+        }
       }
     }
-    return material;
-  }
 
-  void readPositions(Ogre::VertexData *vertexData, Vertex *vertices, size_t vertexOffset, const Ogre::Vector3 &position, const Ogre::Quaternion &orientation, const Ogre::Vector3 &scale) {
-    // get position data
-    const Ogre::VertexElement *positionElement = vertexData->vertexDeclaration->findElementBySemantic(Ogre::VES_POSITION);
-    if (positionElement) {
-      Ogre::HardwareVertexBufferSharedPtr positionBuffer = vertexData->vertexBufferBinding->getBuffer(positionElement->getSource());
-      unsigned char *positionData = static_cast<unsigned char*>(positionBuffer->lock(Ogre::HardwareBuffer::HBL_READ_ONLY));
-      for (size_t j = 0; j < vertexData->vertexCount; ++j) {
-        float *start = 0;
-        // get position data for this vertex
-        positionElement->baseVertexPointerToElement(positionData, &start);
-        vertices[vertexOffset + j].position = (orientation * (Ogre::Vector3(start[0], start[1], start[2]) * scale)) + position;
-        // advance by vertex size
-        positionData += positionBuffer->getVertexSize();
+    void readIndices(const ParseJob &job) const {
+      Ogre::HardwareIndexBuffer *indexBuffer = job.indexData->indexBuffer.getPointer();
+      const void *indexData = lockedBuffers.find(indexBuffer)->second;
+      // index of the first index to read
+      size_t first = job.indexData->indexStart + job.first * 3;
+      Ogre::uint32 *indices = mesh->indices() + (job.triangleOffset + job.first) * 3;
+      if (indexBuffer->getType() == Ogre::HardwareIndexBuffer::IT_32BIT) {
+        const Ogre::uint32 *data = static_cast<const Ogre::uint32 *>(indexData) + first;
+        for (size_t j = 0; j < job.count * 3; ++j)
+          indices[j] = data[j] + job.vertexOffset;
+      } else {
+        const Ogre::uint16 *data = static_cast<const Ogre::uint16 *>(indexData) + first;
+        for (size_t j = 0; j < job.count * 3; ++j)
+          indices[j] = data[j] + job.vertexOffset;
       }
-      positionBuffer->unlock();
     }
-  }
 
-  void readNormals(Ogre::VertexData *vertexData, Vertex *vertices, size_t vertexOffset, const Ogre::Quaternion &orientation) {
-    // get normal data
-    const Ogre::VertexElement *normalElement = vertexData->vertexDeclaration->findElementBySemantic(Ogre::VES_NORMAL);
-    if (normalElement) {
-      Ogre::HardwareVertexBufferSharedPtr normalBuffer = vertexData->vertexBufferBinding->getBuffer(normalElement->getSource());
-      unsigned char *normalData = static_cast<unsigned char*>(normalBuffer->lock(Ogre::HardwareBuffer::HBL_READ_ONLY));
-      for (size_t j = 0; j < vertexData->vertexCount; ++j) {
-        float *start = 0;
-        // get normal data for this vertex
-        normalElement->baseVertexPointerToElement(normalData, &start);
-        vertices[vertexOffset + j].normal = orientation * Ogre::Vector3(start[0], start[1], start[2]);
-        // advance by vertex size
-        normalData += normalBuffer->getVertexSize();
+    void readLoadedVertices(const ParseJob &job) const {
+      const Ogre::Vector3 *sourcePositions = loadedMesh->positions() + job.first;
+      const Ogre::Vector3 *sourceNormals = loadedMesh->normals() + job.first;
+      Ogre::Vector3 *positions = mesh->positions() + job.first;
+      Ogre::Vector3 *normals = mesh->normals() + job.first;
+      // transform positions and normals
+      for (size_t j = 0; j < job.count; ++j) {
+        positions[j] = (orientation * (sourcePositions[j] * scale)) + position;
+        normals[j] = orientation * sourceNormals[j];
       }
-      normalBuffer->unlock();
+      // copy texture coordinates
+      std::copy(loadedMesh->texCoords() + job.first, loadedMesh->texCoords() + job.first + job.count, mesh->texCoords() + job.first);
     }
-  }
 
-  void readTexCoords(Ogre::VertexData *vertexData, Vertex *vertices, size_t vertexOffset) {
-    // get texCoord data
-    const Ogre::VertexElement *texCoordElement = vertexData->vertexDeclaration->findElementBySemantic(Ogre::VES_TEXTURE_COORDINATES);
-    if (texCoordElement) {
-      Ogre::HardwareVertexBufferSharedPtr texCoordBuffer = vertexData->vertexBufferBinding->getBuffer(texCoordElement->getSource());
-      unsigned char *texCoordData = static_cast<unsigned char*>(texCoordBuffer->lock(Ogre::HardwareBuffer::HBL_READ_ONLY));
-      for (size_t j = 0; j < vertexData->vertexCount; ++j) {
-        float *start = 0;
-        // get texCoord data for this vertex
-        texCoordElement->baseVertexPointerToElement(texCoordData, &start);
-        vertices[vertexOffset + j].texCoord = Ogre::Vector2(start[0], start[1]);
-        // advance by vertex size
-        texCoordData += texCoordBuffer->getVertexSize();
+    void readLoadedTriangles(const ParseJob &job) const {
+      // copy indices and material indices, materials are added in the same order
+      std::copy(loadedMesh->indices() + job.first * 3, loadedMesh->indices() + (job.first + job.count) * 3, mesh->indices() + job.first * 3);
+      std::copy(loadedMesh->materialIndices() + job.first, loadedMesh->materialIndices() + job.first + job.count, mesh->materialIndices() + job.first);
+    }
+
+    void addLoadedMeshJobs(Mesh *target) {
+      // create the mesh or read the vertices only into the mesh of the last parse
+      if (target) {
+        if (!isUpdatable(target, loadedMesh->vertexCount(), loadedMesh->triangleCount()))
+          return;
+        mesh = target;
+      } else {
+        mesh = new Mesh(loadedMesh->vertexCount(), loadedMesh->triangleCount());
+        for (size_t i = 0; i < loadedMesh->materials().size(); ++i)
+          mesh->addMaterial(loadedMesh->materials().at(i));
       }
-      texCoordBuffer->unlock();
+      // split vertices and triangles into jobs
+      for (size_t i = 0; i < loadedMesh->vertexCount(); i += MAXIMUM_ELEMENTS_PER_JOB)
+        jobs.push_back(ParseJob(PJT_LOADED_VERTICES, 0, 0, i, std::min<size_t>(MAXIMUM_ELEMENTS_PER_JOB, loadedMesh->vertexCount() - i), 0, 0));
+      if (target)
+        return;
+      for (size_t i = 0; i < loadedMesh->triangleCount(); i += MAXIMUM_ELEMENTS_PER_JOB)
+        jobs.push_back(ParseJob(PJT_LOADED_TRIANGLES, 0, 0, i, std::min<size_t>(MAXIMUM_ELEMENTS_PER_JOB, loadedMesh->triangleCount() - i), 0, 0));
+    }
+
+    // the vertices can be read into a mesh again if the entity still has its layout and the mesh is not quantized
+    const bool isUpdatable(const Mesh *target, const size_t vertexCount, const size_t triangleCount) const {
+      return target->vertexCount() == vertexCount && target->triangleCount() == triangleCount && !target->isCompressed();
     }
-  }
 
-  MeshParser::MeshParser(const Ogre::Entity *entity) : d(new MeshParserPrivate()) {
-    // get position orientation and scale
-    Ogre::Vector3 position = entity->getParentSceneNode()->_getDerivedPosition();
-    Ogre::Quaternion orientation = entity->getParentSceneNode()->_getDerivedOrientation();
-    Ogre::Vector3 scale = entity->getParentSceneNode()->_getDerivedScale();
-    // extract mesh information
-    bool useSharedVertices = false;
-    // calculate total number of the vertices and indices in the mesh
-    Ogre::Mesh *mesh = entity->getMesh().getPointer();
-    for (unsigned int i = 0; i < entity->getNumSubEntities(); ++i) {
-      Ogre::SubEntity *subEntity = entity->getSubEntity(i);
-      Ogre::SubMesh *subMesh = subEntity->getSubMesh();
-      // add vertex count if not using shared vertices
-      if (subMesh->useSharedVertices)
-        useSharedVertices = true;
+    // vertex data of the current pose of an animated entity, blended by ogre in software
+    Ogre::VertexData *poseVertexData(Ogre::VertexData *vertexData, Ogre::Entity *entity, Ogre::SubEntity *subEntity) const {
+      if (!animatedEntity)
+        return vertexData;
+      Ogre::VertexData *animatedData;
+      if (subEntity)
+        animatedData = entity->hasSkeleton() ? subEntity->_getSkelAnimVertexData() : subEntity->_getSoftwareVertexAnimVertexData();
       else
-        d->vertexCount += subMesh->vertexData->vertexCount;
-      // add index count
-      d->indexCount += subMesh->indexData->indexCount;
-    }
-    // add shared vertex count, if used
-    if (useSharedVertices)
-      d->vertexCount += mesh->sharedVertexData->vertexCount;
-    // create buffers
-    d->vertices = new Vertex[d->vertexCount];
-    d->indices = new Ogre::uint32[d->indexCount];
-    // offset of the first vertex or index position to write into
-    size_t vertexOffset = 0;
-    size_t indexOffset = 0;
-    size_t triangleOffset = 0;
-    // extract shared vertices
-    if (useSharedVertices) {
-      readPositions(mesh->sharedVertexData, d->vertices, vertexOffset, position, orientation, scale);
-      readNormals(mesh->sharedVertexData, d->vertices, vertexOffset, orientation);
-      readTexCoords(mesh->sharedVertexData, d->vertices, vertexOffset);
-      vertexOffset += mesh->sharedVertexData->vertexCount;
-    }
-    // process submeshes
-    for (unsigned int i = 0; i < entity->getNumSubEntities(); ++i) {
-      Ogre::SubEntity *subEntity = entity->getSubEntity(i);
-      Ogre::SubMesh *subMesh = subEntity->getSubMesh();
-      // extract vertices if not using shared vertices
-      if (!subMesh->useSharedVertices) {
-        readPositions(subMesh->vertexData, d->vertices, vertexOffset, position, orientation, scale);
-        readNormals(subMesh->vertexData, d->vertices, vertexOffset, orientation);
-        readTexCoords(subMesh->vertexData, d->vertices, vertexOffset);
+        animatedData = entity->hasSkeleton() ? entity->_getSkelAnimVertexData() : entity->_getSoftwareVertexAnimVertexData();
+      // vertex data without animation of its own, like a submesh without poses in an animated mesh, has no copy
+      return animatedData ? animatedData : vertexData;
+    }
+
+    void addEntityJobs(Ogre::Entity *entity, MaterialLibrary *materialLibrary, Mesh *target) {
+      // get position orientation and scale
+      position = entity->getParentSceneNode()->_getDerivedPosition();
+      orientation = entity->getParentSceneNode()->_getDerivedOrientation();
+      scale = entity->getParentSceneNode()->_getDerivedScale();
+      // the mesh library copy is in the bind pose, animated entities are read from the vertices blended by ogre
+      if (entity->_isAnimated()) {
+        entity->addSoftwareAnimationRequest(true);
+        entity->_updateAnimation();
+        animatedEntity = entity;
       }
-      // extract indices
-      Ogre::HardwareIndexBufferSharedPtr indexBuffer = subMesh->indexData->indexBuffer;
-      if (indexBuffer->getType() == Ogre::HardwareIndexBuffer::IT_32BIT) {
-        Ogre::uint32 *indexData = static_cast<Ogre::uint32 *>(indexBuffer->lock(Ogre::HardwareBuffer::HBL_READ_ONLY));
-        for (size_t j = 0; j < subMesh->indexData->indexCount; ++j)
-          d->indices[indexOffset + j] = indexData[subMesh->indexData->indexStart + j] + (subMesh->useSharedVertices ? 0 : vertexOffset);
-        indexBuffer->unlock();
+      // use the mesh library copy if the mesh has been loaded without ogre, no need to read the hardware buffers
+      loadedMesh = animatedEntity ? 0 : MeshLibrary::instance()->getMesh(entity->getMesh()->getName());
+      if (loadedMesh) {
+        addLoadedMeshJobs(target);
+        return;
+      }
+      // extract mesh information
+      bool useSharedVertices = false;
+      size_t vertexCount = 0;
+      size_t triangleCount = 0;
+      // calculate total number of the vertices and triangles in the mesh
+      Ogre::Mesh *ogreMesh = entity->getMesh().getPointer();
+      for (unsigned int i = 0; i < entity->getNumSubEntities(); ++i) {
+        Ogre::SubEntity *subEntity = entity->getSubEntity(i);
+        Ogre::SubMesh *subMesh = subEntity->getSubMesh();
+        // add vertex count if not using shared vertices
+        if (subMesh->useSharedVertices)
+          useSharedVertices = true;
+        else
+          vertexCount += subMesh->vertexData->vertexCount;
+        // add triangle count
+        triangleCount += subMesh->indexData->indexCount / 3;
+      }
+      // add shared vertex count, if used
+      if (useSharedVertices)
+        vertexCount += ogreMesh->sharedVertexData->vertexCount;
+      // create the mesh or read the vertices only into the mesh of the last parse, the indices and materials are kept
+      if (target) {
+        if (!isUpdatable(target, vertexCount, triangleCount))
+          return;
+        mesh = target;
       } else {
-        Ogre::uint16 *indexData = static_cast<Ogre::uint16 *>(indexBuffer->lock(Ogre::HardwareBuffer::HBL_READ_ONLY));
-        for (size_t j = 0; j < subMesh->indexData->indexCount; ++j)
-          d->indices[indexOffset + j] = indexData[subMesh->indexData->indexStart + j] + (subMesh->useSharedVertices ? 0 : vertexOffset);
-        indexBuffer->unlock();
+        mesh = new Mesh(vertexCount, triangleCount);
+      }
+      // offset of the first vertex or triangle to write into
+      size_t vertexOffset = 0;
+      size_t triangleOffset = 0;
+      // read shared vertices first
+      if (useSharedVertices) {
+        addVertexJobs(poseVertexData(ogreMesh->sharedVertexData, entity, 0), vertexOffset);
+        vertexOffset += ogreMesh->sharedVertexData->vertexCount;
       }
-      // read sub-entity material
-      Material *material  = readMaterial(subEntity->getMaterialName());
-      // fill in the triangles array
-      for (int j = 0; j < subMesh->indexData->indexCount / 3; ++j) {
-        const Vertex &v1 = d->vertices[d->indices[indexOffset + j * 3 + 0]];
-        const Vertex &v2 = d->vertices[d->indices[indexOffset + j * 3 + 1]];
-        const Vertex &v3 = d->vertices[d->indices[indexOffset + j * 3 + 2]];
-        d->triangles.push_back(new Triangle(v1.position, v2.position, v3.position, v1.normal, v2.normal, v3.normal, v1.texCoord, v2.texCoord, v3.texCoord, material));
+      // process submeshes
+      for (unsigned int i = 0; i < entity->getNumSubEntities(); ++i) {
+        Ogre::SubEntity *subEntity = entity->getSubEntity(i);
+        Ogre::SubMesh *subMesh = subEntity->getSubMesh();
+        size_t subMeshTriangleCount = subMesh->indexData->indexCount / 3;
+        // read vertices if not using shared vertices
+        if (!subMesh->useSharedVertices)
+          addVertexJobs(poseVertexData(subMesh->vertexData, entity, subEntity), vertexOffset);
+        if (!target) {
+          // read indices of the complete triangles
+          addIndexJobs(subMesh->indexData, subMesh->useSharedVertices ? 0 : vertexOffset, triangleOffset);
+          // read sub-entity material
+          Ogre::uint16 materialIndex = mesh->addMaterial(materialLibrary->getMaterial(subEntity->getMaterialName()));
+          // assign material to the triangles of the submesh
+          for (size_t j = 0; j < subMeshTriangleCount; ++j)
+            mesh->materialIndices()[triangleOffset + j] = materialIndex;
+        }
+        // update vertex and triangle offsets
+        if (!subMesh->useSharedVertices)
+          vertexOffset += subMesh->vertexData->vertexCount;
+        triangleOffset += subMeshTriangleCount;
       }
-      // update vertex and index offsets
-      if (!subMesh->useSharedVertices)
-        vertexOffset += subMesh->vertexData->vertexCount;
-      indexOffset += subMesh->indexData->indexCount;
-      triangleOffset += subMesh->indexData->indexCount / 3;
     }
+
+    Mesh *mesh;
+    // mesh loaded directly into the mesh library, if any
+    const Mesh *loadedMesh;
+    // entity blended in software for the parse, the request is withdrawn when the parser is deleted
+    Ogre::Entity *animatedEntity;
+    // world transform
+    Ogre::Vector3 position;
+    Ogre::Quaternion orientation;
+    Ogre::Vector3 scale;
+    // parse jobs
+    std::vector<ParseJob> jobs;
+    std::map<Ogre::HardwareBuffer *, void *> lockedBuffers;
+  };
+
+  MeshParser::MeshParser(Ogre::Entity *entity, MaterialLibrary *materialLibrary) : d(new MeshParserPrivate()) {
+    d->addEntityJobs(entity, materialLibrary, 0);
+  }
+
+  MeshParser::MeshParser(Ogre::Entity *entity, Mesh *mesh) : d(new MeshParserPrivate()) {
+    d->addEntityJobs(entity, 0, mesh);
   }
 
   MeshParser::~MeshParser() {
+    d->unlock();
+    if (d->animatedEntity)
+      d->animatedEntity->removeSoftwareAnimationRequest(true);
     delete d;
   }
 
-  const std::vector<Triangle *> &MeshParser::triangles() const {
-    return d->triangles;
+  const size_t MeshParser::jobCount() const {
+    return d->jobs.size();
+  }
+
+  void MeshParser::parse(const size_t job) const {
+    const ParseJob &parseJob = d->jobs.at(job);
+    if (parseJob.type == PJT_VERTICES)
+      d->readVertices(parseJob);
+    else if (parseJob.type == PJT_INDICES)
+      d->readIndices(parseJob);
+    else if (parseJob.type == PJT_LOADED_VERTICES)
+      d->readLoadedVertices(parseJob);
+    else if (parseJob.type == PJT_LOADED_TRIANGLES)
+      d->readLoadedTriangles(parseJob);
+  }
+
+  void MeshParser::parse() const {
+    for (size_t i = 0; i < d->jobs.size(); ++i)
+      parse(i);
+  }
+
+  Mesh *MeshParser::mesh() const {
+    return d->mesh;
   }
 }
@@ -4,17 +4,26 @@
 #include <OGRE/OgrePrerequisites.h>
 
 namespace Aort {
-  class Material;
-  class Triangle;
+  class MaterialLibrary;
+  class Mesh;
 
   class MeshParserPrivate;
 
   class MeshParser {
   public:
-    MeshParser(const Ogre::Entity *entity);
+    // animated entities are read in their current pose, ogre blends them in software for the parse
+    MeshParser(Ogre::Entity *entity, MaterialLibrary *materialLibrary);
+    // reads the vertices of the entity again into the mesh parsed from it before, for entities that moved or deformed,
+    // the triangles and materials are kept, mesh returns 0 if the vertex or triangle count changed or the mesh is
+    // quantized
+    MeshParser(Ogre::Entity *entity, Mesh *mesh);
     ~MeshParser();
 
-    const std::vector<Triangle *> &triangles() const;
+    const size_t jobCount() const;
+    void parse(const size_t job) const;
+    void parse() const;
+
+    Mesh *mesh() const;
 
   private:
     MeshParserPrivate *d;
@@ -0,0 +1,519 @@
+#include "AortRenderServer.h"
+
+#include "AortDistributed.h"
+#include "AortImageWriter.h"
+#include "AortMeshLibrary.h"
+#include "AortRenderer.h"
+
+#include <QBuffer>
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QStringList>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThread>
+#include <QTime>
+#include <QUrl>
+#include <QWaitCondition>
+
+#include <OGRE/OgreCamera.h>
+#include <OGRE/OgreCommon.h>
+#include <OGRE/OgreLogManager.h>
+#include <OGRE/OgreMath.h>
+#include <OGRE/OgreSceneManager.h>
+#include <OGRE/OgreStringConverter.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#ifndef NO_OMP
+#include <omp.h>
+#endif // !NO_OMP
+
+// largest request header accepted
+#define MAX_REQUEST_SIZE (64 * 1024)
+// time a client may take to send its request
+#define REQUEST_TIMEOUT (10000)
+// largest image edge accepted
+#define MAX_IMAGE_SIZE (16384)
+
+namespace Aort {
+  static const bool parseVector(const QString &value, Ogre::Vector3 &vector) {
+    QStringList values = value.split(",");
+    if (values.size() != 3)
+      return false;
+    bool ok[3];
+    vector = Ogre::Vector3(values.at(0).toFloat(&ok[0]), values.at(1).toFloat(&ok[1]), values.at(2).toFloat(&ok[2]));
+    return ok[0] && ok[1] && ok[2];
+  }
+
+  // a prepared scene, it is deleted when it has been removed and no render uses it anymore
+  class CachedScene {
+  public:
+    CachedScene(const RenderJob &job, Renderer *renderer, const std::vector<Ogre::String> &meshNames, const int preprocessTime) : job(job), renderer(renderer), meshNames(meshNames), preprocessTime(preprocessTime), users(0), lastUsed(0), removed(false) {
+    }
+
+    ~CachedScene() {
+      delete renderer;
+    }
+
+    RenderJob job;
+    Renderer *renderer;
+    // meshes of the scene held in the mesh library, they are released by the server after the scene is deleted
+    std::vector<Ogre::String> meshNames;
+    int preprocessTime;
+    // renders of the same scene run one after the other, the renderer keeps the state of a render
+    QMutex renderMutex;
+    int users;
+    // value of the use counter of the server when the scene was last used
+    quint64 lastUsed;
+    bool removed;
+  };
+
+  // shares the cores between the renders, each render gets an equal share of the cores when it starts, limited to the
+  // cores no other render holds, and a render waits while every core is in use
+  class CoreScheduler {
+  public:
+    CoreScheduler() : threads(1), running(0), used(0) {
+    }
+
+    const int acquire() {
+      QMutexLocker locker(&mutex);
+      while (used >= threads)
+        released.wait(&mutex);
+      running++;
+      int acquired = std::min(threads - used, std::max(1, threads / running));
+      used += acquired;
+      return acquired;
+    }
+
+    // gives back the cores returned by acquire
+    void release(const int acquired) {
+      QMutexLocker locker(&mutex);
+      running--;
+      used -= acquired;
+      released.wakeAll();
+    }
+
+    int threads;
+    int running;
+    // cores held by the running renders
+    int used;
+    QMutex mutex;
+    QWaitCondition released;
+  };
+
+  // hands the accepted connections to the server instead of queueing them
+  class HttpServer : public QTcpServer {
+  public:
+    HttpServer(RenderServerPrivate *server) : server(server) {
+    }
+
+  protected:
+    void incomingConnection(int socketDescriptor);
+
+  private:
+    RenderServerPrivate *server;
+  };
+
+  class RenderServerPrivate {
+  public:
+    RenderServerPrivate(Ogre::SceneManager *sceneManager) : sceneManager(sceneManager), httpServer(this), cacheSize(8), useCounter(0), cameraCounter(0) {
+#ifndef NO_OMP
+      scheduler.threads = omp_get_num_procs();
+#endif // !NO_OMP
+    }
+
+    ~RenderServerPrivate() {
+      for (std::map<QString, CachedScene *>::iterator it = scenes.begin(); it != scenes.end(); ++it)
+        deleteScene(it->second);
+      MeshLibrary::instance()->release(releasedMeshNames);
+    }
+
+    // returns the scene and marks it used, 0 if there is no scene with the id
+    CachedScene *acquireScene(const QString &id) {
+      QMutexLocker locker(&cacheMutex);
+      std::map<QString, CachedScene *>::iterator it = scenes.find(id);
+      if (it == scenes.end())
+        return 0;
+      it->second->users++;
+      it->second->lastUsed = ++useCounter;
+      return it->second;
+    }
+
+    void releaseScene(CachedScene *scene) {
+      QMutexLocker locker(&cacheMutex);
+      scene->users--;
+      if (scene->removed && scene->users == 0)
+        deleteScene(scene);
+    }
+
+    // must be called with the cache mutex locked
+    void removeScene(std::map<QString, CachedScene *>::iterator it) {
+      if (it->second->users == 0)
+        deleteScene(it->second);
+      else
+        it->second->removed = true;
+      scenes.erase(it);
+    }
+
+    // must be called with the cache mutex locked, the meshes are released later with the load mutex locked
+    void deleteScene(CachedScene *scene) {
+      releasedMeshNames.insert(releasedMeshNames.end(), scene->meshNames.begin(), scene->meshNames.end());
+      delete scene;
+    }
+
+    // releases the meshes of the deleted scenes, must be called with the load mutex locked
+    void releaseMeshes() {
+      std::vector<Ogre::String> meshNames;
+      {
+        QMutexLocker locker(&cacheMutex);
+        meshNames.swap(releasedMeshNames);
+      }
+      MeshLibrary::instance()->release(meshNames);
+    }
+
+    // releases the meshes of the deleted scenes, waits for the scene being loaded only if there are any
+    void releaseDeletedMeshes() {
+      {
+        QMutexLocker locker(&cacheMutex);
+        if (releasedMeshNames.empty())
+          return;
+      }
+      QMutexLocker loadLocker(&loadMutex);
+      releaseMeshes();
+    }
+
+    const bool addScene(const QString &id, const RenderJob &job, QString &error) {
+      // the mesh library is not thread safe, the scenes are loaded one after the other
+      QMutexLocker loadLocker(&loadMutex);
+      QTime time;
+      time.start();
+      std::vector<Ogre::String> meshNames;
+      Renderer *renderer = job.createRenderer(error, meshNames);
+      if (!renderer)
+        return false;
+      Ogre::LogManager::getSingletonPtr()->logMessage("Prepared scene " + id.toStdString() + " in " + Ogre::StringConverter::toString(time.elapsed()) + " ms");
+      {
+        QMutexLocker locker(&cacheMutex);
+        std::map<QString, CachedScene *>::iterator it = scenes.find(id);
+        if (it != scenes.end())
+          removeScene(it);
+        CachedScene *scene = new CachedScene(job, renderer, meshNames, time.elapsed());
+        scene->lastUsed = ++useCounter;
+        scenes[id] = scene;
+        // release the scenes used least recently, scenes being rendered are kept until their renders finish
+        while (int(scenes.size()) > cacheSize) {
+          std::map<QString, CachedScene *>::iterator oldest = scenes.end();
+          for (it = scenes.begin(); it != scenes.end(); ++it)
+            if (it->second != scene && (oldest == scenes.end() || it->second->lastUsed < oldest->second->lastUsed))
+              oldest = it;
+          if (oldest == scenes.end())
+            break;
+          Ogre::LogManager::getSingletonPtr()->logMessage("Releasing scene " + oldest->first.toStdString());
+          removeScene(oldest);
+        }
+      }
+      releaseMeshes();
+      return true;
+    }
+
+    // cameras are created and destroyed by the scene manager, which is not thread safe
+    Ogre::Camera *createCamera() {
+      QMutexLocker locker(&cameraMutex);
+      return sceneManager->createCamera("ServerCamera" + Ogre::StringConverter::toString(++cameraCounter));
+    }
+
+    void destroyCamera(Ogre::Camera *camera) {
+      QMutexLocker locker(&cameraMutex);
+      sceneManager->destroyCamera(camera);
+    }
+
+    static void writeResponse(QTcpSocket *socket, const int status, const QByteArray &contentType, const QByteArray &body, const QByteArray &headers = QByteArray()) {
+      QByteArray reason = status == 200 ? "OK" : status == 400 ? "Bad Request" : status == 404 ? "Not Found" : status == 405 ? "Method Not Allowed" : "Internal Server Error";
+      QByteArray response = "HTTP/1.0 " + QByteArray::number(status) + " " + reason + "\r\n";
+      response += "Content-Type: " + contentType + "\r\n";
+      response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+      response += headers;
+      response += "Connection: close\r\n\r\n";
+      response += body;
+      socket->write(response);
+      while (socket->bytesToWrite() > 0)
+        if (!socket->waitForBytesWritten(REQUEST_TIMEOUT))
+          break;
+    }
+
+    static void writeError(QTcpSocket *socket, const int status, const QString &message) {
+      writeResponse(socket, status, "text/plain; charset=utf-8", message.toUtf8() + "\n");
+    }
+
+    void putScene(QTcpSocket *socket, const QString &id, const QUrl &url) {
+      RenderJob job;
+      job.scenePath = url.queryItemValue("path").toStdString();
+      QStringList lights = url.allQueryItemValues("light");
+      for (int i = 0; i < lights.size(); ++i) {
+        JobLight light;
+        if (!parseVector(lights.at(i), light.position)) {
+          writeError(socket, 400, "Invalid light " + lights.at(i));
+          return;
+        }
+        job.lights.push_back(light);
+      }
+      QString error;
+      if (job.scenePath.empty())
+        writeError(socket, 400, "Missing path");
+      else if (!addScene(id, job, error))
+        writeError(socket, 400, error);
+      else
+        writeResponse(socket, 200, "application/json", listScenes(id));
+    }
+
+    // json of the scene with the id or of all scenes if the id is empty
+    QByteArray listScenes(const QString &id) {
+      QMutexLocker locker(&cacheMutex);
+      QByteArray json = id.isEmpty() ? "[" : "";
+      int count = 0;
+      for (std::map<QString, CachedScene *>::const_iterator it = scenes.begin(); it != scenes.end(); ++it) {
+        if (!id.isEmpty() && it->first != id)
+          continue;
+        const CachedScene *scene = it->second;
+        if (count++)
+          json += ",";
+        json += "\n  { \"id\": \"" + it->first.toUtf8() + "\", \"path\": \"" + QByteArray(scene->job.scenePath.c_str()) + "\"";
+        json += ", \"triangles\": " + QByteArray::number(qulonglong(scene->renderer->getTriangleCount()));
+        json += ", \"lights\": " + QByteArray::number(qulonglong(scene->renderer->getLightCount()));
+        json += ", \"memoryBytes\": " + QByteArray::number(qulonglong(scene->renderer->getMemoryUsage()));
+        json += ", \"preprocessMilliseconds\": " + QByteArray::number(scene->preprocessTime);
+        json += ", \"rendering\": " + QByteArray::number(scene->users) + " }";
+      }
+      json += id.isEmpty() ? "\n]\n" : "\n";
+      return json;
+    }
+
+    void render(QTcpSocket *socket, const QString &id, const QUrl &url) {
+      // read the parameters of the image
+      int width = url.hasQueryItem("width") ? url.queryItemValue("width").toInt() : 640;
+      int height = url.hasQueryItem("height") ? url.queryItemValue("height").toInt() : 480;
+      int samples = url.hasQueryItem("samples") ? url.queryItemValue("samples").toInt() : 1;
+      int supersampling = url.hasQueryItem("supersampling") ? url.queryItemValue("supersampling").toInt() : 1;
+      Ogre::Real fov = url.hasQueryItem("fov") ? url.queryItemValue("fov").toFloat() : 45.0f;
+      Ogre::Real exposure = url.queryItemValue("exposure").toFloat();
+      Ogre::Vector3 position(0.0f, 150.0f, 600.0f);
+      Ogre::Vector3 target(0.0f, 100.0f, 0.0f);
+      ImageFormat format = IF_PNG;
+      if (!ImageFileWriter::formatFromPath("." + url.queryItemValue("format").toStdString(), format) && url.hasQueryItem("format")) {
+        writeError(socket, 400, "Unknown format " + url.queryItemValue("format"));
+        return;
+      }
+      if (width < 1 || height < 1 || width > MAX_IMAGE_SIZE || height > MAX_IMAGE_SIZE || samples < 1 || supersampling < 1 || fov <= 0.0f || fov >= 180.0f ||
+          (url.hasQueryItem("camera") && !parseVector(url.queryItemValue("camera"), position)) ||
+          (url.hasQueryItem("target") && !parseVector(url.queryItemValue("target"), target))) {
+        writeError(socket, 400, "Invalid parameters");
+        return;
+      }
+      CachedScene *scene = acquireScene(id);
+      if (!scene) {
+        writeError(socket, 404, "Unknown scene " + id);
+        return;
+      }
+      Ogre::Camera *camera = createCamera();
+      camera->setNearClipDistance(10.0f);
+      camera->setPosition(position);
+      camera->lookAt(target);
+      camera->setFOVy(Ogre::Degree(fov));
+      camera->setAspectRatio(Ogre::Real(width) / Ogre::Real(height));
+      // render into memory
+      QByteArray image;
+      QBuffer buffer(&image);
+      ImageFileWriter writer(&buffer, format, exposure);
+      QTime time;
+      time.start();
+      int result;
+      int threads;
+      {
+        QMutexLocker locker(&scene->renderMutex);
+        // the share of the cores is taken when the scene is free, so that waiting renders do not hold cores
+        threads = scheduler.acquire();
+#ifndef NO_OMP
+        omp_set_num_threads(threads);
+#endif // !NO_OMP
+        scene->renderer->setRegion(Ogre::Rect());
+        scene->renderer->setSamplesPerPixel(samples);
+        result = scene->renderer->render(camera, width, height, &writer, supersampling);
+        scheduler.release(threads);
+      }
+      buffer.close();
+      destroyCamera(camera);
+      releaseScene(scene);
+      releaseDeletedMeshes();
+      if (result < 0) {
+        writeError(socket, 500, "Could not write the image");
+        return;
+      }
+      const char *contentTypes[3] = { "image/png", "image/x-exr", "image/x-portable-floatmap" };
+      QByteArray headers = "X-Render-Milliseconds: " + QByteArray::number(time.elapsed()) + "\r\n" +
+                           "X-Render-Threads: " + QByteArray::number(threads) + "\r\n";
+      writeResponse(socket, 200, contentTypes[format], image, headers);
+    }
+
+    // answers a single request, the connection is closed afterwards
+    void serve(QTcpSocket *socket) {
+      // read the request line and the headers, a body is not used
+      QByteArray request;
+      while (request.indexOf("\r\n\r\n") < 0) {
+        if (request.size() > MAX_REQUEST_SIZE || (socket->bytesAvailable() == 0 && !socket->waitForReadyRead(REQUEST_TIMEOUT)))
+          return;
+        request.append(socket->readAll());
+      }
+      QList<QByteArray> requestLine = request.left(request.indexOf("\r\n")).split(' ');
+      if (requestLine.size() < 2) {
+        writeError(socket, 400, "Invalid request");
+        return;
+      }
+      QByteArray method = requestLine.at(0);
+      QUrl url = QUrl::fromEncoded(requestLine.at(1));
+      QStringList path = url.path().split("/", QString::SkipEmptyParts);
+      Ogre::LogManager::getSingletonPtr()->logMessage("Request " + QString(method).toStdString() + " " + url.path().toStdString());
+      if (path.size() == 1 && path.at(0) == "scenes" && method == "GET") {
+        writeResponse(socket, 200, "application/json", listScenes(QString()));
+      } else if (path.size() == 2 && path.at(0) == "scenes" && (method == "PUT" || method == "POST")) {
+        putScene(socket, path.at(1), url);
+      } else if (path.size() == 2 && path.at(0) == "scenes" && method == "DELETE") {
+        bool found = false;
+        {
+          QMutexLocker locker(&cacheMutex);
+          std::map<QString, CachedScene *>::iterator it = scenes.find(path.at(1));
+          found = it != scenes.end();
+          if (found)
+            removeScene(it);
+        }
+        releaseDeletedMeshes();
+        if (found)
+          writeResponse(socket, 200, "application/json", "{}\n");
+        else
+          writeError(socket, 404, "Unknown scene " + path.at(1));
+      } else if (path.size() == 2 && path.at(0) == "render" && method == "GET") {
+        render(socket, path.at(1), url);
+      } else if (path.size() >= 1 && (path.at(0) == "scenes" || path.at(0) == "render")) {
+        writeError(socket, 405, "Method not allowed");
+      } else {
+        writeError(socket, 404, "Not found");
+      }
+    }
+
+    Ogre::SceneManager *sceneManager;
+    HttpServer httpServer;
+    // scenes by id, guarded by the cache mutex
+    std::map<QString, CachedScene *> scenes;
+    // meshes of the deleted scenes not yet released from the mesh library, guarded by the cache mutex
+    std::vector<Ogre::String> releasedMeshNames;
+    int cacheSize;
+    quint64 useCounter;
+    QMutex cacheMutex;
+    QMutex loadMutex;
+    QMutex cameraMutex;
+    int cameraCounter;
+    CoreScheduler scheduler;
+    // threads of the connections being served
+    std::vector<QThread *> connections;
+  };
+
+  // serves a connection on its own thread
+  class ConnectionThread : public QThread {
+  public:
+    ConnectionThread(RenderServerPrivate *server, const int socketDescriptor) : server(server), socketDescriptor(socketDescriptor) {
+    }
+
+  protected:
+    void run() {
+      QTcpSocket socket;
+      if (!socket.setSocketDescriptor(socketDescriptor))
+        return;
+      server->serve(&socket);
+      socket.disconnectFromHost();
+      if (socket.state() != QAbstractSocket::UnconnectedState)
+        socket.waitForDisconnected(REQUEST_TIMEOUT);
+    }
+
+  private:
+    RenderServerPrivate *server;
+    int socketDescriptor;
+  };
+
+  void HttpServer::incomingConnection(int socketDescriptor) {
+    // delete the threads of the connections that have been served
+    for (size_t i = 0; i < server->connections.size(); ) {
+      if (server->connections.at(i)->isFinished()) {
+        delete server->connections.at(i);
+        server->connections.erase(server->connections.begin() + i);
+      } else {
+        ++i;
+      }
+    }
+    server->connections.push_back(new ConnectionThread(server, socketDescriptor));
+    server->connections.back()->start();
+  }
+
+  RenderServer::RenderServer(Ogre::SceneManager *sceneManager) : d(new RenderServerPrivate(sceneManager)) {
+  }
+
+  RenderServer::~RenderServer() {
+    d->httpServer.close();
+    for (size_t i = 0; i < d->connections.size(); ++i) {
+      d->connections.at(i)->wait();
+      delete d->connections.at(i);
+    }
+    delete d;
+  }
+
+  void RenderServer::setThreadCount(const int threads) {
+    QMutexLocker locker(&d->scheduler.mutex);
+    d->scheduler.threads = std::max(1, threads);
+    // waiting renders may fit into the added cores
+    d->scheduler.released.wakeAll();
+  }
+
+  const int RenderServer::getThreadCount() const {
+    return d->scheduler.threads;
+  }
+
+  void RenderServer::setCacheSize(const int scenes) {
+    d->cacheSize = std::max(1, scenes);
+  }
+
+  const int RenderServer::getCacheSize() const {
+    return d->cacheSize;
+  }
+
+  const bool RenderServer::addScene(const QString &id, const RenderJob &job, QString &error) {
+    return d->addScene(id, job, error);
+  }
+
+  const bool RenderServer::removeScene(const QString &id) {
+    {
+      QMutexLocker locker(&d->cacheMutex);
+      std::map<QString, CachedScene *>::iterator it = d->scenes.find(id);
+      if (it == d->scenes.end())
+        return false;
+      d->removeScene(it);
+    }
+    d->releaseDeletedMeshes();
+    return true;
+  }
+
+  const bool RenderServer::listen(const quint16 port, const bool localOnly) {
+    return d->httpServer.listen(localOnly ? QHostAddress(QHostAddress::LocalHost) : QHostAddress(QHostAddress::Any), port);
+  }
+
+  const quint16 RenderServer::getPort() const {
+    return d->httpServer.serverPort();
+  }
+
+  void RenderServer::exec() {
+    // the connections are started by the http server while it waits
+    while (d->httpServer.isListening())
+      d->httpServer.waitForNewConnection(-1);
+  }
+}
@@ -0,0 +1,56 @@
+#ifndef AORTRENDERSERVER_H
+#define AORTRENDERSERVER_H
+
+#include <QString>
+
+#include <OGRE/OgrePrerequisites.h>
+
+namespace Ogre {
+  class SceneManager;
+}
+
+namespace Aort {
+  class RenderJob;
+  class RenderServerPrivate;
+
+  // keeps prepared scenes in memory and renders them for http requests, so that a render does not load and
+  // preprocess its scene again:
+  //   PUT /scenes/<id>?path=<scene>&light=<x,y,z>...  loads and preprocesses a scene, replacing a scene with the id
+  //   DELETE /scenes/<id>                               releases a scene
+  //   GET /scenes                                       lists the scenes as json
+  //   GET /render/<id>?width=<pixels>&height=<pixels>&camera=<x,y,z>&target=<x,y,z>&fov=<degrees>&samples=<count>
+  //       &supersampling=<n>&exposure=<stops>&format=<png|exr|pfm>
+  //                                                     renders an image of a scene
+  // the requests are served concurrently, the cores are shared between the renders running at the same time, renders
+  // of the same scene run one after the other
+  class RenderServer {
+  public:
+    // the cameras of the renders are created by the scene manager, it is not owned
+    RenderServer(Ogre::SceneManager *sceneManager);
+    ~RenderServer();
+
+    // cores shared by the renders, the processor count by default
+    void setThreadCount(const int threads);
+    const int getThreadCount() const;
+
+    // number of scenes kept in memory, the scene used least recently is released when a scene is added beyond it
+    void setCacheSize(const int scenes);
+    const int getCacheSize() const;
+
+    // loads and preprocesses the scene of the job under the id, the camera and the image of the job are not used
+    const bool addScene(const QString &id, const RenderJob &job, QString &error);
+    // releases the scene once the renders using it have finished
+    const bool removeScene(const QString &id);
+
+    // listens on the local host only, unless other hosts are allowed
+    const bool listen(const quint16 port, const bool localOnly = true);
+    const quint16 getPort() const;
+    // serves the requests until the process is stopped
+    void exec();
+
+  private:
+    RenderServerPrivate *d;
+  };
+}
+
+#endif // AORTRENDERSERVER_H
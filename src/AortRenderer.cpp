@@ -1,11 +1,19 @@
 #include "AortRenderer.h"
 
+#include "AortFrameBuffer.h"
+#include "AortImageWriter.h"
 #include "AortLight.h"
 #include "AortMaterial.h"
+#include "AortMaterialLibrary.h"
+#include "AortMesh.h"
 #include "AortMeshParser.h"
+#include "AortSceneFile.h"
 #include "AortSceneNode.h"
+#include "AortTrace.h"
 #include "AortTriangle.h"
+#include "AortVisibilityBuffer.h"
 
+#include <QElapsedTimer>
 #include <QTime>
 
 #include <OGRE/OgreCamera.h>
@@ -16,23 +24,105 @@
 #include <OGRE/OgreSceneManager.h>
 #include <OGRE/OgreSceneNode.h>
 
+#include <string.h>
+
+#include <algorithm>
 #include <limits>
+#include <map>
+#include <set>
 
 #ifndef NO_OMP
 #include <omp.h>
 #endif // !NO_OMP
 
 #define EPSILON 0.001f
+#define RAY_COUNTER_STRIDE (64 / sizeof(size_t))
+// size of the scene subset and number of primary rays used to tune the tree options
+#define TUNE_TRIANGLE_COUNT (16384)
+#define TUNE_RAY_COUNT (4096)
+// minimum number of image rows rendered before they are passed to an image writer
+#define BAND_HEIGHT (16)
 
 namespace Aort {
+  // radical inverse of the index in the base, a low discrepancy sequence in [0, 1) that starts at 0
+  static Ogre::Real radicalInverse(Ogre::uint32 index, const Ogre::uint32 base) {
+    Ogre::Real inverseBase = 1.0f / base;
+    Ogre::Real digit = inverseBase;
+    Ogre::Real result = 0.0f;
+    while (index > 0) {
+      result += (index % base) * digit;
+      index /= base;
+      digit *= inverseBase;
+    }
+    return result;
+  }
+
+  // mixes the bits of the coordinates of a point into a seed
+  static Ogre::uint32 hashPoint(const Ogre::Vector3 &point) {
+    const float coordinates[3] = { point.x, point.y, point.z };
+    Ogre::uint32 hash = 2166136261u;
+    for (int i = 0; i < 3; ++i) {
+      Ogre::uint32 bits;
+      memcpy(&bits, &coordinates[i], sizeof(bits));
+      hash = (hash ^ bits) * 16777619u;
+    }
+    return hash;
+  }
+
+  class RayStatistics : public TraversalStatistics {
+  public:
+    RayStatistics() : primaryRayCount(0), shadowRayCount(0), reflectionRayCount(0) {
+    }
+
+    size_t primaryRayCount;
+    size_t shadowRayCount;
+    size_t reflectionRayCount;
+  };
+
+  // a mesh parsed from an entity and the placement it was parsed with, a later update reuses the mesh while the
+  // placement stays the same
+  class EntityMesh {
+  public:
+    const Ogre::Entity *entity;
+    Ogre::Vector3 position;
+    Ogre::Quaternion orientation;
+    Ogre::Vector3 scale;
+    Ogre::AxisAlignedBox bounds;
+    Mesh *mesh;
+  };
+
   class RendererPrivate {
   public:
-    RendererPrivate() : ambientColour(0.0f, 0.0f, 0.0f), backgroundColour(0.0f, 0.0f, 0.0f), maxDepth(0), rootNode(0), rayCount(0) {
+    RendererPrivate() : ambientColour(0.0f, 0.0f, 0.0f), backgroundColour(0.0f, 0.0f, 0.0f), bounds(Ogre::Vector3(0, 0, 0), Ogre::Vector3(0, 0, 0)), instanceBounds(Ogre::Vector3(0, 0, 0), Ogre::Vector3(0, 0, 0)), sceneChanged(false), sceneMoved(false), maxDepth(0), compressGeometry(false), sceneTree(0), treeAutoTune(false), renderMode(RM_COLOUR), costChannel(CC_TRIANGLES), samplesPerPixel(1), accumulate(false), exposure(0.0f), rasterizeVisibility(false) {
     }
 
     ~RendererPrivate() {
     }
 
+    void countRay() {
+      // each thread increments its own counter, counters are a cache line apart
+#ifndef NO_OMP
+      rayCounts[omp_get_thread_num() * RAY_COUNTER_STRIDE]++;
+#else
+      rayCounts[0]++;
+#endif // !NO_OMP
+    }
+
+    void resetRayCounts() {
+#ifndef NO_OMP
+      rayCounts.assign(omp_get_max_threads() * RAY_COUNTER_STRIDE, 0);
+#else
+      rayCounts.assign(1, 0);
+#endif // !NO_OMP
+    }
+
+    const size_t totalRayCount() const {
+      size_t total = 0;
+      for (size_t i = 0; i < rayCounts.size(); ++i)
+        total += rayCounts.at(i);
+      return total;
+    }
+
     void traverse(Ogre::SceneNode *root) {
       for (int i = 0; i < root->numAttachedObjects(); ++i) {
         Ogre::MovableObject *object = root->getAttachedObject(i);
@@ -42,8 +132,10 @@ namespace Aort {
         // get object if it is an entity or light
         if (object->getMovableType() == "Entity")
           entities.push_back(static_cast<Ogre::Entity *>(object));
-        else if (object->getMovableType() == "Light")
+        else if (object->getMovableType() == "Light") {
           lights.push_back(processLight(static_cast<Ogre::Light *>(object)));
+          sceneLights.push_back(lights.back());
+        }
       }
       // traverse child nodes
       for (int i = 0; i < root->numChildren(); ++i)
@@ -66,32 +158,380 @@ namespace Aort {
       return l;
     }
 
+    // runs the parse jobs of all entities and submeshes in parallel, each job writes into its own range of its mesh
+    void runParsers(const std::vector<MeshParser *> &meshParsers, const std::vector<Ogre::Entity *> &parsedEntities) {
+      std::vector<std::pair<size_t, size_t> > jobs;
+      for (size_t i = 0; i < meshParsers.size(); ++i)
+        for (size_t j = 0; j < meshParsers[i]->jobCount(); ++j)
+          jobs.push_back(std::make_pair(i, j));
+#ifndef NO_OMP
+      #pragma omp parallel for schedule(dynamic)
+#endif // !NO_OMP
+      for (int i = 0; i < int(jobs.size()); ++i) {
+        TraceSpan span("preprocess", "parse", parsedEntities.at(jobs[i].first)->getName());
+        meshParsers[jobs[i].first]->parse(jobs[i].second);
+      }
+    }
+
+    // remembers the placement of the entity the mesh was parsed from
+    EntityMesh placement(Ogre::Entity *entity, Mesh *mesh) {
+      EntityMesh entityMesh;
+      entityMesh.entity = entity;
+      entityMesh.position = entity->getParentSceneNode()->_getDerivedPosition();
+      entityMesh.orientation = entity->getParentSceneNode()->_getDerivedOrientation();
+      entityMesh.scale = entity->getParentSceneNode()->_getDerivedScale();
+      entityMesh.mesh = mesh;
+      // the ogre bounds of animated entities do not follow their pose
+      if (entity->_isAnimated()) {
+        entityMesh.bounds = Ogre::AxisAlignedBox();
+        for (size_t i = 0; i < mesh->vertexCount(); ++i)
+          entityMesh.bounds.merge(mesh->positions()[i]);
+      } else {
+        entityMesh.bounds = entity->getWorldBoundingBox(true);
+      }
+      return entityMesh;
+    }
+
+    // parses the entities into meshes, it reads ogre objects and locks hardware buffers, so it has to run on the thread
+    // of ogre
+    void parseEntities() {
+      // create mesh parsers, they lock the hardware buffers and read the materials so have to be created on this thread
+      std::vector<MeshParser *> meshParsers(entities.size());
+      for (size_t i = 0; i < meshParsers.size(); ++i) {
+        TraceSpan span("preprocess", "create mesh parser", entities.at(i)->getName());
+        meshParsers[i] = new MeshParser(entities.at(i), &materialLibrary);
+      }
+      runParsers(meshParsers, entities);
+      // take the ownership of the meshes, remember the placement of the entities and extend aabb
+      for (size_t i = 0; i < meshParsers.size(); ++i) {
+        meshes.push_back(meshParsers[i]->mesh());
+        entityMeshes.push_back(placement(entities.at(i), meshes.back()));
+        bounds.merge(entityMeshes.back().bounds);
+        // delete mesh parser instance, unlocks the buffers
+        delete meshParsers[i];
+      }
+      sceneChanged = sceneChanged || !entities.empty();
+      entities.clear();
+    }
+
+    // replaces the lights of the last extract and keeps the meshes of the entities that have not moved, the vertices
+    // of moved and animated entities are read again into their meshes, only new entities and entities whose layout
+    // changed are parsed again, returns the number of kept meshes
+    size_t updateEntities(Ogre::SceneNode *root) {
+      for (size_t i = 0; i < sceneLights.size(); ++i) {
+        lights.erase(std::find(lights.begin(), lights.end(), sceneLights.at(i)));
+        delete sceneLights.at(i);
+      }
+      sceneLights.clear();
+      {
+        TraceSpan traverseSpan("preprocess", "traverse scene");
+        traverse(root);
+      }
+      // index the entities of the last extract
+      std::map<const Ogre::Entity *, size_t> previousIndices;
+      std::vector<EntityMesh> previous;
+      previous.swap(entityMeshes);
+      for (size_t i = 0; i < previous.size(); ++i)
+        previousIndices[previous.at(i).entity] = i;
+      // keep the meshes of the entities with the same placement and pose
+      std::vector<bool> kept(previous.size(), false);
+      std::vector<Ogre::Entity *> changed;
+      std::vector<Ogre::Entity *> moved;
+      std::vector<MeshParser *> moveParsers;
+      for (size_t i = 0; i < entities.size(); ++i) {
+        Ogre::Entity *entity = entities.at(i);
+        const Ogre::SceneNode *node = entity->getParentSceneNode();
+        std::map<const Ogre::Entity *, size_t>::const_iterator it = previousIndices.find(entity);
+        if (it == previousIndices.end() || kept[it->second]) {
+          changed.push_back(entity);
+          continue;
+        }
+        const EntityMesh &entityMesh = previous.at(it->second);
+        if (!entity->_isAnimated() && entityMesh.position == node->_getDerivedPosition() && entityMesh.orientation == node->_getDerivedOrientation() && entityMesh.scale == node->_getDerivedScale()) {
+          kept[it->second] = true;
+          entityMeshes.push_back(entityMesh);
+          continue;
+        }
+        // read the vertices into the mesh again if the entity still fits it
+        MeshParser *meshParser = new MeshParser(entity, entityMesh.mesh);
+        if (meshParser->mesh()) {
+          kept[it->second] = true;
+          moved.push_back(entity);
+          moveParsers.push_back(meshParser);
+        } else {
+          delete meshParser;
+          changed.push_back(entity);
+        }
+      }
+      size_t keptCount = entityMeshes.size();
+      runParsers(moveParsers, moved);
+      for (size_t i = 0; i < moveParsers.size(); ++i) {
+        entityMeshes.push_back(placement(moved.at(i), moveParsers[i]->mesh()));
+        delete moveParsers[i];
+      }
+      sceneMoved = sceneMoved || !moved.empty();
+      // release the meshes of the entities that are gone or could not be read again, the meshes of added instances stay
+      std::set<const Mesh *> released;
+      for (size_t i = 0; i < previous.size(); ++i) {
+        if (!kept[i]) {
+          released.insert(previous.at(i).mesh);
+          delete previous.at(i).mesh;
+        }
+      }
+      if (!released.empty()) {
+        std::vector<Mesh *> remaining;
+        for (size_t i = 0; i < meshes.size(); ++i)
+          if (released.find(meshes.at(i)) == released.end())
+            remaining.push_back(meshes.at(i));
+        meshes.swap(remaining);
+        sceneChanged = true;
+      }
+      // the bounds of the kept and moved meshes, the parsed entities extend them
+      bounds = instanceBounds;
+      for (size_t i = 0; i < entityMeshes.size(); ++i)
+        bounds.merge(entityMeshes.at(i).bounds);
+      entities.swap(changed);
+      parseEntities();
+      return keptCount;
+    }
+
+    // creates instances of the added meshes, which transform the arrays of the meshes when the triangles are read
+    // instead of copying them, ogre is not used
+    void parseInstances() {
+      // the indices are checked once for each mesh before its triangles are used, meshes failing it are left out
+      std::vector<char> valid(instanceMeshes.size());
+#ifndef NO_OMP
+      #pragma omp parallel for schedule(dynamic)
+#endif // !NO_OMP
+      for (int i = 0; i < int(instanceMeshes.size()); ++i) {
+        TraceSpan span("preprocess", "check mesh");
+        valid[i] = instanceMeshes.at(i)->isValid();
+      }
+      for (size_t i = 0; i < valid.size(); ++i)
+        if (!valid.at(i))
+          Ogre::LogManager::getSingletonPtr()->logMessage("Skipping a mesh with indices out of range");
+      // extend aabb by the instances, they have no ogre bounds
+      for (size_t i = 0; i < instances.size(); ++i) {
+        const SceneInstance &instance = instances.at(i);
+        if (!valid.at(instance.mesh))
+          continue;
+        meshes.push_back(new Mesh(instanceMeshes.at(instance.mesh), instance.position, instance.orientation, instance.scale));
+        instanceBounds.merge(meshes.back()->bounds());
+      }
+      bounds.merge(instanceBounds);
+      sceneChanged = sceneChanged || !instances.empty();
+      instanceMeshes.clear();
+      instances.clear();
+    }
+
     void buildTree() {
-      Ogre::AxisAlignedBox aabb(Ogre::Vector3(0, 0, 0), Ogre::Vector3(0, 0, 0));
-      // extract triangles from all meshes
-      for (int i = 0; i < entities.size(); ++i) {
-        // extend aabb
-        aabb.merge(entities.at(i)->getWorldBoundingBox(true));
-        // extract mesh info
-        MeshParser *meshParser = new MeshParser(entities.at(i));
-        // merge mesh triangles
-        triangles.insert(triangles.end(), meshParser->triangles().begin(), meshParser->triangles().end());
-        // delete mesh parser instance
-        delete meshParser;
+      // calculate offsets of the first triangles of the meshes
+      std::vector<size_t> triangleOffsets(meshes.size() + 1, 0);
+      for (size_t i = 0; i < meshes.size(); ++i)
+        triangleOffsets[i + 1] = triangleOffsets[i] + meshes.at(i)->triangleCount();
+      // quantize vertex attributes of the meshes if requested
+      if (compressGeometry) {
+#ifndef NO_OMP
+        #pragma omp parallel for schedule(dynamic)
+#endif // !NO_OMP
+        for (int i = 0; i < int(meshes.size()); ++i) {
+          TraceSpan span("preprocess", "compress");
+          meshes.at(i)->compress();
+        }
+      }
+      // create triangles referencing the meshes
+      triangles.resize(triangleOffsets.back());
+      std::vector<Ogre::uint32> indices(triangles.size());
+#ifndef NO_OMP
+      #pragma omp parallel for schedule(dynamic)
+#endif // !NO_OMP
+      for (int i = 0; i < int(meshes.size()); ++i) {
+        TraceSpan span("preprocess", "create triangles");
+        for (Ogre::uint32 j = 0; j < meshes.at(i)->triangleCount(); ++j) {
+          triangles[triangleOffsets[i] + j] = Triangle(meshes.at(i), j);
+          indices[triangleOffsets[i] + j] = triangleOffsets[i] + j;
+        }
+      }
+      // pick the tree options for the scene
+      if (treeAutoTune && !indices.empty()) {
+        TraceSpan tuneSpan("preprocess", "tune tree");
+        treeOptions = tuneTree(bounds);
       }
       // build the scene tree
-      rootNode = new SceneNode(aabb, triangles);
+      TraceSpan treeSpan("preprocess", "build tree");
+      delete sceneTree;
+      sceneTree = new SceneTree(bounds, triangles.empty() ? 0 : &triangles[0], indices, treeOptions);
+    }
+
+    // sorts the triangles into the leaves of the tree again, returns false if the tree has to be built again
+    const bool refitTree() {
+      TraceSpan span("preprocess", "refit tree");
+      std::vector<Ogre::uint32> indices(triangles.size());
+      for (size_t i = 0; i < indices.size(); ++i)
+        indices[i] = i;
+      return sceneTree->refit(bounds, indices);
     }
 
-    Ogre::ColourValue traceRay(const Ogre::Ray &ray, int depth = 0) {
+    TreeOptions tuneTree(const Ogre::AxisAlignedBox &aabb) {
+      // take every nth triangle, the subset keeps the distribution of the scene
+      std::vector<Ogre::uint32> subset;
+      size_t stride = std::max(size_t(1), triangles.size() / TUNE_TRIANGLE_COUNT);
+      for (size_t i = 0; i < triangles.size(); i += stride)
+        subset.push_back(i);
+      // primary rays from a sphere around the scene towards random points inside it
+      Ogre::Vector3 centre = aabb.getCenter();
+      Ogre::Real radius = aabb.getHalfSize().length() * 2.0f;
+      std::vector<Ogre::Ray> rays;
+      for (int i = 0; i < TUNE_RAY_COUNT; ++i) {
+        Ogre::Vector3 origin(Ogre::Math::SymmetricRandom(), Ogre::Math::SymmetricRandom(), Ogre::Math::SymmetricRandom());
+        origin.normalise();
+        origin = centre + origin * radius;
+        Ogre::Vector3 target = aabb.getMinimum() + aabb.getSize() * Ogre::Vector3(Ogre::Math::UnitRandom(), Ogre::Math::UnitRandom(), Ogre::Math::UnitRandom());
+        rays.push_back(Ogre::Ray(origin, (target - origin).normalisedCopy()));
+      }
+      // secondary rays from the hit points, shadow rays towards the lights and scattered rays away from the surface
+      std::vector<Ogre::Ray> shadowRays;
+      std::vector<Ogre::Real> shadowLengths;
+      {
+        SceneTree tree(aabb, &triangles[0], subset, treeOptions);
+        for (int i = 0; i < TUNE_RAY_COUNT; ++i) {
+          Triangle *triangle = 0;
+          Ogre::Real t = FLT_MAX, u = 0, v = 0;
+          if (!tree.hit(rays.at(i), triangle, t, u, v))
+            continue;
+          Ogre::Vector3 P = rays.at(i).getPoint(t);
+          if (!lights.empty()) {
+            Ogre::Vector3 L = lights.at(i % lights.size())->getPosition() - P;
+            shadowLengths.push_back(L.normalise());
+            shadowRays.push_back(Ogre::Ray(P, L));
+          }
+          Ogre::Vector3 R(Ogre::Math::SymmetricRandom(), Ogre::Math::SymmetricRandom(), Ogre::Math::SymmetricRandom());
+          R.normalise();
+          if (R.dotProduct(rays.at(i).getDirection()) > 0.0f)
+            R = -R;
+          rays.push_back(Ogre::Ray(P + R * EPSILON, R));
+        }
+      }
+      // candidate options, the default options are the first candidate
+      std::vector<TreeOptions> candidates(1, treeOptions);
+      const size_t leafSizes[4] = { 1, 2, 4, 8 };
+      const Ogre::Real traversalCosts[4] = { 0.0f, 0.5f, 1.0f, 2.0f };
+      const Ogre::Real emptyBonuses[2] = { 0.0f, 0.2f };
+      for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+          for (int k = 0; k < 2; ++k) {
+            TreeOptions options = treeOptions;
+            options.minimumTrianglesPerLeaf = leafSizes[i];
+            options.traversalCost = traversalCosts[j];
+            options.intersectionCost = 1.0f;
+            options.emptyBonus = emptyBonuses[k];
+            candidates.push_back(options);
+          }
+        }
+      }
+      // a memory budget is scaled down to the subset, so that the candidates are limited like the full tree
+      size_t subsetBudget = size_t(double(treeOptions.memoryBudget) * subset.size() / triangles.size());
+      // measure the candidates, the rays are traced on this thread and the fastest of two passes is kept
+      size_t best = 0;
+      qint64 bestTime = 0;
+      for (size_t i = 0; i < candidates.size(); ++i) {
+        TreeOptions options = candidates.at(i);
+        options.memoryBudget = subsetBudget;
+        SceneTree tree(aabb, &triangles[0], subset, options);
+        qint64 time = 0;
+        for (int pass = 0; pass < 2; ++pass) {
+          QElapsedTimer timer;
+          timer.start();
+          for (size_t j = 0; j < rays.size(); ++j) {
+            Triangle *triangle = 0;
+            Ogre::Real t = FLT_MAX, u = 0, v = 0;
+            tree.hit(rays.at(j), triangle, t, u, v);
+          }
+          for (size_t j = 0; j < shadowRays.size(); ++j)
+            tree.hit(shadowRays.at(j), EPSILON, shadowLengths.at(j));
+          time = (pass == 0) ? timer.nsecsElapsed() : std::min(time, timer.nsecsElapsed());
+        }
+        if (i == 0 || time < bestTime) {
+          best = i;
+          bestTime = time;
+        }
+      }
+      const TreeOptions &options = candidates.at(best);
+      Ogre::LogManager::getSingletonPtr()->logMessage("Tuned tree options: minimum triangles per leaf " + Ogre::StringConverter::toString(options.minimumTrianglesPerLeaf) +
+                                                      ", traversal cost " + Ogre::StringConverter::toString(options.traversalCost) +
+                                                      ", empty bonus " + Ogre::StringConverter::toString(options.emptyBonus));
+      return options;
+    }
+
+    // region clipped to the image, the whole image if no region is set
+    const Ogre::Rect clipRegion(const int width, const int height) const {
+      if (region.width() <= 0 || region.height() <= 0)
+        return Ogre::Rect(0, 0, width, height);
+      Ogre::Rect clipped(std::max(region.left, 0L), std::max(region.top, 0L), std::min(region.right, long(width)), std::min(region.bottom, long(height)));
+      clipped.right = std::max(clipped.left, clipped.right);
+      clipped.bottom = std::max(clipped.top, clipped.bottom);
+      return clipped;
+    }
+
+    void writeCostImage(const int width, uchar *buffer, const Ogre::Rect &region) const {
+      // normalize the selected channel by its maximum in the region
+      float maximum = 0.0f;
+      for (long y = region.top; y < region.bottom; ++y)
+        for (long x = region.left; x < region.right; ++x)
+          maximum = std::max(maximum, costBuffer[(y * width + x) * CC_COUNT + costChannel]);
+      float scale = (maximum > 0.0f) ? 1.0f / maximum : 0.0f;
+      for (long y = region.top; y < region.bottom; ++y) {
+        for (long x = region.left; x < region.right; ++x) {
+          int i = y * width + x;
+          // blue, cyan, green, yellow, red from the cheapest to the most expensive pixel
+          Ogre::Real value = costBuffer[i * CC_COUNT + costChannel] * scale;
+          Ogre::ColourValue colour;
+          colour.r = Ogre::Math::Clamp(2.0f * value - 0.5f, 0.0f, 1.0f);
+          colour.g = Ogre::Math::Clamp(2.0f - Ogre::Math::Abs(4.0f * value - 2.0f), 0.0f, 1.0f);
+          colour.b = Ogre::Math::Clamp(1.5f - 2.0f * value, 0.0f, 1.0f);
+          // buffer is read as a 32-bit argb image, that is bgra byte order on little endian machines
+          buffer[i * 4 + 0] = colour.b * 255;
+          buffer[i * 4 + 1] = colour.g * 255;
+          buffer[i * 4 + 2] = colour.r * 255;
+          buffer[i * 4 + 3] = 255;
+        }
+      }
+    }
+
+    Ogre::ColourValue traceRay(const Ogre::Ray &ray, int depth = 0, RayStatistics *statistics = 0) {
       // trace ray using the kd-tree
       Triangle *triangle = 0;
       Ogre::Real t = FLT_MAX, u = 0, v = 0;
       // increase ray count
-      rayCount++;
+      countRay();
+      if (statistics) {
+        if (depth == 0)
+          statistics->primaryRayCount++;
+        else
+          statistics->reflectionRayCount++;
+      }
       // if nothing hit, return background color
-      if (!rootNode->hit(ray, triangle, t, u, v))
+      if (!sceneTree->hit(ray, triangle, t, u, v, 0.0f, FLT_MAX, statistics))
+        return backgroundColour;
+      return shade(ray, triangle, t, u, v, depth, statistics);
+    }
+
+    // shades the rasterized hit of a primary ray if its sample is in the visibility buffer, traces the ray otherwise
+    Ogre::ColourValue tracePrimaryRay(const Ogre::Ray &ray, const int x, const int y, const bool rasterized, RayStatistics *statistics = 0) {
+      if (!rasterizeVisibility || !rasterized)
+        return traceRay(ray, 0, statistics);
+      const VisibilitySample &sample = visibility.at(x, y);
+      if (sample.triangle == NO_TRIANGLE)
         return backgroundColour;
+      Triangle *triangle = &triangles[sample.triangle];
+      // distance of the hit point along the ray
+      Ogre::Vector3 p1 = triangle->position(0);
+      Ogre::Vector3 P = p1 + sample.u * (triangle->position(1) - p1) + sample.v * (triangle->position(2) - p1);
+      Ogre::Real t = (P - ray.getOrigin()).dotProduct(ray.getDirection());
+      return shade(ray, triangle, t, sample.u, sample.v, 0, statistics);
+    }
+
+    Ogre::ColourValue shade(const Ogre::Ray &ray, Triangle *triangle, const Ogre::Real t, const Ogre::Real u, const Ogre::Real v, int depth, RayStatistics *statistics) {
       // final colour
       Ogre::ColourValue finalColour(0.0f, 0.0f, 0.0f);
       // calculate view vector
@@ -113,9 +553,9 @@ namespace Aort {
         // calculate illumination
         Ogre::Real illumination = 0.0f;
         if (lights.at(i)->getType() == Aort::LT_POINT)
-          illumination = calculateIllumination(P, L, length);
+          illumination = calculateIllumination(P, L, length, statistics);
         else if (lights.at(i)->getType() == LT_AREA)
-          illumination = calculateIllumination(P, lights.at(i));
+          illumination = calculateIllumination(P, lights.at(i), statistics);
         // if not completely unlit
         if (illumination > std::numeric_limits<float>::epsilon()) {
           // add diffuse
@@ -126,40 +566,40 @@ namespace Aort {
       }
       // add reflections
       if (triangle->getMaterial()->getReflectivity() > std::numeric_limits<float>::epsilon() && depth < maxDepth)
-        finalColour += triangle->getMaterial()->getReflectivity() * calculateReflection(P, V, N, depth) * diffuseColour;
-      // set full opacity
-      finalColour.r = Ogre::Math::Clamp(finalColour.r, 0.0f, 1.0f);
-      finalColour.g = Ogre::Math::Clamp(finalColour.g, 0.0f, 1.0f);
-      finalColour.b = Ogre::Math::Clamp(finalColour.b, 0.0f, 1.0f);
+        finalColour += triangle->getMaterial()->getReflectivity() * calculateReflection(P, V, N, depth, statistics) * diffuseColour;
+      // set full opacity, the colour is kept linear and unclamped until it is tonemapped
       finalColour.a = 1.0f;
       // return final color
       return finalColour;
     }
 
-    Ogre::Real calculateIllumination(const Ogre::Vector3 &P, const Ogre::Vector3 &L, Ogre::Real length) {
+    Ogre::Real calculateIllumination(const Ogre::Vector3 &P, const Ogre::Vector3 &L, Ogre::Real length, RayStatistics *statistics) {
       // increase ray count
-      rayCount++;
+      countRay();
+      if (statistics)
+        statistics->shadowRayCount++;
       // check for occluders
-      if (!rootNode->hit(Ogre::Ray(P, L), EPSILON, length))
+      if (!sceneTree->hit(Ogre::Ray(P, L), EPSILON, length, statistics))
         return 1.0f;
       return 0.0f;
     }
 
-    Ogre::Real calculateIllumination(const Ogre::Vector3 &P, Light *light) {
+    Ogre::Real calculateIllumination(const Ogre::Vector3 &P, Light *light, RayStatistics *statistics) {
       Ogre::Real illumination = 0;
-      // get some control points on the light
-      const Ogre::Vector3 *points = light->getPoints();
-      // check for null
-      if (!points)
-        return 0.0f;
+      // get some control points on the light, jittered by the hit point so that the result does not depend on the
+      // thread or the order of the pixels
+      Ogre::Vector3 points[16];
+      light->getPoints(points, hashPoint(P));
       // check if visible from current point
       for (int i = 0; i < 16; ++i) {
         Ogre::Vector3 L = points[i] - P;
         Ogre::Real length = L.normalise();
         // increase ray count
-        rayCount++;
+        countRay();
+        if (statistics)
+          statistics->shadowRayCount++;
         // check for occluders
-        if (!rootNode->hit(Ogre::Ray(P, L), EPSILON, length))
+        if (!sceneTree->hit(Ogre::Ray(P, L), EPSILON, length, statistics))
           illumination += 1.0f / 16.0f;
       }
       return illumination;
@@ -181,37 +621,144 @@ namespace Aort {
       return 0;
     }
 
-    Ogre::ColourValue calculateReflection(const Ogre::Vector3 &P, const Ogre::Vector3 &V, const Ogre::Vector3 &N, int depth = 0) {
+    Ogre::ColourValue calculateReflection(const Ogre::Vector3 &P, const Ogre::Vector3 &V, const Ogre::Vector3 &N, int depth, RayStatistics *statistics) {
       // calculate reflection vector
       Ogre::Vector3 R = V - 2.0f * N.dotProduct(V) * N;
       // TODO: Implement diffuse (scattered) reflections
-      return traceRay(Ogre::Ray(P + R * EPSILON, R), depth + 1);
+      return traceRay(Ogre::Ray(P + R * EPSILON, R), depth + 1, statistics);
     }
 
     Ogre::ColourValue ambientColour;
     Ogre::ColourValue backgroundColour;
     std::vector<Ogre::Entity *> entities;
-    std::vector<Triangle *> triangles;
+    std::vector<Mesh *> meshes;
+    std::vector<Triangle> triangles;
     std::vector<Light *> lights;
+    // meshes added without ogre and their instances
+    std::vector<const Mesh *> instanceMeshes;
+    std::vector<SceneInstance> instances;
+    // bounds of the meshes, the ogre bounds of the entities
+    Ogre::AxisAlignedBox bounds;
+    Ogre::AxisAlignedBox instanceBounds;
+    // meshes of the entities in the order of the scene and the lights of the scene, replaced by an update
+    std::vector<EntityMesh> entityMeshes;
+    std::vector<Light *> sceneLights;
+    // meshes were added or released since the tree was built, or vertices of the meshes were read again
+    bool sceneChanged;
+    bool sceneMoved;
+    MaterialLibrary materialLibrary;
     size_t maxDepth;
-    SceneNode *rootNode;
-    size_t rayCount;
+    bool compressGeometry;
+    SceneTree *sceneTree;
+    TreeOptions treeOptions;
+    bool treeAutoTune;
+    std::vector<size_t> rayCounts;
+    RenderMode renderMode;
+    CostChannel costChannel;
+    // per pixel costs of the last render, CC_COUNT values per pixel
+    std::vector<float> costBuffer;
+    FrameBuffer frameBuffer;
+    Ogre::Rect region;
+    int samplesPerPixel;
+    bool accumulate;
+    Ogre::Real exposure;
+    // nearest triangles of the primary rays of a pass, used instead of tracing the rays if rasterizeVisibility is set
+    bool rasterizeVisibility;
+    VisibilityBuffer visibility;
   };
 
   Renderer::Renderer() : d(new RendererPrivate()) {
   }
 
   Renderer::~Renderer() {
+    clear();
     delete d;
   }
 
-  int Renderer::preprocess(Ogre::SceneNode *root) {
+  void Renderer::setGeometryCompression(const bool compress) {
+    d->compressGeometry = compress;
+  }
+
+  const bool Renderer::getGeometryCompression() const {
+    return d->compressGeometry;
+  }
+
+  void Renderer::setTreeOptions(const TreeOptions &options) {
+    d->treeOptions = options;
+  }
+
+  const TreeOptions &Renderer::getTreeOptions() const {
+    return d->treeOptions;
+  }
+
+  void Renderer::setTreeAutoTune(const bool autoTune) {
+    d->treeAutoTune = autoTune;
+  }
+
+  const bool Renderer::getTreeAutoTune() const {
+    return d->treeAutoTune;
+  }
+
+  void Renderer::addMesh(const Mesh *mesh, const Ogre::Vector3 &position, const Ogre::Quaternion &orientation, const Ogre::Vector3 &scale) {
+    // reuse the index of the mesh if it has already been added
+    Ogre::uint32 index = std::find(d->instanceMeshes.begin(), d->instanceMeshes.end(), mesh) - d->instanceMeshes.begin();
+    if (index == d->instanceMeshes.size())
+      d->instanceMeshes.push_back(mesh);
+    d->instances.push_back(SceneInstance(index, position, orientation, scale));
+  }
+
+  void Renderer::addLight(Light *light) {
+    d->lights.push_back(light);
+  }
+
+  int Renderer::extract(Ogre::SceneNode *root) {
     QTime time;
     time.start();
+    TraceSpan span("preprocess", "extract");
     // extract entities and lights
-    d->traverse(root);
+    {
+      TraceSpan traverseSpan("preprocess", "traverse scene");
+      d->traverse(root);
+    }
+    d->parseEntities();
+    return time.elapsed();
+  }
+
+  int Renderer::update(Ogre::SceneNode *root) {
+    QTime time;
+    time.start();
+    TraceSpan span("preprocess", "update");
+    size_t kept = d->updateEntities(root);
+    Ogre::LogManager::getSingletonPtr()->logMessage("Scene update: kept " + Ogre::StringConverter::toString(kept) + " of " + Ogre::StringConverter::toString(d->entityMeshes.size()) + " entity meshes");
+    return time.elapsed();
+  }
+
+  int Renderer::preprocess(Ogre::SceneNode *root) {
+    QTime time;
+    time.start();
+    TraceSpan span("preprocess", "preprocess");
+    if (root)
+      extract(root);
+    // keep the tree while the meshes are the same, sort the moved triangles into its leaves if only vertices moved
+    d->parseInstances();
+    if (d->sceneTree && !d->sceneChanged) {
+      if (!d->sceneMoved) {
+        Ogre::LogManager::getSingletonPtr()->logMessage("Scene unchanged, the tree is kept");
+        return time.elapsed();
+      }
+      d->sceneMoved = false;
+      if (d->refitTree()) {
+        Ogre::LogManager::getSingletonPtr()->logMessage("Scene moved, the tree is refitted");
+        return time.elapsed();
+      }
+      Ogre::LogManager::getSingletonPtr()->logMessage("Refitted tree degraded, it is built again");
+    }
     // build tree
     d->buildTree();
+    d->sceneChanged = false;
+    d->sceneMoved = false;
+    // log tree quality
+    Ogre::LogManager::getSingletonPtr()->logMessage("Scene tree:\n" + getTreeStatistics().toString());
     // return elapsed time
     return time.elapsed();
   }
@@ -219,59 +766,315 @@ namespace Aort {
   int Renderer::render(const Ogre::Camera *camera, const int width, const int height, uchar *buffer) {
     QTime time;
     time.start();
+    TraceSpan span("render", "render");
     // log message
     Ogre::LogManager::getSingletonPtr()->logMessage("Rendering...");
     // set ambient colour
     d->ambientColour = Ogre::ColourValue(0.0f, 0.0f, 0.0f);
     d->backgroundColour = Ogre::ColourValue(0.0f, 0.0f, 0.0f);
     d->maxDepth = 3;
+    // reset ray counters
+    d->resetRayCounts();
+    // only the pixels inside the region are rendered, the others keep the values of the previous render
+    Ogre::Rect region = d->clipRegion(width, height);
+    // allocate cost buffer
+    if (d->renderMode == RM_COST && d->costBuffer.size() != size_t(width * height * CC_COUNT))
+      d->costBuffer.assign(width * height * CC_COUNT, 0.0f);
+    else if (d->renderMode != RM_COST)
+      std::vector<float>().swap(d->costBuffer);
     // precalculate 1/width and 1/height
     Ogre::Real inverseWidth = 1.0f / width;
     Ogre::Real inverseHeight = 1.0f / height;
+    // keep the samples of the previous render if they are accumulated and the size has not changed
+    if (d->renderMode == RM_COLOUR && (d->frameBuffer.getWidth() != width || d->frameBuffer.getHeight() != height))
+      d->frameBuffer.resize(width, height);
+    else if (d->renderMode == RM_COLOUR && !d->accumulate)
+      d->frameBuffer.clear(region);
+    // project the triangles for the rasterized passes
+    if (d->rasterizeVisibility) {
+      TraceSpan projectSpan("render", "project triangles");
+      d->visibility.setup(camera, d->triangles.empty() ? 0 : &d->triangles[0], d->triangles.size());
+    }
+    // each pass adds one sample to the pixels in colour mode
+    int passes = (d->renderMode == RM_COLOUR) ? d->samplesPerPixel : 1;
     size_t rowsCompleted = 0;
+    for (int pass = 0; pass < passes; ++pass) {
+      // the samples of the pass are rasterized at the sample index of the first pixel, the pixels of the region only
+      // differ from it after renders of other regions, they trace their primary rays
+      Ogre::uint32 passSample = 0;
+      if (d->renderMode == RM_COLOUR && region.width() > 0 && region.height() > 0)
+        passSample = d->frameBuffer.getSampleCount(region.left, region.top);
+      if (d->rasterizeVisibility) {
+        TraceSpan rasterizeSpan("render", "rasterize");
+        d->visibility.rasterize(width, height, region, radicalInverse(passSample, 2), radicalInverse(passSample, 3));
+      }
 #ifndef NO_OMP
-    #pragma omp parallel for
+      #pragma omp parallel for
 #endif // !NO_OMP
-    // start rendering
-    for (size_t y = 0; y < height; ++y) {
-      uchar *scanline = buffer + y * width * 4;
-      for (size_t x = 0; x < width; ++x) {
-        // create camera to viewport ray
-        // and make sure that rays are not parallel to any axis
-        Ogre::Ray ray = camera->getCameraToViewportRay(x * inverseWidth + std::numeric_limits<float>::epsilon(), y * inverseHeight + std::numeric_limits<float>::epsilon());
-        // trace the ray
-        Ogre::ColourValue colour = d->traceRay(ray);
-        // update image
-        scanline[x * 4 + 0] = colour.r * 255;
-        scanline[x * 4 + 1] = colour.g * 255;
-        scanline[x * 4 + 2] = colour.b * 255;
-        scanline[x * 4 + 3] = colour.a * 255;
+      // start rendering
+      for (int y = region.top; y < region.bottom; ++y) {
+        TraceSpan scanlineSpan("render", "scanline", Trace::isEnabled() ? Ogre::StringConverter::toString(y) : Ogre::String());
+        for (int x = region.left; x < region.right; ++x) {
+          if (d->renderMode == RM_COLOUR) {
+            // place the samples of the pixel by its sample index, so that each pass continues the sequence of the
+            // previous ones, the first sample is at the corner of the pixel
+            Ogre::uint32 sample = d->frameBuffer.getSampleCount(x, y);
+            Ogre::Real sx = (x + radicalInverse(sample, 2)) * inverseWidth;
+            Ogre::Real sy = (y + radicalInverse(sample, 3)) * inverseHeight;
+            // create camera to viewport ray
+            // and make sure that rays are not parallel to any axis
+            Ogre::Ray ray = camera->getCameraToViewportRay(sx + std::numeric_limits<float>::epsilon(), sy + std::numeric_limits<float>::epsilon());
+            // trace the ray
+            d->frameBuffer.addSample(x, y, d->tracePrimaryRay(ray, x, y, sample == passSample));
+            continue;
+          }
+          // create camera to viewport ray
+          // and make sure that rays are not parallel to any axis
+          Ogre::Ray ray = camera->getCameraToViewportRay(x * inverseWidth + std::numeric_limits<float>::epsilon(), y * inverseHeight + std::numeric_limits<float>::epsilon());
+          if (d->renderMode == RM_COST) {
+            // trace the ray and record its cost, the image is coloured when all costs are known
+            RayStatistics statistics;
+            d->tracePrimaryRay(ray, x, y, true, &statistics);
+            float *cost = &d->costBuffer[(y * width + x) * CC_COUNT];
+            cost[CC_NODES] = statistics.nodeCount;
+            cost[CC_TRIANGLES] = statistics.triangleCount;
+            cost[CC_PRIMARY_RAYS] = statistics.primaryRayCount;
+            cost[CC_SHADOW_RAYS] = statistics.shadowRayCount;
+            cost[CC_REFLECTION_RAYS] = statistics.reflectionRayCount;
+          }
+        }
+        // increase row count
+        rowsCompleted++;
+        // log message
+        Ogre::LogManager::getSingletonPtr()->logMessage("Progress: " + Ogre::StringConverter::toString(int(rowsCompleted * 100 / (region.height() * passes)), 3) + "%");
       }
-      // increase row count
-      rowsCompleted++;
-      // log message
-      Ogre::LogManager::getSingletonPtr()->logMessage("Progress: " + Ogre::StringConverter::toString(int(rowsCompleted * inverseHeight * 100), 3) + "%");
+    }
+    // quantize the colours, or colour the cost image
+    if (d->renderMode == RM_COLOUR) {
+      TraceSpan tonemapSpan("render", "tonemap");
+      d->frameBuffer.tonemap(buffer, d->exposure, region);
+    } else if (d->renderMode == RM_COST) {
+      TraceSpan costSpan("render", "cost image");
+      d->writeCostImage(width, buffer, region);
     }
     Ogre::LogManager::getSingletonPtr()->logMessage("Finished.");
     Ogre::LogManager::getSingletonPtr()->logMessage("Number of triangles: " + Ogre::StringConverter::toString(d->triangles.size()));
-    Ogre::LogManager::getSingletonPtr()->logMessage("Number of rays: " + Ogre::StringConverter::toString(d->rayCount));
-    Ogre::LogManager::getSingletonPtr()->logMessage("Number of ray triangle intersections: " + Ogre::StringConverter::toString(d->rootNode->intersectionCount));
-    // delete rootNode
-    delete d->rootNode;
-    d->rootNode = 0;
-    // reset ray count
-    d->rayCount = 0;
+    size_t meshMemory = 0;
+    for (size_t i = 0; i < d->meshes.size(); ++i)
+      meshMemory += d->meshes.at(i)->memoryUsage();
+    Ogre::LogManager::getSingletonPtr()->logMessage("Mesh memory usage: " + Ogre::StringConverter::toString(meshMemory) + " bytes");
+    Ogre::LogManager::getSingletonPtr()->logMessage("Number of materials: " + Ogre::StringConverter::toString(d->materialLibrary.materialCount()));
+    Ogre::LogManager::getSingletonPtr()->logMessage("Number of images: " + Ogre::StringConverter::toString(d->materialLibrary.imageCount()));
+    Ogre::LogManager::getSingletonPtr()->logMessage("Number of rays: " + Ogre::StringConverter::toString(d->totalRayCount()));
+    Ogre::LogManager::getSingletonPtr()->logMessage("Number of ray triangle intersections: " + Ogre::StringConverter::toString(SceneNode::intersectionCount));
+    // return elapsed time
+    return time.elapsed();
+  }
+
+  int Renderer::render(const Ogre::Camera *camera, const int width, const int height, ImageWriter *writer, const int supersampling) {
+    QTime time;
+    time.start();
+    TraceSpan span("render", "render");
+    Ogre::LogManager::getSingletonPtr()->logMessage("Rendering...");
+    d->ambientColour = Ogre::ColourValue(0.0f, 0.0f, 0.0f);
+    d->backgroundColour = Ogre::ColourValue(0.0f, 0.0f, 0.0f);
+    d->maxDepth = 3;
+    d->resetRayCounts();
+    // the writer receives the region only, its pixels keep the camera rays of the whole image
+    Ogre::Rect region = d->clipRegion(width, height);
+    // a region outside the image has no pixels to write
+    if (region.width() <= 0 || region.height() <= 0)
+      return -1;
+    if (!writer->begin(region.width(), region.height()))
+      return -1;
+    // the samples of an output pixel are spread over a regular grid of supersampling by supersampling cells
+    int cells = std::max(1, supersampling);
+    Ogre::Real inverseWidth = 1.0f / (width * cells);
+    Ogre::Real inverseHeight = 1.0f / (height * cells);
+    Ogre::Real inverseSampleCount = 1.0f / (cells * cells * d->samplesPerPixel);
+    // bands are high enough to keep all threads busy
+    int bandHeight = BAND_HEIGHT;
+#ifndef NO_OMP
+    bandHeight = std::max(bandHeight, omp_get_max_threads() * 4);
+#endif // !NO_OMP
+    std::vector<float> band(bandHeight * region.width() * 4);
+    // project the triangles for the rasterized passes
+    if (d->rasterizeVisibility) {
+      TraceSpan projectSpan("render", "project triangles");
+      d->visibility.setup(camera, d->triangles.empty() ? 0 : &d->triangles[0], d->triangles.size());
+    }
+    for (int top = region.top; top < region.bottom; top += bandHeight) {
+      TraceSpan bandSpan("render", "band", Trace::isEnabled() ? Ogre::StringConverter::toString(top) : Ogre::String());
+      int rows = std::min(bandHeight, int(region.bottom) - top);
+      std::fill(band.begin(), band.begin() + rows * region.width() * 4, 0.0f);
+      // each pass takes one sample in every cell of the band, the cells are rasterized as one grid
+      for (int i = 0; i < d->samplesPerPixel; ++i) {
+        if (d->rasterizeVisibility) {
+          TraceSpan rasterizeSpan("render", "rasterize");
+          d->visibility.rasterize(width * cells, height * cells, Ogre::Rect(region.left * cells, top * cells, region.right * cells, (top + rows) * cells), radicalInverse(i, 2), radicalInverse(i, 3));
+        }
+#ifndef NO_OMP
+        #pragma omp parallel for schedule(dynamic)
+#endif // !NO_OMP
+        for (int y = top; y < top + rows; ++y) {
+          float *row = &band[(y - top) * region.width() * 4];
+          for (int x = region.left; x < region.right; ++x) {
+            Ogre::ColourValue colour(0.0f, 0.0f, 0.0f, 0.0f);
+            for (int cy = 0; cy < cells; ++cy) {
+              for (int cx = 0; cx < cells; ++cx) {
+                // create camera to viewport ray
+                // and make sure that rays are not parallel to any axis
+                Ogre::Real sx = (x * cells + cx + radicalInverse(i, 2)) * inverseWidth;
+                Ogre::Real sy = (y * cells + cy + radicalInverse(i, 3)) * inverseHeight;
+                Ogre::Ray ray = camera->getCameraToViewportRay(sx + std::numeric_limits<float>::epsilon(), sy + std::numeric_limits<float>::epsilon());
+                colour += d->tracePrimaryRay(ray, x * cells + cx, y * cells + cy, true);
+              }
+            }
+            row[(x - region.left) * 4 + 0] += colour.r;
+            row[(x - region.left) * 4 + 1] += colour.g;
+            row[(x - region.left) * 4 + 2] += colour.b;
+            row[(x - region.left) * 4 + 3] += colour.a;
+          }
+        }
+      }
+      for (int j = 0; j < rows * region.width() * 4; ++j)
+        band[j] *= inverseSampleCount;
+      // pass the finished rows on, they are overwritten by the next band
+      if (!writer->write(top - region.top, rows, &band[0])) {
+        writer->end();
+        Ogre::LogManager::getSingletonPtr()->logMessage("Could not write the image.");
+        return -1;
+      }
+      Ogre::LogManager::getSingletonPtr()->logMessage("Progress: " + Ogre::StringConverter::toString(int((top + rows - region.top) * 100 / region.height()), 3) + "%");
+    }
+    if (!writer->end()) {
+      Ogre::LogManager::getSingletonPtr()->logMessage("Could not write the image.");
+      return -1;
+    }
+    Ogre::LogManager::getSingletonPtr()->logMessage("Finished.");
+    Ogre::LogManager::getSingletonPtr()->logMessage("Number of rays: " + Ogre::StringConverter::toString(d->totalRayCount()));
+    return time.elapsed();
+  }
+
+  void Renderer::clear() {
+    // delete the scene tree
+    delete d->sceneTree;
+    d->sceneTree = 0;
     // delete triangles
-    for (int i = 0; i < d->triangles.size(); ++i)
-      delete d->triangles.at(i);
-    d->triangles.clear();
+    std::vector<Triangle>().swap(d->triangles);
+    // delete meshes
+    for (int i = 0; i < d->meshes.size(); ++i)
+      delete d->meshes.at(i);
+    d->meshes.clear();
     // delete lights
     for (int i = 0; i < d->lights.size(); ++i)
       delete d->lights.at(i);
     d->lights.clear();
-    // clean up entities
+    d->sceneLights.clear();
+    // delete materials, textures and images
+    d->materialLibrary.clear();
+    // clean up entities and added meshes
     d->entities.clear();
-    // return elapsed time
-    return time.elapsed();
+    d->instanceMeshes.clear();
+    d->instances.clear();
+    d->entityMeshes.clear();
+    d->bounds = Ogre::AxisAlignedBox(Ogre::Vector3(0, 0, 0), Ogre::Vector3(0, 0, 0));
+    d->instanceBounds = d->bounds;
+    d->sceneChanged = false;
+    d->sceneMoved = false;
+  }
+
+  void Renderer::setRenderMode(const RenderMode &mode) {
+    d->renderMode = mode;
+  }
+
+  const RenderMode &Renderer::getRenderMode() const {
+    return d->renderMode;
+  }
+
+  void Renderer::setCostChannel(const CostChannel &channel) {
+    d->costChannel = channel;
+  }
+
+  const CostChannel &Renderer::getCostChannel() const {
+    return d->costChannel;
+  }
+
+  void Renderer::setRegion(const Ogre::Rect &region) {
+    d->region = region;
+  }
+
+  const Ogre::Rect &Renderer::getRegion() const {
+    return d->region;
+  }
+
+  void Renderer::setSamplesPerPixel(const int samples) {
+    d->samplesPerPixel = std::max(1, samples);
+  }
+
+  const int Renderer::getSamplesPerPixel() const {
+    return d->samplesPerPixel;
+  }
+
+  void Renderer::setAccumulation(const bool accumulate) {
+    d->accumulate = accumulate;
+  }
+
+  const bool Renderer::getAccumulation() const {
+    return d->accumulate;
+  }
+
+  void Renderer::setExposure(const Ogre::Real exposure) {
+    d->exposure = exposure;
+  }
+
+  const Ogre::Real Renderer::getExposure() const {
+    return d->exposure;
+  }
+
+  void Renderer::setRasterizedVisibility(const bool rasterize) {
+    d->rasterizeVisibility = rasterize;
+  }
+
+  const bool Renderer::getRasterizedVisibility() const {
+    return d->rasterizeVisibility;
+  }
+
+  const FrameBuffer &Renderer::getFrameBuffer() const {
+    return d->frameBuffer;
+  }
+
+  const float *Renderer::getCostBuffer() const {
+    if (d->costBuffer.empty())
+      return 0;
+    return &d->costBuffer[0];
+  }
+
+  const size_t Renderer::getTriangleCount() const {
+    return d->triangles.size();
+  }
+
+  const size_t Renderer::getLightCount() const {
+    return d->lights.size();
+  }
+
+  const size_t Renderer::getRayCount() const {
+    return d->totalRayCount();
+  }
+
+  const size_t Renderer::getMemoryUsage() const {
+    size_t memoryUsage = d->triangles.capacity() * sizeof(Triangle);
+    for (size_t i = 0; i < d->meshes.size(); ++i)
+      memoryUsage += d->meshes.at(i)->memoryUsage();
+    if (d->sceneTree)
+      memoryUsage += d->sceneTree->memoryUsage();
+    memoryUsage += d->visibility.memoryUsage();
+    return memoryUsage;
+  }
+
+  const TreeStatistics Renderer::getTreeStatistics() const {
+    if (!d->sceneTree)
+      return TreeStatistics();
+    return d->sceneTree->statistics();
   }
 }
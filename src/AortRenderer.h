@@ -3,12 +3,41 @@
 
 #include <QObject>
 
+#include <OGRE/OgreCommon.h>
+#include <OGRE/OgrePrerequisites.h>
+
+#include <stddef.h>
+
 namespace Ogre {
   class Camera;
+  class Quaternion;
   class SceneNode;
+  class Vector3;
 }
 
 namespace Aort {
+  class FrameBuffer;
+  class ImageWriter;
+  class Light;
+  class Mesh;
+  class TreeOptions;
+  class TreeStatistics;
+
+  enum RenderMode {
+    RM_COLOUR,
+    RM_COST
+  };
+
+  // per pixel values recorded in the cost render mode
+  enum CostChannel {
+    CC_NODES,
+    CC_TRIANGLES,
+    CC_PRIMARY_RAYS,
+    CC_SHADOW_RAYS,
+    CC_REFLECTION_RAYS,
+    CC_COUNT
+  };
+
   class RendererPrivate;
 
   class Renderer {
@@ -16,8 +45,93 @@ namespace Aort {
     Renderer();
     ~Renderer();
 
+    // cost mode renders a false colour image of the selected channel instead of the scene
+    void setRenderMode(const RenderMode &mode);
+    const RenderMode &getRenderMode() const;
+
+    void setCostChannel(const CostChannel &channel);
+    const CostChannel &getCostChannel() const;
+
+    // limits the renders to a region of the image in pixels, right and bottom are exclusive, an empty region renders
+    // the whole image, the pixels keep the camera rays they have in the whole image
+    // rendering into a buffer updates the region of the buffer only, rendering into a writer writes the region as the image
+    void setRegion(const Ogre::Rect &region);
+    const Ogre::Rect &getRegion() const;
+
+    // samples traced per pixel by each render in colour mode
+    void setSamplesPerPixel(const int samples);
+    const int getSamplesPerPixel() const;
+
+    // adds the samples of the next render to the frame buffer of the previous one instead of starting over,
+    // for progressive rendering, the frame buffer is restarted if the size changes
+    void setAccumulation(const bool accumulate);
+    const bool getAccumulation() const;
+
+    // exposure in stops applied when the frame buffer is tonemapped into the render buffer
+    void setExposure(const Ogre::Real exposure);
+    const Ogre::Real getExposure() const;
+
+    // finds the nearest triangles of the primary rays by rasterizing the scene on the cpu instead of tracing the rays,
+    // shading starts from the rasterized hits and only shadows and reflections are traced, the ray count leaves out
+    // the rasterized rays, the projected triangles in view (about 96 bytes each) are kept for the whole render on top
+    // of the samples of the band being rasterized
+    void setRasterizedVisibility(const bool rasterize);
+    const bool getRasterizedVisibility() const;
+
+    // linear colours of the renders in colour mode, can be tonemapped again with another exposure or written as hdr
+    const FrameBuffer &getFrameBuffer() const;
+
+    // costs of the last render in cost mode, CC_COUNT floats per pixel in row order, 0 otherwise
+    const float *getCostBuffer() const;
+
+    // stores vertex attributes of the scene quantized, must be set before preprocess, see Mesh::compress for the
+    // precision, only the vertices shrink, the triangles of the scene (16 bytes each on 64-bit systems), the indices
+    // of the meshes and the triangle references of the tree keep their size, so this mode does not reduce the memory
+    // per triangle which dominates dense meshes
+    void setGeometryCompression(const bool compress);
+    const bool getGeometryCompression() const;
+
+    // parameters of the scene tree, must be set before preprocess
+    void setTreeOptions(const TreeOptions &options);
+    const TreeOptions &getTreeOptions() const;
+
+    // tunes the tree options for the scene during preprocess by building trees of a subset of the scene
+    // with candidate options and picking the one tracing sample rays fastest, the maximum depth is kept
+    void setTreeAutoTune(const bool autoTune);
+    const bool getTreeAutoTune() const;
+
+    // adds an instance of a mesh, the mesh is not owned and has to be alive until clear
+    void addMesh(const Mesh *mesh, const Ogre::Vector3 &position, const Ogre::Quaternion &orientation, const Ogre::Vector3 &scale);
+    // adds a light, the light is owned by the renderer
+    void addLight(Light *light);
+
+    // copies the entities and lights under root into the renderer, it reads ogre objects and hardware buffers, so it
+    // has to be called on the thread of ogre, preprocess can run on another thread afterwards with a root of 0
+    int extract(Ogre::SceneNode *root);
+    // replaces the entities and lights of the last extract or update by those under root for the next frame of a
+    // sequence, the meshes of entities that have not moved are kept, the vertices of moved and animated entities are
+    // read again into their meshes and only new entities are parsed, it has to be called on the thread of ogre like
+    // extract, changed materials are not detected
+    int update(Ogre::SceneNode *root);
+    // builds the scene from the entities and lights under root and the added meshes and lights, root can be 0, the
+    // tree of the last preprocess is kept if no mesh was added or released since, it is refitted if only vertices
+    // moved and built again if the refit degrades it
     int preprocess(Ogre::SceneNode *root);
     int render(const Ogre::Camera *camera, const int width, const int height, uchar *buffer);
+    // renders the image in bands of rows and passes each finished band to the writer, so that only one band is kept
+    // in memory, each pixel averages the samples of a grid of supersampling by supersampling cells, the render mode
+    // and the frame buffer are not used, with rasterized visibility the projected triangles of the whole view are kept
+    // besides the band, returns -1 if the region has no pixels inside the image or the writer fails
+    int render(const Ogre::Camera *camera, const int width, const int height, ImageWriter *writer, const int supersampling = 1);
+    // releases the scene data created by preprocess
+    void clear();
+
+    const size_t getTriangleCount() const;
+    const size_t getLightCount() const;
+    const size_t getRayCount() const;
+    const size_t getMemoryUsage() const;
+    // quality report of the tree built by preprocess
+    const TreeStatistics getTreeStatistics() const;
 
   private:
     RendererPrivate *d;
@@ -0,0 +1,366 @@
+#include "AortSceneFile.h"
+
+#include "AortMaterial.h"
+#include "AortMesh.h"
+#include "AortTexture.h"
+
+#include <QFile>
+#include <QTemporaryFile>
+
+#include <algorithm>
+#include <map>
+
+#define SCENE_FILE_VERSION (1)
+#define SCENE_FILE_ALIGNMENT (16)
+
+namespace Aort {
+  // records are written in native byte order, arrays are aligned so they can be used directly from the mapped file
+  class FileHeader {
+  public:
+    char magic[4];
+    quint32 version;
+    quint32 materialCount;
+    quint32 meshCount;
+    quint32 instanceCount;
+    quint32 reserved;
+    quint64 materialsOffset;
+    quint64 meshesOffset;
+    quint64 instancesOffset;
+  };
+
+  class FileMaterial {
+  public:
+    char name[256];
+    char texture[256];
+    float ambient[4];
+    float diffuse[4];
+    float specular[4];
+    float shininess;
+    float reflectivity;
+    quint32 filter;
+    quint32 anisotropy;
+  };
+
+  class FileMesh {
+  public:
+    quint64 vertexCount;
+    quint64 triangleCount;
+    quint64 materialCount;
+    quint64 positionsOffset;
+    quint64 normalsOffset;
+    quint64 texCoordsOffset;
+    quint64 indicesOffset;
+    quint64 materialIndicesOffset;
+    quint64 materialsOffset;
+  };
+
+  class FileInstance {
+  public:
+    quint32 mesh;
+    float position[3];
+    float orientation[4];
+    float scale[3];
+  };
+
+  quint64 align(quint64 offset) {
+    return (offset + SCENE_FILE_ALIGNMENT - 1) & ~quint64(SCENE_FILE_ALIGNMENT - 1);
+  }
+
+  void copyString(char *destination, const Ogre::String &source, size_t size) {
+    memset(destination, 0, size);
+    source.copy(destination, size - 1);
+  }
+
+  void copyColour(float *destination, const Ogre::ColourValue &colour) {
+    destination[0] = colour.r;
+    destination[1] = colour.g;
+    destination[2] = colour.b;
+    destination[3] = colour.a;
+  }
+
+  SceneMaterial::SceneMaterial() : ambient(1.0f, 1.0f, 1.0f), diffuse(1.0f, 1.0f, 1.0f), specular(0.0f, 0.0f, 0.0f), shininess(0.0f), reflectivity(0.0f), filter(Ogre::FO_LINEAR), anisotropy(1) {
+  }
+
+  SceneMaterial::SceneMaterial(Material *material) : name(material->getName()), ambient(material->getAmbient()), diffuse(material->getDiffuse()), specular(material->getSpecular()),
+    shininess(material->getShininess()), reflectivity(material->getReflectivity()), filter(Ogre::FO_LINEAR), anisotropy(1) {
+    if (material->getTexture()) {
+      texture = material->getTexture()->getName();
+      filter = material->getTexture()->getFilter();
+      anisotropy = material->getTexture()->getAnisotropy();
+    }
+  }
+
+  SceneInstance::SceneInstance() : mesh(0), position(Ogre::Vector3::ZERO), orientation(Ogre::Quaternion::IDENTITY), scale(Ogre::Vector3::UNIT_SCALE) {
+  }
+
+  SceneInstance::SceneInstance(const Ogre::uint32 mesh, const Ogre::Vector3 &position, const Ogre::Quaternion &orientation, const Ogre::Vector3 &scale) : mesh(mesh), position(position), orientation(orientation), scale(scale) {
+  }
+
+  class SceneFilePrivate {
+  public:
+    SceneFilePrivate() : data(0), header(0) {
+    }
+
+    ~SceneFilePrivate() {
+    }
+
+    const FileMaterial *materials() const {
+      return reinterpret_cast<const FileMaterial *>(data + header->materialsOffset);
+    }
+
+    const FileMesh *meshes() const {
+      return reinterpret_cast<const FileMesh *>(data + header->meshesOffset);
+    }
+
+    const FileInstance *instances() const {
+      return reinterpret_cast<const FileInstance *>(data + header->instancesOffset);
+    }
+
+    // checks that the array lies inside the file at the alignment it is written with, without overflowing on the
+    // offsets and counts read from the file
+    const bool validate(const quint64 offset, const quint64 count, const quint64 elementSize) const {
+      quint64 fileSize = file.size();
+      return offset % SCENE_FILE_ALIGNMENT == 0 && offset <= fileSize && count <= (fileSize - offset) / elementSize;
+    }
+
+    // checks that the materials of the mesh are distinct scene materials, as the mesh keeps each material once, the
+    // per triangle indices are not read here but checked by Mesh::isValid before the triangles are used
+    const bool validateMaterials(const FileMesh &fileMesh) const {
+      const quint32 *materials = reinterpret_cast<const quint32 *>(data + fileMesh.materialsOffset);
+      std::vector<quint32> sorted(materials, materials + fileMesh.materialCount);
+      std::sort(sorted.begin(), sorted.end());
+      if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end())
+        return false;
+      return sorted.empty() || sorted.back() < header->materialCount;
+    }
+
+    QFile file;
+    uchar *data;
+    const FileHeader *header;
+  };
+
+  SceneFile::SceneFile() : d(new SceneFilePrivate()) {
+  }
+
+  SceneFile::~SceneFile() {
+    close();
+    delete d;
+  }
+
+  const bool SceneFile::write(const Ogre::String &path, const std::vector<Mesh *> &meshes, const std::vector<SceneInstance> &instances) {
+    // the meshes may be mapped from the file at the path, truncating it would pull the data from under them
+    QString target = QString::fromStdString(path);
+    QTemporaryFile file(target + ".XXXXXX");
+    file.setAutoRemove(false);
+    if (!file.open())
+      return false;
+    // collect materials of all meshes
+    std::vector<Material *> materials;
+    std::map<Material *, quint32> materialIndices;
+    for (size_t i = 0; i < meshes.size(); ++i) {
+      for (size_t j = 0; j < meshes.at(i)->materials().size(); ++j) {
+        Material *material = meshes.at(i)->materials().at(j);
+        if (materialIndices.find(material) == materialIndices.end()) {
+          materialIndices[material] = materials.size();
+          materials.push_back(material);
+        }
+      }
+    }
+    // calculate layout of the records
+    FileHeader header;
+    memcpy(header.magic, "AORT", 4);
+    header.version = SCENE_FILE_VERSION;
+    header.materialCount = materials.size();
+    header.meshCount = meshes.size();
+    header.instanceCount = instances.size();
+    header.reserved = 0;
+    header.materialsOffset = align(sizeof(FileHeader));
+    header.meshesOffset = align(header.materialsOffset + materials.size() * sizeof(FileMaterial));
+    header.instancesOffset = align(header.meshesOffset + meshes.size() * sizeof(FileMesh));
+    // calculate layout of the mesh arrays
+    quint64 offset = align(header.instancesOffset + instances.size() * sizeof(FileInstance));
+    std::vector<FileMesh> fileMeshes(meshes.size());
+    for (size_t i = 0; i < meshes.size(); ++i) {
+      FileMesh &fileMesh = fileMeshes[i];
+      fileMesh.vertexCount = meshes.at(i)->vertexCount();
+      fileMesh.triangleCount = meshes.at(i)->triangleCount();
+      fileMesh.materialCount = meshes.at(i)->materials().size();
+      fileMesh.positionsOffset = offset;
+      offset = align(offset + fileMesh.vertexCount * sizeof(Ogre::Vector3));
+      fileMesh.normalsOffset = offset;
+      offset = align(offset + fileMesh.vertexCount * sizeof(Ogre::Vector3));
+      fileMesh.texCoordsOffset = offset;
+      offset = align(offset + fileMesh.vertexCount * sizeof(Ogre::Vector2));
+      fileMesh.indicesOffset = offset;
+      offset = align(offset + fileMesh.triangleCount * 3 * sizeof(Ogre::uint32));
+      fileMesh.materialIndicesOffset = offset;
+      offset = align(offset + fileMesh.triangleCount * sizeof(Ogre::uint16));
+      fileMesh.materialsOffset = offset;
+      offset = align(offset + fileMesh.materialCount * sizeof(quint32));
+    }
+    // write header
+    bool result = file.write(reinterpret_cast<const char *>(&header), sizeof(FileHeader)) == sizeof(FileHeader);
+    // write materials
+    result = result && file.seek(header.materialsOffset);
+    for (size_t i = 0; i < materials.size() && result; ++i) {
+      SceneMaterial material(materials.at(i));
+      FileMaterial fileMaterial;
+      copyString(fileMaterial.name, material.name, sizeof(fileMaterial.name));
+      copyString(fileMaterial.texture, material.texture, sizeof(fileMaterial.texture));
+      copyColour(fileMaterial.ambient, material.ambient);
+      copyColour(fileMaterial.diffuse, material.diffuse);
+      copyColour(fileMaterial.specular, material.specular);
+      fileMaterial.shininess = material.shininess;
+      fileMaterial.reflectivity = material.reflectivity;
+      fileMaterial.filter = material.filter;
+      fileMaterial.anisotropy = material.anisotropy;
+      result = file.write(reinterpret_cast<const char *>(&fileMaterial), sizeof(FileMaterial)) == sizeof(FileMaterial);
+    }
+    // write meshes
+    result = result && file.seek(header.meshesOffset);
+    if (result && fileMeshes.size())
+      result = file.write(reinterpret_cast<const char *>(&fileMeshes[0]), fileMeshes.size() * sizeof(FileMesh)) == qint64(fileMeshes.size() * sizeof(FileMesh));
+    // write instances
+    result = result && file.seek(header.instancesOffset);
+    for (size_t i = 0; i < instances.size() && result; ++i) {
+      FileInstance fileInstance;
+      fileInstance.mesh = instances.at(i).mesh;
+      for (int j = 0; j < 3; ++j) {
+        fileInstance.position[j] = instances.at(i).position[j];
+        fileInstance.scale[j] = instances.at(i).scale[j];
+      }
+      fileInstance.orientation[0] = instances.at(i).orientation.w;
+      fileInstance.orientation[1] = instances.at(i).orientation.x;
+      fileInstance.orientation[2] = instances.at(i).orientation.y;
+      fileInstance.orientation[3] = instances.at(i).orientation.z;
+      result = file.write(reinterpret_cast<const char *>(&fileInstance), sizeof(FileInstance)) == sizeof(FileInstance);
+    }
+    // write mesh arrays
+    for (size_t i = 0; i < meshes.size() && result; ++i) {
+      const Mesh *mesh = meshes.at(i);
+      const FileMesh &fileMesh = fileMeshes.at(i);
+      // translate mesh material indices into file material indices
+      std::vector<quint32> meshMaterials(fileMesh.materialCount);
+      for (size_t j = 0; j < meshMaterials.size(); ++j)
+        meshMaterials[j] = materialIndices[mesh->materials().at(j)];
+      result = file.seek(fileMesh.positionsOffset) && file.write(reinterpret_cast<const char *>(mesh->positions()), fileMesh.vertexCount * sizeof(Ogre::Vector3)) == qint64(fileMesh.vertexCount * sizeof(Ogre::Vector3));
+      result = result && file.seek(fileMesh.normalsOffset) && file.write(reinterpret_cast<const char *>(mesh->normals()), fileMesh.vertexCount * sizeof(Ogre::Vector3)) == qint64(fileMesh.vertexCount * sizeof(Ogre::Vector3));
+      result = result && file.seek(fileMesh.texCoordsOffset) && file.write(reinterpret_cast<const char *>(mesh->texCoords()), fileMesh.vertexCount * sizeof(Ogre::Vector2)) == qint64(fileMesh.vertexCount * sizeof(Ogre::Vector2));
+      result = result && file.seek(fileMesh.indicesOffset) && file.write(reinterpret_cast<const char *>(mesh->indices()), fileMesh.triangleCount * 3 * sizeof(Ogre::uint32)) == qint64(fileMesh.triangleCount * 3 * sizeof(Ogre::uint32));
+      result = result && file.seek(fileMesh.materialIndicesOffset) && file.write(reinterpret_cast<const char *>(mesh->materialIndices()), fileMesh.triangleCount * sizeof(Ogre::uint16)) == qint64(fileMesh.triangleCount * sizeof(Ogre::uint16));
+      if (result && meshMaterials.size())
+        result = file.seek(fileMesh.materialsOffset) && file.write(reinterpret_cast<const char *>(&meshMaterials[0]), meshMaterials.size() * sizeof(quint32)) == qint64(meshMaterials.size() * sizeof(quint32));
+    }
+    // pad the file up to the end of the last array
+    result = result && file.resize(offset);
+    // temporary files are private, scene files are read by the render workers
+    result = result && file.setPermissions(QFile::ReadOwner | QFile::WriteOwner | QFile::ReadGroup | QFile::ReadOther);
+    // close file
+    file.close();
+    // replace the target, removing it only unlinks it, so an existing mapping keeps the old data
+    if (result && QFile::exists(target))
+      result = QFile::remove(target);
+    result = result && QFile::rename(file.fileName(), target);
+    // remove incomplete file
+    if (!result)
+      file.remove();
+    return result;
+  }
+
+  const bool SceneFile::open(const Ogre::String &path) {
+    close();
+    // open and map the file, geometry is paged in by the os when accessed
+    d->file.setFileName(QString::fromStdString(path));
+    if (!d->file.open(QIODevice::ReadOnly))
+      return false;
+    d->data = d->file.map(0, d->file.size());
+    if (!d->data || !d->validate(0, 1, sizeof(FileHeader))) {
+      close();
+      return false;
+    }
+    d->header = reinterpret_cast<const FileHeader *>(d->data);
+    // check header
+    if (memcmp(d->header->magic, "AORT", 4) != 0 || d->header->version != SCENE_FILE_VERSION ||
+        !d->validate(d->header->materialsOffset, d->header->materialCount, sizeof(FileMaterial)) ||
+        !d->validate(d->header->meshesOffset, d->header->meshCount, sizeof(FileMesh)) ||
+        !d->validate(d->header->instancesOffset, d->header->instanceCount, sizeof(FileInstance))) {
+      close();
+      return false;
+    }
+    // check that the mesh arrays lie inside the file, the arrays themselves are not read
+    for (size_t i = 0; i < d->header->meshCount; ++i) {
+      const FileMesh &fileMesh = d->meshes()[i];
+      if (!d->validate(fileMesh.positionsOffset, fileMesh.vertexCount, sizeof(Ogre::Vector3)) ||
+          !d->validate(fileMesh.normalsOffset, fileMesh.vertexCount, sizeof(Ogre::Vector3)) ||
+          !d->validate(fileMesh.texCoordsOffset, fileMesh.vertexCount, sizeof(Ogre::Vector2)) ||
+          !d->validate(fileMesh.indicesOffset, fileMesh.triangleCount, 3 * sizeof(Ogre::uint32)) ||
+          !d->validate(fileMesh.materialIndicesOffset, fileMesh.triangleCount, sizeof(Ogre::uint16)) ||
+          !d->validate(fileMesh.materialsOffset, fileMesh.materialCount, sizeof(quint32)) ||
+          !d->validateMaterials(fileMesh)) {
+        close();
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void SceneFile::close() {
+    if (d->data)
+      d->file.unmap(d->data);
+    d->file.close();
+    d->data = 0;
+    d->header = 0;
+  }
+
+  const size_t SceneFile::materialCount() const {
+    return d->header ? d->header->materialCount : 0;
+  }
+
+  const SceneMaterial SceneFile::material(const size_t i) const {
+    const FileMaterial &fileMaterial = d->materials()[i];
+    SceneMaterial material;
+    material.name = Ogre::String(fileMaterial.name, strnlen(fileMaterial.name, sizeof(fileMaterial.name)));
+    material.texture = Ogre::String(fileMaterial.texture, strnlen(fileMaterial.texture, sizeof(fileMaterial.texture)));
+    material.ambient = Ogre::ColourValue(fileMaterial.ambient[0], fileMaterial.ambient[1], fileMaterial.ambient[2], fileMaterial.ambient[3]);
+    material.diffuse = Ogre::ColourValue(fileMaterial.diffuse[0], fileMaterial.diffuse[1], fileMaterial.diffuse[2], fileMaterial.diffuse[3]);
+    material.specular = Ogre::ColourValue(fileMaterial.specular[0], fileMaterial.specular[1], fileMaterial.specular[2], fileMaterial.specular[3]);
+    material.shininess = fileMaterial.shininess;
+    material.reflectivity = fileMaterial.reflectivity;
+    material.filter = Ogre::FilterOptions(fileMaterial.filter);
+    material.anisotropy = fileMaterial.anisotropy;
+    return material;
+  }
+
+  const size_t SceneFile::meshCount() const {
+    return d->header ? d->header->meshCount : 0;
+  }
+
+  Mesh *SceneFile::createMesh(const size_t i) const {
+    const FileMesh &fileMesh = d->meshes()[i];
+    // create a view to the read only mapped arrays, the file has to be kept open while the mesh is used
+    return new Mesh(fileMesh.vertexCount, fileMesh.triangleCount,
+                    reinterpret_cast<const Ogre::Vector3 *>(d->data + fileMesh.positionsOffset),
+                    reinterpret_cast<const Ogre::Vector3 *>(d->data + fileMesh.normalsOffset),
+                    reinterpret_cast<const Ogre::Vector2 *>(d->data + fileMesh.texCoordsOffset),
+                    reinterpret_cast<const Ogre::uint32 *>(d->data + fileMesh.indicesOffset),
+                    reinterpret_cast<const Ogre::uint16 *>(d->data + fileMesh.materialIndicesOffset));
+  }
+
+  const std::vector<Ogre::uint32> SceneFile::meshMaterials(const size_t i) const {
+    const FileMesh &fileMesh = d->meshes()[i];
+    const quint32 *materials = reinterpret_cast<const quint32 *>(d->data + fileMesh.materialsOffset);
+    return std::vector<Ogre::uint32>(materials, materials + fileMesh.materialCount);
+  }
+
+  const size_t SceneFile::instanceCount() const {
+    return d->header ? d->header->instanceCount : 0;
+  }
+
+  const SceneInstance SceneFile::instance(const size_t i) const {
+    const FileInstance &fileInstance = d->instances()[i];
+    return SceneInstance(fileInstance.mesh,
+                         Ogre::Vector3(fileInstance.position[0], fileInstance.position[1], fileInstance.position[2]),
+                         Ogre::Quaternion(fileInstance.orientation[0], fileInstance.orientation[1], fileInstance.orientation[2], fileInstance.orientation[3]),
+                         Ogre::Vector3(fileInstance.scale[0], fileInstance.scale[1], fileInstance.scale[2]));
+  }
+}
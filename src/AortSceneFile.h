@@ -0,0 +1,70 @@
+#ifndef AORTSCENEFILE_H
+#define AORTSCENEFILE_H
+
+#include <OGRE/OgreColourValue.h>
+#include <OGRE/OgreCommon.h>
+#include <OGRE/OgrePrerequisites.h>
+#include <OGRE/OgreQuaternion.h>
+#include <OGRE/OgreVector3.h>
+
+namespace Aort {
+  class Material;
+  class Mesh;
+
+  class SceneMaterial {
+  public:
+    SceneMaterial();
+    SceneMaterial(Material *material);
+
+    Ogre::String name;
+    Ogre::ColourValue ambient;
+    Ogre::ColourValue diffuse;
+    Ogre::ColourValue specular;
+    Ogre::Real shininess;
+    Ogre::Real reflectivity;
+    Ogre::String texture;
+    Ogre::FilterOptions filter;
+    unsigned int anisotropy;
+  };
+
+  class SceneInstance {
+  public:
+    SceneInstance();
+    SceneInstance(const Ogre::uint32 mesh, const Ogre::Vector3 &position, const Ogre::Quaternion &orientation, const Ogre::Vector3 &scale);
+
+    Ogre::uint32 mesh;
+    Ogre::Vector3 position;
+    Ogre::Quaternion orientation;
+    Ogre::Vector3 scale;
+  };
+
+  class SceneFilePrivate;
+
+  class SceneFile {
+  public:
+    SceneFile();
+    ~SceneFile();
+
+    // writes a new file next to the path and replaces the file at the path with it, so that a mapped file at the path
+    // stays intact, also while its meshes are the ones being written
+    static const bool write(const Ogre::String &path, const std::vector<Mesh *> &meshes, const std::vector<SceneInstance> &instances);
+
+    const bool open(const Ogre::String &path);
+    void close();
+
+    const size_t materialCount() const;
+    const SceneMaterial material(const size_t i) const;
+
+    const size_t meshCount() const;
+    Mesh *createMesh(const size_t i) const;
+    const std::vector<Ogre::uint32> meshMaterials(const size_t i) const;
+
+    const size_t instanceCount() const;
+    const SceneInstance instance(const size_t i) const;
+
+  private:
+    SceneFilePrivate *d;
+  };
+}
+
+#endif // AORTSCENEFILE_H
@@ -1,9 +1,24 @@
 #include "AortSceneNode.h"
 
+#include "AortArena.h"
+#include "AortTrace.h"
 #include "AortTriangle.h"
 
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QThread>
+
 #include <OGRE/OgreAxisAlignedBox.h>
 #include <OGRE/OgreRay.h>
+#include <OGRE/OgreStringConverter.h>
+
+#include <algorithm>
+#include <new>
+
+// depth of the deepest nodes whose construction is traced, deeper nodes are too many and too short
+#define TRACE_DEPTH (6)
+// axis of the leaves that are pending subtrees
+#define PENDING_AXIS (3)
 
 namespace Aort {
   enum SplitPointType  {
@@ -13,11 +28,10 @@ namespace Aort {
 
   class SplitPoint {
   public:
-    SplitPoint(Ogre::Real position, Triangle *triangle, SplitPointType type) : position(position), triangle(triangle), type(type) {
+    SplitPoint(Ogre::Real position, SplitPointType type) : position(position), type(type) {
     }
 
     Ogre::Real position;
-    Triangle *triangle;
     SplitPointType type;
   };
 
@@ -30,33 +44,279 @@ namespace Aort {
     return s1.type < s2.type;
   }
 
-  size_t SceneNode::intersectionCount = 0;
+  TreeOptions::TreeOptions() : maximumDepth(MAXIMUM_DEPTH), minimumTrianglesPerLeaf(MINIMUM_TRIANGLES_PER_LEAF), traversalCost(0.0f), intersectionCost(1.0f), emptyBonus(0.0f), memoryBudget(0), maximumRefitCost(MAXIMUM_REFIT_COST), lazyDepth(0) {
+  }
 
-  SceneNode::SceneNode() : data(6), splitPosition(0) {
+  TreeStatistics::TreeStatistics() : nodeCount(0), leafCount(0), emptyLeafCount(0), maximumDepthLeafCount(0), triangleCount(0), referenceCount(0), largestLeafSize(0), depth(0), expectedNodeCount(0), expectedTriangleCount(0), memoryUsage(0), memoryBudget(0), buildMemoryUsage(0), budgetLeafCount(0), budgetCostIncrease(0), pendingLeafCount(0) {
   }
 
-  SceneNode::SceneNode(const Ogre::AxisAlignedBox &aabb, std::vector<Triangle *> &triangles) : data(6), splitPosition(0) {
-    split(aabb, triangles);
+  const Ogre::Real TreeStatistics::duplicationFactor() const {
+    return triangleCount ? Ogre::Real(referenceCount) / triangleCount : 0.0f;
   }
 
-  SceneNode::~SceneNode() {
-    if (isLeaf())
-      delete[] triangles();
-    else
-      delete[] nodes();
+  const Ogre::Real TreeStatistics::emptyLeafRatio() const {
+    return leafCount ? Ogre::Real(emptyLeafCount) / leafCount : 0.0f;
+  }
+
+  const Ogre::Real TreeStatistics::sahCost() const {
+    return expectedNodeCount + expectedTriangleCount;
+  }
+
+  const Ogre::String TreeStatistics::toString() const {
+    Ogre::String report;
+    report += "Nodes: " + Ogre::StringConverter::toString(nodeCount) + ", leaves: " + Ogre::StringConverter::toString(leafCount) + ", depth: " + Ogre::StringConverter::toString(depth) + "\n";
+    report += "Empty leaves: " + Ogre::StringConverter::toString(emptyLeafCount) + " (" + Ogre::StringConverter::toString(emptyLeafRatio() * 100.0f, 4) + "%)\n";
+    report += "Leaves at maximum depth: " + Ogre::StringConverter::toString(maximumDepthLeafCount) + "\n";
+    report += "Triangle references: " + Ogre::StringConverter::toString(referenceCount) + " of " + Ogre::StringConverter::toString(triangleCount) + " triangles (duplication " + Ogre::StringConverter::toString(duplicationFactor(), 4) + ")\n";
+    report += "Largest leaf: " + Ogre::StringConverter::toString(largestLeafSize) + " triangles\n";
+    if (pendingLeafCount)
+      report += "Pending subtrees: " + Ogre::StringConverter::toString(pendingLeafCount) + " of the leaves\n";
+    report += "SAH cost: " + Ogre::StringConverter::toString(sahCost(), 6) + " (" + Ogre::StringConverter::toString(expectedNodeCount, 6) + " nodes, " + Ogre::StringConverter::toString(expectedTriangleCount, 6) + " triangles per ray)\n";
+    report += "Memory: " + Ogre::StringConverter::toString(memoryUsage) + " bytes";
+    if (memoryBudget) {
+      report += " of " + Ogre::StringConverter::toString(memoryBudget) + " bytes budget, " + Ogre::StringConverter::toString(budgetLeafCount) + " leaves forced by the budget";
+      report += ", SAH cost increase at least " + Ogre::StringConverter::toString(budgetCostIncrease, 6) + " (" + Ogre::StringConverter::toString(sahCost() > 0.0f ? budgetCostIncrease / sahCost() * 100.0f : 0.0f, 4) + "%)";
+    }
+    report += "\n";
+    report += "Build memory peak: " + Ogre::StringConverter::toString(buildMemoryUsage) + " bytes\n";
+    report += "Leaves per depth:";
+    for (size_t i = 0; i < depthHistogram.size(); ++i)
+      report += " " + Ogre::StringConverter::toString(depthHistogram.at(i));
+    report += "\nLeaves per size: 0: " + Ogre::StringConverter::toString(leafSizeHistogram.empty() ? 0 : leafSizeHistogram.at(0));
+    for (size_t i = 1; i < leafSizeHistogram.size(); ++i)
+      report += ", " + Ogre::StringConverter::toString(size_t(1) << (i - 1)) + "-" + Ogre::StringConverter::toString((size_t(1) << i) - 1) + ": " + Ogre::StringConverter::toString(leafSizeHistogram.at(i));
+    return report;
+  }
+
+  class SceneBuilder {
+  public:
+    SceneBuilder(Triangle *triangles, Arena &nodes, std::vector<Ogre::uint32> &leafIndices, const TreeOptions &options) : triangles(triangles), nodes(nodes), leafIndices(leafIndices), options(options), inverseRootArea(0), budgetLeafCount(0), budgetCostIncrease(0), tree(0), lazyDepth(0) {
+    }
+
+    Triangle *triangles;
+    // arena of the tree and arena of the temporaries of the build
+    Arena &nodes;
+    Arena scratch;
+    // triangle indices of all leaves
+    std::vector<Ogre::uint32> &leafIndices;
+    const TreeOptions &options;
+    // one over the surface area of the root, converts the cost of a node to the cost of a ray through the root
+    Ogre::Real inverseRootArea;
+    // leaves created because a split did not fit into the memory budget and the cost they add
+    size_t budgetLeafCount;
+    Ogre::Real budgetCostIncrease;
+    // tree the pending subtrees are registered with and the depth at which they are left, zero to build everything
+    SceneTree *tree;
+    int lazyDepth;
+  };
+
+  enum LazyState {
+    LS_PENDING,
+    LS_BUILDING,
+    LS_BUILT
+  };
+
+  // a subtree allocates its nodes in blocks sized by its triangles, so that small subtrees do not take a whole block
+  static size_t lazyBlockSize(const size_t count) {
+    return std::min<size_t>(ARENA_BLOCK_SIZE, std::max<size_t>(2 * count * sizeof(SceneNode), 4096));
+  }
+
+  // root and leaf indices of a built subtree, published together through one pointer
+  class LazySubtree {
+  public:
+    SceneNode *root;
+    const Ogre::uint32 *indices;
+  };
+
+  // a subtree of a lazy tree, the first ray entering it builds it while the other rays entering it wait
+  class LazyNode {
+  public:
+    LazyNode(SceneTree *tree, const Ogre::AxisAlignedBox &aabb, const size_t offset, const size_t count, const int depth) :
+      tree(tree), aabb(aabb), offset(offset), count(count), depth(depth), state(LS_PENDING), subtree(0), arena(lazyBlockSize(count)) {
+    }
+
+    // registers the node with its tree, which destroys it
+    void enqueue() {
+      tree->lazyNodes.push_back(this);
+    }
+
+    // the rays entering a built subtree only read the published pointer, the root and the leaf indices are reached
+    // through it, so their reads depend on it and are not taken before the release publishing them
+    const LazySubtree *expand() {
+      const LazySubtree *built = subtree;
+      if (built)
+        return built;
+      if (!state.testAndSetAcquire(LS_PENDING, LS_BUILDING)) {
+        while (!(built = subtree))
+          QThread::yieldCurrentThread();
+        return built;
+      }
+      qint64 traceBegin = Trace::isEnabled() ? Trace::now() : -1;
+      // build the subtree from the triangle list kept in the leaf indices of the tree
+      SceneBuilder builder(tree->triangles, arena, leafIndices, tree->options);
+      Ogre::Vector3 size = tree->aabb.getSize();
+      Ogre::Real area = size.x * size.y + size.y * size.z + size.z * size.x;
+      builder.inverseRootArea = (area > 0.0f) ? 1.0f / area : 0.0f;
+      Ogre::uint32 *indices = builder.scratch.allocate<Ogre::uint32>(count);
+      std::copy(tree->leafIndices.begin() + offset, tree->leafIndices.begin() + offset + count, indices);
+      SceneNode *node = new (arena.allocate<SceneNode>(1)) SceneNode();
+      node->split(aabb, indices, count, depth, size_t(-1), builder);
+      std::vector<Ogre::uint32>(leafIndices).swap(leafIndices);
+      if (traceBegin >= 0)
+        Trace::record("render", "expand subtree", "depth " + Ogre::StringConverter::toString(depth) + ", " + Ogre::StringConverter::toString(count) + " triangles", traceBegin, Trace::now());
+      // publish the subtree
+      LazySubtree *published = arena.allocate<LazySubtree>(1);
+      published->root = node;
+      published->indices = leafIndices.empty() ? 0 : &leafIndices[0];
+      subtree.fetchAndStoreRelease(published);
+      state.fetchAndStoreRelease(LS_BUILT);
+      return published;
+    }
+
+    // the acquire pairs with the release publishing the subtree, so that all its data is seen once it is built, used
+    // off the paths of the rays
+    const bool isBuilt() const {
+      return state.fetchAndAddAcquire(0) == LS_BUILT;
+    }
+
+    const size_t memoryUsage() const {
+      return isBuilt() ? arena.memoryUsage() + leafIndices.capacity() * sizeof(Ogre::uint32) : 0;
+    }
+
+    SceneTree *tree;
+    Ogre::AxisAlignedBox aabb;
+    // range of the triangle list in the leaf indices of the tree
+    size_t offset;
+    size_t count;
+    int depth;
+    // decides the ray building the subtree
+    mutable QAtomicInt state;
+    QAtomicPointer<LazySubtree> subtree;
+    // nodes and leaf indices of the subtree
+    Arena arena;
+    std::vector<Ogre::uint32> leafIndices;
+  };
+
+  // a budgeted tree allocates its nodes in smaller blocks, so that the last block does not waste most of the budget
+  static size_t blockSize(const TreeOptions &options) {
+    return options.memoryBudget ? std::min<size_t>(ARENA_BLOCK_SIZE, std::max<size_t>(options.memoryBudget / 16, 4096)) : ARENA_BLOCK_SIZE;
+  }
+
+  SceneTree::SceneTree(const Ogre::AxisAlignedBox &aabb, Triangle *triangles, const std::vector<Ogre::uint32> &indices, const TreeOptions &options) : arena(blockSize(options)), rootNode(0), triangles(triangles), aabb(aabb), options(options), triangleCount(indices.size()), budgetLeafCount(0), budgetCostIncrease(0), buildCost(0), buildMemoryUsage(0) {
+    SceneBuilder builder(triangles, arena, leafIndices, options);
+    Ogre::Vector3 size = aabb.getSize();
+    Ogre::Real area = size.x * size.y + size.y * size.z + size.z * size.x;
+    builder.inverseRootArea = (area > 0.0f) ? 1.0f / area : 0.0f;
+    builder.tree = this;
+    builder.lazyDepth = options.lazyDepth;
+    // the index lists of the build live in the scratch arena, starting with a copy of the indices
+    Ogre::uint32 *rootIndices = builder.scratch.allocate<Ogre::uint32>(indices.size());
+    std::copy(indices.begin(), indices.end(), rootIndices);
+    rootNode = new (arena.allocate<SceneNode>(1)) SceneNode();
+    // the root and the unused end of the last block take their share of the budget first, a budget too small for even
+    // a single leaf still builds one
+    size_t reserved = options.memoryBudget ? sizeof(SceneNode) + blockSize(options) : 0;
+    size_t budget = options.memoryBudget ? options.memoryBudget - std::min(options.memoryBudget, reserved) : size_t(-1);
+    rootNode->split(aabb, rootIndices, indices.size(), 0, budget, builder);
+    budgetLeafCount = builder.budgetLeafCount;
+    budgetCostIncrease = builder.budgetCostIncrease;
+    // the scratch arena keeps its blocks, so they are its high-water mark, the leaf indices are copied once more when
+    // their unused capacity is released
+    buildMemoryUsage = arena.memoryUsage() + builder.scratch.memoryUsage() + (leafIndices.capacity() + leafIndices.size()) * sizeof(Ogre::uint32);
+    // release the unused capacity of the leaf indices
+    std::vector<Ogre::uint32>(leafIndices).swap(leafIndices);
+    buildCost = statistics().sahCost();
+  }
+
+  SceneTree::~SceneTree() {
+    // nodes and triangle lists are released with the arena, the lazy nodes release their subtrees
+    for (size_t i = 0; i < lazyNodes.size(); ++i)
+      lazyNodes.at(i)->~LazyNode();
+  }
+
+  const bool SceneTree::hit(const Ogre::Ray &ray, Triangle *&triangle, Ogre::Real &t, Ogre::Real &u, Ogre::Real &v, const Ogre::Real t_min, const Ogre::Real t_max, TraversalStatistics *statistics) const {
+    return rootNode->hit(ray, triangle, t, u, v, t_min, t_max, triangles, leafIndices.empty() ? 0 : &leafIndices[0], statistics);
+  }
+
+  const bool SceneTree::hit(const Ogre::Ray &ray, const Ogre::Real t_min, const Ogre::Real t_max, TraversalStatistics *statistics) const {
+    return rootNode->hit(ray, t_min, t_max, triangles, leafIndices.empty() ? 0 : &leafIndices[0], statistics);
+  }
+
+  const Ogre::AxisAlignedBox &SceneTree::getBounds() const {
+    return aabb;
+  }
+
+  const TreeOptions &SceneTree::getOptions() const {
+    return options;
   }
 
-  const bool SceneNode::hit(const Ogre::Ray &ray, Triangle *&triangle, Ogre::Real &t, Ogre::Real &u, Ogre::Real &v, const Ogre::Real t_min, const Ogre::Real t_max) const {
+  const bool SceneTree::refit(const Ogre::AxisAlignedBox &aabb, const std::vector<Ogre::uint32> &indices) {
+    // the pending triangle lists live in the leaf indices, a lazy tree is built again, which is cheap for it
+    if (!lazyNodes.empty())
+      return false;
+    size_t previousUsage = memoryUsage();
+    this->aabb = aabb;
+    triangleCount = indices.size();
+    // the leaves append their indices to a new list in the order of the build
+    leafIndices.clear();
+    SceneBuilder builder(triangles, arena, leafIndices, options);
+    Ogre::uint32 *rootIndices = builder.scratch.allocate<Ogre::uint32>(indices.size());
+    std::copy(indices.begin(), indices.end(), rootIndices);
+    rootNode->refit(rootIndices, indices.size(), builder);
+    std::vector<Ogre::uint32>(leafIndices).swap(leafIndices);
+    // leaves that were small may have filled up, compare with the tree that was built
+    if (options.memoryBudget && memoryUsage() > std::max(options.memoryBudget, previousUsage))
+      return false;
+    return statistics().sahCost() <= buildCost * options.maximumRefitCost;
+  }
+
+  const TreeStatistics SceneTree::statistics() const {
+    TreeStatistics statistics;
+    statistics.triangleCount = triangleCount;
+    rootNode->collectStatistics(aabb, statistics, options);
+    statistics.memoryUsage = memoryUsage();
+    statistics.memoryBudget = options.memoryBudget;
+    statistics.buildMemoryUsage = buildMemoryUsage;
+    statistics.budgetLeafCount = budgetLeafCount;
+    statistics.budgetCostIncrease = budgetCostIncrease;
+    return statistics;
+  }
+
+  const size_t SceneTree::memoryUsage() const {
+    size_t memoryUsage = arena.memoryUsage() + leafIndices.capacity() * sizeof(Ogre::uint32);
+    for (size_t i = 0; i < lazyNodes.size(); ++i)
+      memoryUsage += lazyNodes.at(i)->memoryUsage();
+    return memoryUsage;
+  }
+
+  size_t SceneNode::intersectionCount = 0;
+
+  SceneNode::SceneNode() : data(6), triangleCount(0) {
+  }
+
+  const bool SceneNode::hit(const Ogre::Ray &ray, Triangle *&triangle, Ogre::Real &t, Ogre::Real &u, Ogre::Real &v, const Ogre::Real t_min, const Ogre::Real t_max, Triangle *triangles, const Ogre::uint32 *indices, TraversalStatistics *statistics) const {
+    // count visited node
+    if (statistics)
+      statistics->nodeCount++;
+    // enter a pending subtree, it is built by the first ray
+    if (isPending()) {
+      const LazySubtree *subtree = lazyNode()->expand();
+      return subtree->root->hit(ray, triangle, t, u, v, t_min, t_max, triangles, subtree->indices, statistics);
+    }
     // if leaf, check triangle list for intersection
     if (isLeaf()) {
       t = FLT_MAX;
-      for (Triangle **it = triangles(); *it != 0; ++it) {
+      const Ogre::uint32 *leaf = indices + leafOffset();
+      const Ogre::uint32 count = leafSize();
+      // increase intersection count
+      intersectionCount += count;
+      if (statistics)
+        statistics->triangleCount += count;
+      for (Ogre::uint32 i = 0; i < count; ++i) {
         Ogre::Real _t = FLT_MAX, _u = 0, _v = 0;
-        // increase intersection count
-        intersectionCount++;
         // check intersection
-        if ((*it)->intersects(ray, _t, _u, _v) && _t >= t_min && _t <= t_max && _t < t) {
-          triangle = *it;
+        if (triangles[leaf[i]].intersects(ray, _t, _u, _v) && _t >= t_min && _t <= t_max && _t < t) {
+          triangle = triangles + leaf[i];
           t = _t;
           u = _u;
           v = _v;
@@ -72,28 +332,40 @@ namespace Aort {
     SceneNode *far = (ray.getOrigin()[axis()] < splitPosition) ? nodes() + 1 : nodes() + 0;
     // only intersects near node
     if ((t_split < 0) || (t_split > t_max))
-      return near->hit(ray, triangle, t, u, v, t_min, t_max);
+      return near->hit(ray, triangle, t, u, v, t_min, t_max, triangles, indices, statistics);
     // only intersects far node
     if (t_split < t_min)
-      return far->hit(ray, triangle, t, u, v, t_min, t_max);
+      return far->hit(ray, triangle, t, u, v, t_min, t_max, triangles, indices, statistics);
     // intersects both
-    if (near->hit(ray, triangle, t, u, v, t_min, t_split))
+    if (near->hit(ray, triangle, t, u, v, t_min, t_split, triangles, indices, statistics))
       return true;
-    if (far->hit(ray, triangle, t, u, v, t_split, t_max))
+    if (far->hit(ray, triangle, t, u, v, t_split, t_max, triangles, indices, statistics))
       return true;
     // no hit, return false
     return false;
   }
 
-  const bool SceneNode::hit(const Ogre::Ray &ray, const Ogre::Real t_min, const Ogre::Real t_max) const {
+  const bool SceneNode::hit(const Ogre::Ray &ray, const Ogre::Real t_min, const Ogre::Real t_max, Triangle *triangles, const Ogre::uint32 *indices, TraversalStatistics *statistics) const {
+    // count visited node
+    if (statistics)
+      statistics->nodeCount++;
+    // enter a pending subtree, it is built by the first ray
+    if (isPending()) {
+      const LazySubtree *subtree = lazyNode()->expand();
+      return subtree->root->hit(ray, t_min, t_max, triangles, subtree->indices, statistics);
+    }
     // if leaf, check triangle list for intersection
     if (isLeaf()) {
-      for (Triangle **it = triangles(); *it != 0; ++it) {
+      const Ogre::uint32 *leaf = indices + leafOffset();
+      const Ogre::uint32 count = leafSize();
+      for (Ogre::uint32 i = 0; i < count; ++i) {
         Ogre::Real _t = FLT_MAX, _u = 0, _v = 0;
         // increase intersection count
         intersectionCount++;
+        if (statistics)
+          statistics->triangleCount++;
         // if intersects and intersection is between the t_min and t_max
-        if ((*it)->intersects(ray, _t, _u, _v) && _t >= t_min && _t <= t_max)
+        if (triangles[leaf[i]].intersects(ray, _t, _u, _v) && _t >= t_min && _t <= t_max)
           return true;
       }
       // no hit, return false
@@ -106,33 +378,29 @@ namespace Aort {
     SceneNode *far = (ray.getOrigin()[axis()] < splitPosition) ? nodes() + 1 : nodes() + 0;
     // only intersects near node
     if ((t_split < 0) || (t_split > t_max))
-      return near->hit(ray, t_min, t_max);
+      return near->hit(ray, t_min, t_max, triangles, indices, statistics);
     // only intersects far node
     if (t_split < t_min)
-      return far->hit(ray, t_min, t_max);
+      return far->hit(ray, t_min, t_max, triangles, indices, statistics);
     // intersects both
-    if (near->hit(ray, t_min, t_split))
+    if (near->hit(ray, t_min, t_split, triangles, indices, statistics))
       return true;
-    if (far->hit(ray, t_split, t_max))
+    if (far->hit(ray, t_split, t_max, triangles, indices, statistics))
       return true;
     // no hit, return false
     return false;
   }
 
-  void SceneNode::split(const Ogre::AxisAlignedBox &aabb, std::vector<Triangle *> &triangles, const int depth) {
+  const size_t SceneNode::split(const Ogre::AxisAlignedBox &aabb, Ogre::uint32 *indices, const size_t count, const int depth, const size_t budget, SceneBuilder &builder) {
+    const TreeOptions &options = builder.options;
+    const Triangle *triangles = builder.triangles;
+    qint64 traceBegin = (depth < TRACE_DEPTH && Trace::isEnabled()) ? Trace::now() : -1;
     // if maximum depth or minimum triangle count has been reached, dont split
-    if (depth >= MAXIMUM_DEPTH || triangles.size() <= MINIMUM_TRIANGLES_PER_LEAF) {
-      // create triangles array
-      Triangle** t = new Triangle*[triangles.size() + 1];
-      t[triangles.size()] = 0;
-      // copy triangle pointers
-      for (size_t i = 0; i < triangles.size(); ++i)
-        t[i] = triangles.at(i);
-      // save triangle pointer
-      setPointer(t);
-      // return
-      return;
-    }
+    if (depth >= options.maximumDepth || count <= options.minimumTrianglesPerLeaf)
+      return createLeaf(indices, count, builder);
+    // leave the subtree of a lazy tree for the first ray entering it
+    if (builder.lazyDepth > 0 && depth >= builder.lazyDepth)
+      return createPending(aabb, indices, count, depth, builder);
     // get bounding box size
     Ogre::Vector3 size = aabb.getSize();
     // assume first axis is the longest one
@@ -147,26 +415,29 @@ namespace Aort {
     Ogre::Real b = size[(splitAxis + 2) % 3];
     Ogre::Real minimum = aabb.getMinimum()[splitAxis];
     Ogre::Real maximum = aabb.getMaximum()[splitAxis];
-    std::vector<SplitPoint> splitPoints;
+    // temporaries of this node are allocated from the scratch arena and released before returning
+    ArenaMarker marker = builder.scratch.mark();
     // generate split points
-    for (size_t i = 0; i < triangles.size(); ++i) {
+    size_t splitPointCount = count * 2;
+    SplitPoint *splitPoints = builder.scratch.allocate<SplitPoint>(splitPointCount);
+    for (size_t i = 0; i < count; ++i) {
       // push split points
-      splitPoints.push_back(SplitPoint(triangles.at(i)->getMinimum()[splitAxis], triangles.at(i), Minimum));
-      splitPoints.push_back(SplitPoint(triangles.at(i)->getMaximum()[splitAxis], triangles.at(i), Maximum));
+      new (splitPoints + i * 2 + 0) SplitPoint(triangles[indices[i]].getMinimum()[splitAxis], Minimum);
+      new (splitPoints + i * 2 + 1) SplitPoint(triangles[indices[i]].getMaximum()[splitAxis], Maximum);
     }
     // sort events
-    std::sort(splitPoints.begin(), splitPoints.end(), splitPointCompare);
+    std::sort(splitPoints, splitPoints + splitPointCount, splitPointCompare);
     // find the best split point
     Ogre::Real splitCost = FLT_MAX;
-    size_t left = 0, right = triangles.size();
-    for (size_t i = 0; i < splitPoints.size(); ++i) {
-      Ogre::Real position = splitPoints.at(i).position;
+    size_t left = 0, right = count;
+    for (size_t i = 0; i < splitPointCount; ++i) {
+      Ogre::Real position = splitPoints[i].position;
       if (position <= minimum || position >= maximum)
         continue;
       // count points at this point
       size_t e = 0, s = 0;
-      while ((i < splitPoints.size()) && (splitPoints.at(i).position - position < std::numeric_limits<float>::epsilon())) {
-        if (splitPoints.at(i).type == Maximum)
+      while ((i < splitPointCount) && (splitPoints[i].position - position < std::numeric_limits<float>::epsilon())) {
+        if (splitPoints[i].type == Maximum)
           e++;
         else
           s++;
@@ -178,6 +449,9 @@ namespace Aort {
       right -= e;
       // calculate cost of splitting
       Ogre::Real cost = ((position - minimum) * (a + b) + a * b) * left + ((maximum - position) * (a + b) + a * b) * right;
+      if (left == 0 || right == 0)
+        cost *= 1.0f - options.emptyBonus;
+      cost = options.traversalCost * (size[splitAxis] * (a + b) + a * b) + options.intersectionCost * cost;
       // update optimal point if needed
       if (cost < splitCost) {
         splitCost = cost;
@@ -186,45 +460,154 @@ namespace Aort {
       // update left
       left += s;
     }
-    if (splitCost >= (size[splitAxis] * (a + b) + a * b) * triangles.size()) {
-      // create triangles array
-      Triangle** t = new Triangle*[triangles.size() + 1];
-      t[triangles.size()] = 0;
-      // copy triangle pointers
-      for (size_t i = 0; i < triangles.size(); ++i)
-        t[i] = triangles.at(i);
-      // save triangle pointer
-      setPointer(t);
-      // return
-      return;
+    // split points are not needed anymore
+    builder.scratch.rewind(marker);
+    Ogre::Real leafCost = options.intersectionCost * (size[splitAxis] * (a + b) + a * b) * count;
+    if (splitCost >= leafCost)
+      return createLeaf(indices, count, builder);
+    // add triangles
+    Ogre::uint32 *leftIndices = builder.scratch.allocate<Ogre::uint32>(count);
+    Ogre::uint32 *rightIndices = builder.scratch.allocate<Ogre::uint32>(count);
+    size_t leftCount = 0, rightCount = 0;
+    for (size_t i = 0; i < count; ++i) {
+      if (triangles[indices[i]].getMinimum()[splitAxis] <= splitPosition)
+        leftIndices[leftCount++] = indices[i];
+      if (triangles[indices[i]].getMaximum()[splitAxis] > splitPosition)
+        rightIndices[rightCount++] = indices[i];
+    }
+    // the children need at least their nodes and their triangle references, if the budget of this subtree cannot
+    // hold them make a leaf and account for the cost the split would have saved
+    size_t required = 2 * sizeof(SceneNode) + (leftCount + rightCount) * sizeof(Ogre::uint32);
+    if (budget < required) {
+      builder.scratch.rewind(marker);
+      builder.budgetLeafCount++;
+      builder.budgetCostIncrease += (leafCost - splitCost) * builder.inverseRootArea;
+      return createLeaf(indices, count, builder);
     }
     // split
     setLeaf(false);
     setAxis(splitAxis);
     // point the pointer to the nodes
-    setPointer(new SceneNode[2]);
+    SceneNode *children = builder.nodes.allocate<SceneNode>(2);
+    new (children + 0) SceneNode();
+    new (children + 1) SceneNode();
+    setPointer(children);
     // create left node
     SceneNode *leftNode = nodes() + 0;
     // create node
     SceneNode *rightNode = nodes() + 1;
-    // add triangles
-    std::vector<Triangle *> leftTriangles, rightTriangles;
-    for (size_t i = 0; i < triangles.size(); ++i) {
-      if (triangles.at(i)->getMinimum()[splitAxis] <= splitPosition)
-        leftTriangles.push_back(triangles[i]);
-      if (triangles.at(i)->getMaximum()[splitAxis] > splitPosition)
-        rightTriangles.push_back(triangles[i]);
-    }
     // calculate left bounding box
     Ogre::AxisAlignedBox lbb = aabb;
     lbb.getMaximum()[splitAxis] = splitPosition;
     // calculate right bounding box
     Ogre::AxisAlignedBox rbb = aabb;
     rbb.getMinimum()[splitAxis] = splitPosition;
+    // divide the rest of the budget by the triangle counts, the right node also gets what the left node left over
+    size_t remaining = budget - 2 * sizeof(SceneNode);
+    size_t leftBudget = (budget == size_t(-1)) ? budget : size_t(double(remaining) * leftCount / (leftCount + rightCount));
     // split left node
-    leftNode->split(lbb, leftTriangles, depth + 1);
+    size_t used = leftNode->split(lbb, leftIndices, leftCount, depth + 1, leftBudget, builder);
     // split right node
-    rightNode->split(rbb, rightTriangles, depth + 1);
+    size_t rightBudget = (budget == size_t(-1)) ? budget : remaining - used;
+    used += rightNode->split(rbb, rightIndices, rightCount, depth + 1, rightBudget, builder);
+    // release the index lists of the children
+    builder.scratch.rewind(marker);
+    // record the construction of the subtree
+    if (traceBegin >= 0)
+      Trace::record("preprocess", "split", "depth " + Ogre::StringConverter::toString(depth) + ", " + Ogre::StringConverter::toString(count) + " triangles", traceBegin, Trace::now());
+    return 2 * sizeof(SceneNode) + used;
+  }
+
+  const size_t SceneNode::createLeaf(const Ogre::uint32 *indices, const size_t count, SceneBuilder &builder) {
+    // append the indices to the shared list and point the leaf to them
+    setTriangles(builder.leafIndices.size(), count);
+    builder.leafIndices.insert(builder.leafIndices.end(), indices, indices + count);
+    return count * sizeof(Ogre::uint32);
+  }
+
+  const size_t SceneNode::refit(Ogre::uint32 *indices, const size_t count, SceneBuilder &builder) {
+    if (isLeaf())
+      return createLeaf(indices, count, builder);
+    // divide the triangles by the split plane like the build does
+    const Triangle *triangles = builder.triangles;
+    ArenaMarker marker = builder.scratch.mark();
+    Ogre::uint32 *leftIndices = builder.scratch.allocate<Ogre::uint32>(count);
+    Ogre::uint32 *rightIndices = builder.scratch.allocate<Ogre::uint32>(count);
+    size_t leftCount = 0, rightCount = 0;
+    for (size_t i = 0; i < count; ++i) {
+      if (triangles[indices[i]].getMinimum()[axis()] <= splitPosition)
+        leftIndices[leftCount++] = indices[i];
+      if (triangles[indices[i]].getMaximum()[axis()] > splitPosition)
+        rightIndices[rightCount++] = indices[i];
+    }
+    size_t used = nodes()[0].refit(leftIndices, leftCount, builder);
+    used += nodes()[1].refit(rightIndices, rightCount, builder);
+    builder.scratch.rewind(marker);
+    return used;
+  }
+
+  const size_t SceneNode::createPending(const Ogre::AxisAlignedBox &aabb, const Ogre::uint32 *indices, const size_t count, const int depth, SceneBuilder &builder) {
+    // the triangle list is kept in the leaf indices until the subtree is built
+    LazyNode *lazy = new (builder.nodes.allocate<LazyNode>(1)) LazyNode(builder.tree, aabb, builder.leafIndices.size(), count, depth);
+    builder.leafIndices.insert(builder.leafIndices.end(), indices, indices + count);
+    lazy->enqueue();
+    setPointer(lazy);
+    setLeaf(true);
+    setAxis(PENDING_AXIS);
+    triangleCount = count;
+    return count * sizeof(Ogre::uint32);
+  }
+
+  void SceneNode::collectStatistics(const Ogre::AxisAlignedBox &aabb, TreeStatistics &statistics, const TreeOptions &options) const {
+    Ogre::Vector3 size = aabb.getSize();
+    Ogre::Real area = size.x * size.y + size.y * size.z + size.z * size.x;
+    collectStatistics(aabb, statistics, options, 0, (area > 0.0f) ? 1.0f / area : 0.0f);
+  }
+
+  void SceneNode::collectStatistics(const Ogre::AxisAlignedBox &aabb, TreeStatistics &statistics, const TreeOptions &options, const int depth, const Ogre::Real inverseRootArea) const {
+    // built subtrees take the place of their pending leaves, the others are counted as leaves
+    if (isPending()) {
+      if (lazyNode()->isBuilt()) {
+        static_cast<const LazySubtree *>(lazyNode()->subtree)->root->collectStatistics(aabb, statistics, options, depth, inverseRootArea);
+        return;
+      }
+      statistics.pendingLeafCount++;
+    }
+    // probability of a ray through the root passing through this node
+    Ogre::Vector3 size = aabb.getSize();
+    Ogre::Real probability = (size.x * size.y + size.y * size.z + size.z * size.x) * inverseRootArea;
+    statistics.nodeCount++;
+    statistics.expectedNodeCount += probability;
+    statistics.depth = std::max(statistics.depth, depth);
+    if (isLeaf()) {
+      size_t leafSize = this->leafSize();
+      statistics.leafCount++;
+      statistics.referenceCount += leafSize;
+      statistics.largestLeafSize = std::max(statistics.largestLeafSize, leafSize);
+      statistics.expectedTriangleCount += probability * leafSize;
+      if (leafSize == 0)
+        statistics.emptyLeafCount++;
+      if (depth >= options.maximumDepth)
+        statistics.maximumDepthLeafCount++;
+      // update histograms
+      if (statistics.depthHistogram.size() <= size_t(depth))
+        statistics.depthHistogram.resize(depth + 1, 0);
+      statistics.depthHistogram[depth]++;
+      size_t bucket = 0;
+      while ((leafSize >> bucket) > 0)
+        bucket++;
+      if (statistics.leafSizeHistogram.size() <= bucket)
+        statistics.leafSizeHistogram.resize(bucket + 1, 0);
+      statistics.leafSizeHistogram[bucket]++;
+      return;
+    }
+    // calculate child bounding boxes
+    Ogre::AxisAlignedBox lbb = aabb;
+    lbb.getMaximum()[axis()] = splitPosition;
+    Ogre::AxisAlignedBox rbb = aabb;
+    rbb.getMinimum()[axis()] = splitPosition;
+    nodes()[0].collectStatistics(lbb, statistics, options, depth + 1, inverseRootArea);
+    nodes()[1].collectStatistics(rbb, statistics, options, depth + 1, inverseRootArea);
   }
 
   const bool SceneNode::isLeaf() const {
@@ -232,7 +615,15 @@ namespace Aort {
   }
 
   void SceneNode::setLeaf(const bool leaf) {
-    data = (leaf) ? (data | 4) : (data & 0xfffffffb);
+    data = (leaf) ? (data | 4) : (data & ~size_t(4));
+  }
+
+  const bool SceneNode::isPending() const {
+    return (data & 7) == (4 | PENDING_AXIS);
+  }
+
+  LazyNode *SceneNode::lazyNode() const {
+    return (LazyNode *)(data & ~size_t(7));
   }
 
   const int SceneNode::axis() const {
@@ -240,18 +631,27 @@ namespace Aort {
   }
 
   void SceneNode::setAxis(const int axis) {
-    data = (data & 0xfffffffc) + axis;
+    data = (data & ~size_t(3)) + axis;
   }
 
   SceneNode *SceneNode::nodes() const {
-    return (SceneNode *)(data & 0xfffffff8);
+    return (SceneNode *)(data & ~size_t(7));
+  }
+
+  const size_t SceneNode::leafOffset() const {
+    return data >> 3;
+  }
+
+  const Ogre::uint32 SceneNode::leafSize() const {
+    return triangleCount;
   }
 
-  Triangle **SceneNode::triangles() const {
-    return (Triangle **)(data & 0xfffffff8);
+  void SceneNode::setTriangles(const size_t offset, const size_t count) {
+    data = (offset << 3) | 4 | (data & 3);
+    triangleCount = count;
   }
 
   void SceneNode::setPointer(const void *pointer) {
-    data = (unsigned long)pointer + (data & 7);
+    data = (size_t)pointer + (data & 7);
   }
 }
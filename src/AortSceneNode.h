@@ -1,44 +1,195 @@
 #ifndef AORTSCENENODE_H
 #define AORTSCENENODE_H
 
+#include "AortArena.h"
+
+#include <OGRE/OgreAxisAlignedBox.h>
 #include <OGRE/OgrePrerequisites.h>
 
 #include <float.h>
 
+// defaults of the build options
 #define MAXIMUM_DEPTH (32)
 #define MINIMUM_TRIANGLES_PER_LEAF (4)
+#define MAXIMUM_REFIT_COST (1.5f)
 
 namespace Aort {
+  class LazyNode;
+  class SceneBuilder;
   class Triangle;
 
+  // work done by a traversal, collected for diagnostics
+  class TraversalStatistics {
+  public:
+    TraversalStatistics() : nodeCount(0), triangleCount(0) {
+    }
+
+    size_t nodeCount;
+    size_t triangleCount;
+  };
+
+  // parameters of the tree build, the defaults build the same tree as the original fixed parameters
+  class TreeOptions {
+  public:
+    TreeOptions();
+
+    int maximumDepth;
+    size_t minimumTrianglesPerLeaf;
+    // surface area heuristic costs of traversing a node and testing a triangle
+    Ogre::Real traversalCost;
+    Ogre::Real intersectionCost;
+    // fraction of the cost saved by splits that leave one side empty, favours cutting off empty space
+    Ogre::Real emptyBonus;
+    // bytes the nodes and the leaf indices of the built tree may take, splits that do not fit become leaves, zero for
+    // no limit, the temporary index lists of the build and the growth of the leaf indices come on top of it
+    size_t memoryBudget;
+    // sah cost of a refitted tree relative to its cost when it was built above which it has to be rebuilt
+    Ogre::Real maximumRefitCost;
+    // depth at which the build stops and leaves the subtrees pending until a ray enters them, zero builds the whole
+    // tree upfront, the memory budget only limits the part built upfront
+    int lazyDepth;
+  };
+
+  // quality of a built tree, collected for tuning the build parameters
+  class TreeStatistics {
+  public:
+    TreeStatistics();
+
+    // references divided by the triangles, more than one when triangles straddling split planes are duplicated
+    const Ogre::Real duplicationFactor() const;
+    const Ogre::Real emptyLeafRatio() const;
+    // expected cost of a ray passing through the scene bounds, one per traversed node and one per tested triangle
+    const Ogre::Real sahCost() const;
+
+    // multi line human readable report
+    const Ogre::String toString() const;
+
+    size_t nodeCount;
+    size_t leafCount;
+    size_t emptyLeafCount;
+    // leaves forced by the maximum depth instead of the cost function
+    size_t maximumDepthLeafCount;
+    // triangles the tree was built from and their references in the leaves
+    size_t triangleCount;
+    size_t referenceCount;
+    size_t largestLeafSize;
+    int depth;
+    // expected number of visited nodes and tested triangles, surface area of the nodes relative to the root
+    Ogre::Real expectedNodeCount;
+    Ogre::Real expectedTriangleCount;
+    // leaves per depth
+    std::vector<size_t> depthHistogram;
+    // leaves per size, bucket 0 holds the empty leaves and bucket i the leaves with 2^(i-1) to 2^i - 1 triangles
+    std::vector<size_t> leafSizeHistogram;
+    // bytes taken by the tree and the budget it was built with, zero for no limit
+    size_t memoryUsage;
+    size_t memoryBudget;
+    // bytes taken at the peak of the build, including the temporaries the budget does not limit
+    size_t buildMemoryUsage;
+    // leaves forced by the memory budget and the sah cost their splits would have saved, a lower bound of the loss
+    size_t budgetLeafCount;
+    Ogre::Real budgetCostIncrease;
+    // subtrees of a lazy tree no ray has entered yet, they are counted as leaves
+    size_t pendingLeafCount;
+  };
+
   class SceneNode {
   public:
     SceneNode();
-    SceneNode(const Ogre::AxisAlignedBox &aabb, std::vector<Triangle *> &triangles);
-    ~SceneNode();
 
-    const bool hit(const Ogre::Ray &ray, Triangle *&triangle, Ogre::Real &t, Ogre::Real &u, Ogre::Real &v, const Ogre::Real t_min = 0.0f, const Ogre::Real t_max = FLT_MAX) const;
-    const bool hit(const Ogre::Ray &ray, const Ogre::Real t_min = 0.0f, const Ogre::Real t_max = FLT_MAX) const;
+    // walks the tree built inside aabb and adds its nodes to the statistics, the triangle count is set by the caller
+    void collectStatistics(const Ogre::AxisAlignedBox &aabb, TreeStatistics &statistics, const TreeOptions &options = TreeOptions()) const;
 
     static size_t intersectionCount;
 
   private:
-    void split(const Ogre::AxisAlignedBox &aabb, std::vector<Triangle *> &triangles, const int depth = 0);
+    friend class LazyNode;
+    friend class SceneTree;
+
+    // the leaves index the triangles through the shared index list of the tree
+    const bool hit(const Ogre::Ray &ray, Triangle *&triangle, Ogre::Real &t, Ogre::Real &u, Ogre::Real &v, const Ogre::Real t_min, const Ogre::Real t_max, Triangle *triangles, const Ogre::uint32 *indices, TraversalStatistics *statistics) const;
+    const bool hit(const Ogre::Ray &ray, const Ogre::Real t_min, const Ogre::Real t_max, Triangle *triangles, const Ogre::uint32 *indices, TraversalStatistics *statistics) const;
+
+    // build the subtree within the budget and return the bytes of its children and leaf indices
+    const size_t split(const Ogre::AxisAlignedBox &aabb, Ogre::uint32 *indices, const size_t count, const int depth, const size_t budget, SceneBuilder &builder);
+    const size_t createLeaf(const Ogre::uint32 *indices, const size_t count, SceneBuilder &builder);
+    // sort the triangles into the leaves of the built subtree again and return the bytes of its leaf indices
+    const size_t refit(Ogre::uint32 *indices, const size_t count, SceneBuilder &builder);
+    // leave the subtree to be built when a ray enters it and return the bytes of its pending triangle list
+    const size_t createPending(const Ogre::AxisAlignedBox &aabb, const Ogre::uint32 *indices, const size_t count, const int depth, SceneBuilder &builder);
+    void collectStatistics(const Ogre::AxisAlignedBox &aabb, TreeStatistics &statistics, const TreeOptions &options, const int depth, const Ogre::Real inverseRootArea) const;
 
     const bool isLeaf() const;
     void setLeaf(const bool leaf);
+    // a pending subtree is a leaf with the unused axis 3, it points to its lazy node
+    const bool isPending() const;
+    LazyNode *lazyNode() const;
 
     const int axis() const;
     void setAxis(const int axis);
 
     SceneNode *nodes() const;
-    Triangle **triangles() const;
-
     void setPointer(const void *pointer);
 
+    // range of the leaf in the index list of the tree
+    const size_t leafOffset() const;
+    const Ogre::uint32 leafSize() const;
+    void setTriangles(const size_t offset, const size_t count);
+
   private:
-    unsigned long data;
-    Ogre::Real splitPosition;
+    // pointer to the children or offset of the leaf in the index list shifted by three,
+    // the lowest three bits store the leaf flag and the split axis
+    size_t data;
+    union {
+      Ogre::Real splitPosition;
+      Ogre::uint32 triangleCount;
+    };
+  };
+
+  // tree of scene nodes, the nodes are allocated from the arena of the tree and released at once
+  // the leaves store ranges of one list of 32-bit indices into the triangle array, the subtrees of a lazy tree are
+  // built by the first ray entering them into arenas and index lists of their own
+  class SceneTree {
+  public:
+    // builds the tree of the indexed triangles, the triangles are not owned and have to be alive as long as the tree
+    SceneTree(const Ogre::AxisAlignedBox &aabb, Triangle *triangles, const std::vector<Ogre::uint32> &indices, const TreeOptions &options = TreeOptions());
+    ~SceneTree();
+
+    const bool hit(const Ogre::Ray &ray, Triangle *&triangle, Ogre::Real &t, Ogre::Real &u, Ogre::Real &v, const Ogre::Real t_min = 0.0f, const Ogre::Real t_max = FLT_MAX, TraversalStatistics *statistics = 0) const;
+    const bool hit(const Ogre::Ray &ray, const Ogre::Real t_min = 0.0f, const Ogre::Real t_max = FLT_MAX, TraversalStatistics *statistics = 0) const;
+
+    const Ogre::AxisAlignedBox &getBounds() const;
+    const TreeOptions &getOptions() const;
+
+    // sorts the triangles into the leaves again after they moved, the split planes are kept, so it takes linear time
+    // in the references instead of a build, returns false if the sah cost grew beyond the maximum refit cost of the
+    // options or the memory budget is exceeded, the tree stays usable but should be built again, lazy trees are not
+    // refitted
+    const bool refit(const Ogre::AxisAlignedBox &aabb, const std::vector<Ogre::uint32> &indices);
+
+    const TreeStatistics statistics() const;
+    const size_t memoryUsage() const;
+
+  private:
+    friend class LazyNode;
+
+    SceneTree(const SceneTree &);
+    SceneTree &operator=(const SceneTree &);
+
+    Arena arena;
+    SceneNode *rootNode;
+    Triangle *triangles;
+    std::vector<Ogre::uint32> leafIndices;
+    Ogre::AxisAlignedBox aabb;
+    TreeOptions options;
+    size_t triangleCount;
+    size_t budgetLeafCount;
+    Ogre::Real budgetCostIncrease;
+    // sah cost of the tree when it was built and the bytes taken at the peak of the build
+    Ogre::Real buildCost;
+    size_t buildMemoryUsage;
+    // pending subtrees of a lazy tree, their lists of triangles are kept in the leaf indices
+    std::vector<LazyNode *> lazyNodes;
   };
 }
 
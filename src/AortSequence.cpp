@@ -0,0 +1,109 @@
+#include "AortSequence.h"
+
+#include "AortDistributed.h"
+#include "AortImageWriter.h"
+#include "AortRenderer.h"
+
+#include <QFuture>
+#include <QtConcurrentRun>
+
+#include <OGRE/OgreCamera.h>
+#include <OGRE/OgreSceneManager.h>
+#include <OGRE/OgreSceneNode.h>
+#include <OGRE/OgreStringConverter.h>
+
+namespace Aort {
+  // a frame handed to the background thread
+  class SequenceFrame {
+  public:
+    Renderer *renderer;
+    const Ogre::Camera *camera;
+    ImageWriter *writer;
+    int width;
+    int height;
+    int supersampling;
+  };
+
+  static bool renderFrame(const SequenceFrame &frame) {
+    return frame.renderer->render(frame.camera, frame.width, frame.height, frame.writer, frame.supersampling) >= 0;
+  }
+
+  class SequenceRendererPrivate {
+  public:
+    SequenceRendererPrivate(Ogre::SceneNode *root, Ogre::Camera *camera) : root(root), camera(camera) {
+      for (int i = 0; i < 2; ++i) {
+        renderers[i] = new Renderer();
+        // the frames keep copies of the camera, so that it can move to the next frame while the last one renders
+        cameras[i] = root->getCreator()->createCamera("AortSequence" + Ogre::StringConverter::toString(reinterpret_cast<size_t>(this)) + "Camera" + Ogre::StringConverter::toString(i));
+      }
+    }
+
+    ~SequenceRendererPrivate() {
+      for (int i = 0; i < 2; ++i) {
+        delete renderers[i];
+        root->getCreator()->destroyCamera(cameras[i]);
+      }
+    }
+
+    // moves the scene to the frame and brings the renderer up to date with it, returns false if the source stops
+    const bool prepare(SequenceSource *source, const int frame, const int index, const int width, const int height) {
+      if (!source->setFrame(frame))
+        return false;
+      RenderJob job;
+      job.width = width;
+      job.height = height;
+      job.setCamera(camera);
+      job.applyCamera(cameras[index]);
+      renderers[index]->update(root);
+      renderers[index]->preprocess(0);
+      return true;
+    }
+
+    Ogre::SceneNode *root;
+    Ogre::Camera *camera;
+    Renderer *renderers[2];
+    Ogre::Camera *cameras[2];
+  };
+
+  SequenceSource::~SequenceSource() {
+  }
+
+  SequenceRenderer::SequenceRenderer(Ogre::SceneNode *root, Ogre::Camera *camera) : d(new SequenceRendererPrivate(root, camera)) {
+  }
+
+  SequenceRenderer::~SequenceRenderer() {
+    delete d;
+  }
+
+  Renderer *SequenceRenderer::getRenderer(const int index) const {
+    return d->renderers[index];
+  }
+
+  int SequenceRenderer::render(SequenceSource *source, const int first, const int count, const int width, const int height, const int supersampling) {
+    if (count <= 0 || !d->prepare(source, first, 0, width, height))
+      return 0;
+    int index = 0;
+    for (int i = 0; i < count; ++i) {
+      SequenceFrame frame;
+      frame.renderer = d->renderers[index];
+      frame.camera = d->cameras[index];
+      frame.writer = source->createWriter(first + i);
+      if (!frame.writer)
+        return -1;
+      frame.width = width;
+      frame.height = height;
+      frame.supersampling = supersampling;
+      QFuture<bool> rendered = QtConcurrent::run(renderFrame, frame);
+      // the next frame is prepared by the other renderer meanwhile
+      bool next = i + 1 < count && d->prepare(source, first + i + 1, 1 - index, width, height);
+      bool written = rendered.result();
+      delete frame.writer;
+      if (!written)
+        return -1;
+      if (!next)
+        return i + 1;
+      index = 1 - index;
+    }
+    return count;
+  }
+}
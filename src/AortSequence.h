@@ -0,0 +1,49 @@
+#ifndef AORTSEQUENCE_H
+#define AORTSEQUENCE_H
+
+#include <OGRE/OgrePrerequisites.h>
+
+namespace Ogre {
+  class Camera;
+  class SceneNode;
+}
+
+namespace Aort {
+  class ImageWriter;
+  class Renderer;
+
+  // moves the scene and the camera to the frames of a sequence, it is called on the thread of ogre
+  class SequenceSource {
+  public:
+    virtual ~SequenceSource();
+
+    // sets up the scene and the camera for the frame, returns false to stop the sequence before the frame
+    virtual const bool setFrame(const int frame) = 0;
+    // creates the writer of the image of the frame, the writer is deleted once the frame is written
+    virtual ImageWriter *createWriter(const int frame) = 0;
+  };
+
+  class SequenceRendererPrivate;
+
+  // renders the frames of a sequence with two renderers in turn, the next frame is updated and preprocessed on the
+  // calling thread while the frame before renders in the background, each renderer keeps the meshes of the entities
+  // that have not moved since its last frame and its tree while nothing moved, so that camera animations only pay for
+  // the render, moving and animated entities refit the tree
+  class SequenceRenderer {
+  public:
+    // the scene under root is seen through the camera, both are only read on the calling thread
+    SequenceRenderer(Ogre::SceneNode *root, Ogre::Camera *camera);
+    ~SequenceRenderer();
+
+    // the renderers used in turn, their options have to be set alike before the sequence
+    Renderer *getRenderer(const int index) const;
+
+    // renders count frames starting at first, returns the number of frames written or -1 if a writer failed
+    int render(SequenceSource *source, const int first, const int count, const int width, const int height, const int supersampling = 1);
+
+  private:
+    SequenceRendererPrivate *d;
+  };
+}
+
+#endif // AORTSEQUENCE_H
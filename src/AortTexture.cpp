@@ -12,9 +12,10 @@ namespace Aort {
     }
 
     ~TexturePrivate() {
-      delete image;
     }
 
+    Ogre::String name;
+    // image is owned by the material library
     Ogre::Image *image;
     size_t width;
     size_t height;
@@ -30,6 +31,14 @@ namespace Aort {
     delete d;
   }
 
+  void Texture::setName(const Ogre::String &name) {
+    d->name = name;
+  }
+
+  const Ogre::String &Texture::getName() const {
+    return d->name;
+  }
+
   void Texture::setImage(Ogre::Image *image) {
     d->image = image;
     d->width = image->getWidth();
@@ -44,10 +53,18 @@ namespace Aort {
     d->filter = filter;
   }
 
+  const Ogre::FilterOptions Texture::getFilter() const {
+    return d->filter;
+  }
+
   void Texture::setAnisotropy(const unsigned int anisotropy) {
     d->anisotropy = anisotropy;
   }
 
+  const unsigned int Texture::getAnisotropy() const {
+    return d->anisotropy;
+  }
+
   const Ogre::ColourValue Texture::getColourAt(const Ogre::Vector2 &uv) {
     // return white if image is null
     if (!d->image)
@@ -106,7 +123,7 @@ namespace Aort {
       // scale and sum the four colors
       result = c1 * w1 + c2 * w2 + c3 * w3 + c4 * w4;
     }
-    // HACK: swap r and b components -- dont know why, but this generates correct results
-    return Ogre::ColourValue(result.b, result.g, result.r);
+    // textures are opaque
+    return Ogre::ColourValue(result.r, result.g, result.b);
   }
 }
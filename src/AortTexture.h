@@ -12,12 +12,18 @@ namespace Aort {
     Texture();
     ~Texture();
 
+    void setName(const Ogre::String &name);
+    const Ogre::String &getName() const;
+
     void setImage(Ogre::Image *image);
 
     void setTransform(const Ogre::Matrix4 &transform);
 
     void setFilter(Ogre::FilterOptions filter);
+    const Ogre::FilterOptions getFilter() const;
+
     void setAnisotropy(const unsigned int anisotropy);
+    const unsigned int getAnisotropy() const;
 
     const Ogre::ColourValue getColourAt(const Ogre::Vector2 &uv);
 
@@ -0,0 +1,189 @@
+#include "AortTrace.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QTextStream>
+#include <QThreadStorage>
+
+#include <stdio.h>
+#include <vector>
+
+namespace Aort {
+  class TraceEvent {
+  public:
+    TraceEvent(const char *category, const char *name, const Ogre::String &detail, const qint64 begin, const qint64 end) : category(category), name(name), detail(detail), begin(begin), end(end) {
+    }
+
+    const char *category;
+    const char *name;
+    Ogre::String detail;
+    qint64 begin;
+    qint64 end;
+  };
+
+  // events of the threads that used the buffer, a buffer belongs to one thread at a time, so that they do not overlap
+  class TraceBuffer {
+  public:
+    // taken by the thread recording and by start and write
+    QMutex mutex;
+    std::vector<TraceEvent> events;
+  };
+
+  // buffer of a thread, it is given back when the thread finishes
+  class TraceThread {
+  public:
+    TraceThread(TraceBuffer *buffer) : buffer(buffer) {
+    }
+
+    ~TraceThread();
+
+    TraceBuffer *buffer;
+  };
+
+  class TracePrivate {
+  public:
+    TracePrivate() : enabled(false) {
+    }
+
+    // buffer of the calling thread, a new thread takes a buffer given back by a finished one first
+    TraceBuffer *buffer() {
+      if (!threads.hasLocalData()) {
+        QMutexLocker locker(&mutex);
+        TraceBuffer *buffer;
+        if (freeBuffers.empty()) {
+          buffer = new TraceBuffer();
+          buffers.push_back(buffer);
+        } else {
+          buffer = freeBuffers.back();
+          freeBuffers.pop_back();
+        }
+        threads.setLocalData(new TraceThread(buffer));
+      }
+      return threads.localData()->buffer;
+    }
+
+    void releaseBuffer(TraceBuffer *buffer) {
+      QMutexLocker locker(&mutex);
+      freeBuffers.push_back(buffer);
+    }
+
+    // escapes the characters json does not allow in strings
+    static Ogre::String escape(const Ogre::String &text) {
+      Ogre::String result;
+      for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = text[i];
+        if (c == '"' || c == '\\') {
+          result += '\\';
+          result += c;
+        } else if (c < 0x20) {
+          char code[8];
+          sprintf(code, "\\u%04x", c);
+          result += code;
+        } else {
+          result += c;
+        }
+      }
+      return result;
+    }
+
+    bool enabled;
+    QElapsedTimer timer;
+    // guards the lists of the buffers, the buffers are never deleted and their index is the thread id of the trace
+    QMutex mutex;
+    std::vector<TraceBuffer *> buffers;
+    std::vector<TraceBuffer *> freeBuffers;
+    QThreadStorage<TraceThread *> threads;
+  };
+
+  static TracePrivate &trace() {
+    // never destroyed, threads may give their buffers back after the static objects have been destroyed
+    static TracePrivate *d = new TracePrivate();
+    return *d;
+  }
+
+  TraceThread::~TraceThread() {
+    trace().releaseBuffer(buffer);
+  }
+
+  void Trace::start() {
+    TracePrivate &d = trace();
+    {
+      QMutexLocker locker(&d.mutex);
+      for (size_t i = 0; i < d.buffers.size(); ++i) {
+        QMutexLocker bufferLocker(&d.buffers.at(i)->mutex);
+        d.buffers.at(i)->events.clear();
+      }
+    }
+    d.timer.start();
+    d.enabled = true;
+  }
+
+  void Trace::stop() {
+    trace().enabled = false;
+  }
+
+  const bool Trace::isEnabled() {
+    return trace().enabled;
+  }
+
+  const qint64 Trace::now() {
+    return trace().timer.nsecsElapsed() / 1000;
+  }
+
+  void Trace::record(const char *category, const char *name, const Ogre::String &detail, const qint64 begin, const qint64 end) {
+    TracePrivate &d = trace();
+    if (!d.enabled)
+      return;
+    // only start and write contend for the lock of the buffer of a thread
+    TraceBuffer *buffer = d.buffer();
+    QMutexLocker locker(&buffer->mutex);
+    buffer->events.push_back(TraceEvent(category, name, detail, begin, end));
+  }
+
+  const bool Trace::write(const Ogre::String &path) {
+    TracePrivate &d = trace();
+    QFile file(path.c_str());
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+      return false;
+    QTextStream out(&file);
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    QMutexLocker locker(&d.mutex);
+    for (size_t i = 0; i < d.buffers.size(); ++i) {
+      QMutexLocker bufferLocker(&d.buffers.at(i)->mutex);
+      // name the thread row
+      out << (first ? "" : ",") << endl << QString("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%1,\"args\":{\"name\":\"thread %1\"}}").arg((qulonglong)i);
+      first = false;
+      // write complete events, timestamps and durations are in microseconds
+      for (size_t j = 0; j < d.buffers.at(i)->events.size(); ++j) {
+        const TraceEvent &event = d.buffers.at(i)->events.at(j);
+        out << "," << endl << "{\"name\":\"" << TracePrivate::escape(event.name).c_str() << "\",\"cat\":\"" << event.category
+            << "\",\"ph\":\"X\",\"ts\":" << event.begin << ",\"dur\":" << (event.end - event.begin) << ",\"pid\":1,\"tid\":" << (qulonglong)i;
+        if (!event.detail.empty())
+          out << ",\"args\":{\"detail\":\"" << TracePrivate::escape(event.detail).c_str() << "\"}";
+        out << "}";
+      }
+    }
+    out << endl << "],\"displayTimeUnit\":\"ms\"}" << endl;
+    return true;
+  }
+
+  TraceSpan::TraceSpan(const char *category, const char *name) : category(category), name(name), begin(-1) {
+    if (Trace::isEnabled())
+      begin = Trace::now();
+  }
+
+  TraceSpan::TraceSpan(const char *category, const char *name, const Ogre::String &detail) : category(category), name(name), begin(-1) {
+    // copy the detail only if it will be recorded
+    if (Trace::isEnabled()) {
+      this->detail = detail;
+      begin = Trace::now();
+    }
+  }
+
+  TraceSpan::~TraceSpan() {
+    if (begin >= 0)
+      Trace::record(category, name, detail, begin, Trace::now());
+  }
+}
@@ -0,0 +1,40 @@
+#ifndef AORTTRACE_H
+#define AORTTRACE_H
+
+#include <OGRE/OgrePrerequisites.h>
+
+#include <QtGlobal>
+
+namespace Aort {
+  // records timed spans of the preprocess and render phases per thread, written in the chrome trace event format
+  // which chrome://tracing and perfetto can show as a timeline
+  class Trace {
+  public:
+    // clears recorded spans and starts recording, spans may be recorded from any thread
+    static void start();
+    static void stop();
+    static const bool isEnabled();
+
+    // microseconds since start
+    static const qint64 now();
+    static void record(const char *category, const char *name, const Ogre::String &detail, const qint64 begin, const qint64 end);
+
+    static const bool write(const Ogre::String &path);
+  };
+
+  // records a span from its construction to its destruction, does nothing if tracing is not enabled
+  class TraceSpan {
+  public:
+    TraceSpan(const char *category, const char *name);
+    TraceSpan(const char *category, const char *name, const Ogre::String &detail);
+    ~TraceSpan();
+
+  private:
+    const char *category;
+    const char *name;
+    Ogre::String detail;
+    qint64 begin;
+  };
+}
+
+#endif // AORTTRACE_H
@@ -1,6 +1,7 @@
 #include "AortTriangle.h"
 
 #include "AortMaterial.h"
+#include "AortMesh.h"
 
 #include <OGRE/OgreColourValue.h>
 #include <OGRE/OgreMath.h>
@@ -13,116 +14,83 @@
 #include <math.h>
 
 namespace Aort {
-  class TrianglePrivate {
-  public:
-    TrianglePrivate() : material(0) {
-    }
-    ~TrianglePrivate() {
-    }
-
-    Ogre::Vector3 positions[3];
-    Ogre::Vector3 normals[3];
-    Ogre::Vector2 texCoords[3];
-    Ogre::Vector3 normal;
-    Material *material;
-    Ogre::AxisAlignedBox aabb;
-    // intersection
-    Ogre::Vector3 b;
-    Ogre::Vector3 c;
-    Ogre::Real inv_det;
-    int axis;
-    int uAxis;
-    int vAxis;
-  };
-
-  Triangle::Triangle(const Ogre::Vector3 &p1, const Ogre::Vector3 &p2, const Ogre::Vector3 &p3,
-                     const Ogre::Vector3 &n1, const Ogre::Vector3 &n2, const Ogre::Vector3 &n3,
-                     const Ogre::Vector2 &uv1, const Ogre::Vector2 &uv2, const Ogre::Vector2 &uv3,
-                     Material *material) : d(new TrianglePrivate()) {
-    // vertex positions
-    d->positions[0] = p1;
-    d->positions[1] = p2;
-    d->positions[2] = p3;
-    // calculate aabb
-    d->aabb.merge(p1);
-    d->aabb.merge(p2);
-    d->aabb.merge(p3);
-    // face normal
-    d->normal = Ogre::Math::calculateBasicFaceNormal(p1, p2, p3);
-    // vertex normals
-    d->normals[0] = (n1 == Ogre::Vector3::ZERO) ? d->normal : n1;
-    d->normals[1] = (n2 == Ogre::Vector3::ZERO) ? d->normal : n2;
-    d->normals[2] = (n3 == Ogre::Vector3::ZERO) ? d->normal : n3;
-    // texture coordinates
-    d->texCoords[0] = uv1;
-    d->texCoords[1] = uv2;
-    d->texCoords[2] = uv3;
-    // material
-    d->material = material;
-    // precompute some values
-    d->b = d->positions[2] - d->positions[0];
-    d->c = d->positions[1] - d->positions[0];
-    if (fabs(d->normal.x) > fabs(d->normal.y)) {
-      if (fabs(d->normal.x) > fabs(d->normal.z))
-        d->axis = 0;
-      else
-        d->axis = 2;
-    } else {
-      if (fabs(d->normal.y) > fabs(d->normal.z))
-        d->axis = 1;
-      else
-        d->axis = 2;
-    }
-    d->uAxis = (d->axis + 1) % 3;
-    d->vAxis = (d->axis + 2) % 3;
-    d->inv_det = 1.0f / (d->b[d->uAxis] * d->c[d->vAxis] - d->b[d->vAxis] * d->c[d->uAxis]);
+  Triangle::Triangle() : mesh(0), index(0) {
   }
 
-  Triangle::~Triangle() {
-    delete d;
+  Triangle::Triangle(const Mesh *mesh, const Ogre::uint32 index) : mesh(mesh), index(index) {
   }
 
   const Ogre::Vector3 Triangle::position(const int i) const {
-    return d->positions[i];
+    return mesh->position(index, i);
   }
 
   const Ogre::Vector3 Triangle::normal(const Ogre::Real u, const Ogre::Real v) const {
-    return d->normals[0] * (1 - u - v) + d->normals[1] * u + d->normals[2] * v;
+    Ogre::Vector3 n1 = mesh->normal(index, 0);
+    Ogre::Vector3 n2 = mesh->normal(index, 1);
+    Ogre::Vector3 n3 = mesh->normal(index, 2);
+    // use face normal for the vertices without a normal
+    if (n1 == Ogre::Vector3::ZERO || n2 == Ogre::Vector3::ZERO || n3 == Ogre::Vector3::ZERO) {
+      Ogre::Vector3 normal = Ogre::Math::calculateBasicFaceNormal(mesh->position(index, 0), mesh->position(index, 1), mesh->position(index, 2));
+      if (n1 == Ogre::Vector3::ZERO)
+        n1 = normal;
+      if (n2 == Ogre::Vector3::ZERO)
+        n2 = normal;
+      if (n3 == Ogre::Vector3::ZERO)
+        n3 = normal;
+    }
+    return n1 * (1 - u - v) + n2 * u + n3 * v;
   }
 
   const Ogre::Vector2 Triangle::texCoord(const Ogre::Real u, const Ogre::Real v) const {
-    return d->texCoords[0] * (1 - u - v) + d->texCoords[1] * u + d->texCoords[2] * v;
+    return mesh->texCoord(index, 0) * (1 - u - v) + mesh->texCoord(index, 1) * u + mesh->texCoord(index, 2) * v;
   }
 
   const Ogre::Vector3 Triangle::getMinimum() const {
-    return d->aabb.getMinimum();
+    Ogre::Vector3 minimum = mesh->position(index, 0);
+    minimum.makeFloor(mesh->position(index, 1));
+    minimum.makeFloor(mesh->position(index, 2));
+    return minimum;
   }
 
   const Ogre::Vector3 Triangle::getMaximum() const {
-    return d->aabb.getMaximum();
+    Ogre::Vector3 maximum = mesh->position(index, 0);
+    maximum.makeCeil(mesh->position(index, 1));
+    maximum.makeCeil(mesh->position(index, 2));
+    return maximum;
   }
 
   const Material *Triangle::getMaterial() const {
-    return d->material;
+    return mesh->material(index);
   }
 
   const bool Triangle::intersects(const Ogre::Ray &ray, Ogre::Real &t, Ogre::Real &u, Ogre::Real &v) const {
-    t = -(ray.getOrigin() - d->positions[0]).dotProduct(d->normal) / ray.getDirection().dotProduct(d->normal);
-    if (t < std::numeric_limits<float>::epsilon())
+    const Ogre::Vector3 p1 = mesh->position(index, 0);
+    // calculate edges
+    Ogre::Vector3 c = mesh->position(index, 1) - p1;
+    Ogre::Vector3 b = mesh->position(index, 2) - p1;
+    // calculate determinant, zero if ray is parallel to the triangle plane
+    Ogre::Vector3 p = ray.getDirection().crossProduct(b);
+    Ogre::Real det = c.dotProduct(p);
+    if (det == 0.0f)
       return false;
-    // calculate hit point
-    Ogre::Vector3 hit = ray.getPoint(t) - d->positions[0];
+    Ogre::Real inv_det = 1.0f / det;
     // calculate u
-    u = (d->b[d->uAxis] * hit[d->vAxis] - d->b[d->vAxis] * hit[d->uAxis]) * d->inv_det;
-    if (u < 0)
+    Ogre::Vector3 s = ray.getOrigin() - p1;
+    u = s.dotProduct(p) * inv_det;
+    if (!(u >= 0))
       return false;
     // calculate v
-    v = (d->c[d->vAxis] * hit[d->uAxis] - d->c[d->uAxis] * hit[d->vAxis]) * d->inv_det;
-    if (v < 0)
+    Ogre::Vector3 q = s.crossProduct(c);
+    v = ray.getDirection().dotProduct(q) * inv_det;
+    if (!(v >= 0))
       return false;
     // u + v should be less than or equal to 1
     if (u + v > 1)
       return false;
+    // calculate t
+    t = b.dotProduct(q) * inv_det;
+    if (t < std::numeric_limits<float>::epsilon())
+      return false;
     // ray intersects triangle
     return true;
   }
@@ -5,16 +5,12 @@
 
 namespace Aort {
   class Material;
-
-  class TrianglePrivate;
+  class Mesh;
 
   class Triangle {
   public:
-    Triangle(const Ogre::Vector3 &p1, const Ogre::Vector3 &p2, const Ogre::Vector3 &p3,
-             const Ogre::Vector3 &n1, const Ogre::Vector3 &n2, const Ogre::Vector3 &n3,
-             const Ogre::Vector2 &uv1, const Ogre::Vector2 &uv2, const Ogre::Vector2 &uv3,
-             Material *material);
-    ~Triangle();
+    Triangle();
+    Triangle(const Mesh *mesh, const Ogre::uint32 index);
 
     const Ogre::Vector3 position(const int i) const;
     const Ogre::Vector3 normal(const Ogre::Real u, const Ogre::Real v) const;
@@ -28,7 +24,8 @@ namespace Aort {
     const bool intersects(const Ogre::Ray &ray, Ogre::Real &t, Ogre::Real &u, Ogre::Real &v) const;
 
   private:
-    TrianglePrivate *d;
+    const Mesh *mesh;
+    Ogre::uint32 index;
   };
 }
 
@@ -0,0 +1,249 @@
+#include "AortVisibilityBuffer.h"
+
+#include "AortTriangle.h"
+
+#include <OGRE/OgreCamera.h>
+#include <OGRE/OgreMatrix4.h>
+#include <OGRE/OgreVector2.h>
+#include <OGRE/OgreVector4.h>
+
+#include <float.h>
+#include <math.h>
+
+#include <algorithm>
+#include <limits>
+
+#ifndef NO_OMP
+#include <omp.h>
+#endif // !NO_OMP
+
+// rows of the region in a band of triangles rasterized by one thread
+#define BIN_HEIGHT (8)
+// horizontal slices of the view the projected triangles are sorted into, so that a region only visits the triangles
+// of the slices it overlaps
+#define SLICE_COUNT (1024)
+
+namespace Aort {
+  // twice the signed area of the triangle of the edge and the point, the endpoints are taken in a fixed order so that
+  // the two triangles of an edge get exactly opposite values and a sample on the edge is covered by at least one
+  static Ogre::Real edge(const Ogre::Real ax, const Ogre::Real ay, const Ogre::Real bx, const Ogre::Real by, const Ogre::Real px, const Ogre::Real py) {
+    if (ax < bx || (ax == bx && ay < by))
+      return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+    return -((ax - bx) * (py - by) - (ay - by) * (px - bx));
+  }
+
+  // cell of the grid whose sample lies at the coordinate, the renderer adds an epsilon to the viewport coordinates of
+  // its rays, the cell is clamped so that far away vertices do not overflow
+  static long cellAt(const Ogre::Real viewport, const int size, const Ogre::Real offset) {
+    Ogre::Real cell = (viewport - std::numeric_limits<float>::epsilon()) * size - offset;
+    return long(floor(Ogre::Math::Clamp(cell, Ogre::Real(-1), Ogre::Real(size + 1))));
+  }
+
+  // slice of the view at the y coordinate in device coordinates, clamped so that triangles reaching out of the view
+  // are kept in the outermost slices
+  static int sliceAt(const Ogre::Real y) {
+    return int(Ogre::Math::Clamp(floor((y + 1.0f) * 0.5f * SLICE_COUNT), 0.0, double(SLICE_COUNT - 1)));
+  }
+
+  VisibilityBuffer::VisibilityBuffer() : width(0), height(0), region(0, 0, 0, 0), offsetX(0.0f), offsetY(0.0f) {
+  }
+
+  void VisibilityBuffer::setup(const Ogre::Camera *camera, const Triangle *triangles, const size_t count) {
+    screenTriangles.clear();
+    // the camera inverts the same matrices for its rays
+    Ogre::Matrix4 viewProjection = camera->getProjectionMatrix() * camera->getViewMatrix(true);
+    const Ogre::Vector2 corners[3] = { Ogre::Vector2(0.0f, 0.0f), Ogre::Vector2(1.0f, 0.0f), Ogre::Vector2(0.0f, 1.0f) };
+    for (size_t i = 0; i < count; ++i) {
+      Ogre::Vector4 positions[3];
+      for (int j = 0; j < 3; ++j)
+        positions[j] = viewProjection * Ogre::Vector4(triangles[i].position(j));
+      // drop the triangles beyond one of the sides of the view
+      bool outside = false;
+      for (int axis = 0; axis < 2 && !outside; ++axis) {
+        bool beyondMaximum = true;
+        bool beyondMinimum = true;
+        for (int j = 0; j < 3; ++j) {
+          beyondMaximum = beyondMaximum && positions[j][axis] > positions[j].w;
+          beyondMinimum = beyondMinimum && positions[j][axis] < -positions[j].w;
+        }
+        outside = beyondMaximum || beyondMinimum;
+      }
+      if (outside)
+        continue;
+      // distances to the near plane, the rays start on it
+      Ogre::Real distances[3];
+      int inside = 0;
+      for (int j = 0; j < 3; ++j) {
+        distances[j] = positions[j].z + positions[j].w;
+        if (distances[j] >= 0.0f)
+          inside++;
+      }
+      if (inside == 0)
+        continue;
+      if (inside == 3) {
+        addTriangle(positions, corners, i);
+        continue;
+      }
+      // clip the triangle at the near plane, one vertex in front of it leaves a quad
+      Ogre::Vector4 clipped[4];
+      Ogre::Vector2 coordinates[4];
+      int clippedCount = 0;
+      for (int j = 0; j < 3; ++j) {
+        int k = (j + 1) % 3;
+        if (distances[j] >= 0.0f) {
+          clipped[clippedCount] = positions[j];
+          coordinates[clippedCount] = corners[j];
+          clippedCount++;
+        }
+        if ((distances[j] >= 0.0f) != (distances[k] >= 0.0f)) {
+          // interpolate from the vertex in front of the plane, so that both triangles of the edge get the same vertex
+          int a = (distances[j] >= 0.0f) ? j : k;
+          int b = j + k - a;
+          Ogre::Real s = distances[a] / (distances[a] - distances[b]);
+          clipped[clippedCount] = positions[a] + (positions[b] - positions[a]) * s;
+          coordinates[clippedCount] = corners[a] + (corners[b] - corners[a]) * s;
+          clippedCount++;
+        }
+      }
+      addTriangle(clipped, coordinates, i);
+      if (clippedCount == 4) {
+        const Ogre::Vector4 fanPositions[3] = { clipped[0], clipped[2], clipped[3] };
+        const Ogre::Vector2 fanCoordinates[3] = { coordinates[0], coordinates[2], coordinates[3] };
+        addTriangle(fanPositions, fanCoordinates, i);
+      }
+    }
+    // sort the triangles into the slices their bounds overlap
+    slices.resize(SLICE_COUNT);
+    for (size_t i = 0; i < slices.size(); ++i)
+      slices[i].clear();
+    for (size_t i = 0; i < screenTriangles.size(); ++i)
+      for (int slice = sliceAt(screenTriangles.at(i).minimumY); slice <= sliceAt(screenTriangles.at(i).maximumY); ++slice)
+        slices[slice].push_back(i);
+  }
+
+  void VisibilityBuffer::addTriangle(const Ogre::Vector4 *positions, const Ogre::Vector2 *coordinates, const Ogre::uint32 index) {
+    ScreenTriangle triangle;
+    for (int i = 0; i < 3; ++i) {
+      triangle.inverseW[i] = 1.0f / positions[i].w;
+      triangle.x[i] = positions[i].x * triangle.inverseW[i];
+      triangle.y[i] = positions[i].y * triangle.inverseW[i];
+      triangle.z[i] = positions[i].z * triangle.inverseW[i];
+      triangle.u[i] = coordinates[i].x * triangle.inverseW[i];
+      triangle.v[i] = coordinates[i].y * triangle.inverseW[i];
+    }
+    // triangles seen edge on cover no sample, the comparison also drops the areas that are not finite
+    Ogre::Real area = edge(triangle.x[0], triangle.y[0], triangle.x[1], triangle.y[1], triangle.x[2], triangle.y[2]);
+    if (!(Ogre::Math::Abs(area) > 0.0f && Ogre::Math::Abs(area) < FLT_MAX))
+      return;
+    triangle.inverseArea = 1.0f / area;
+    triangle.minimumX = std::min(triangle.x[0], std::min(triangle.x[1], triangle.x[2]));
+    triangle.maximumX = std::max(triangle.x[0], std::max(triangle.x[1], triangle.x[2]));
+    triangle.minimumY = std::min(triangle.y[0], std::min(triangle.y[1], triangle.y[2]));
+    triangle.maximumY = std::max(triangle.y[0], std::max(triangle.y[1], triangle.y[2]));
+    triangle.index = index;
+    screenTriangles.push_back(triangle);
+  }
+
+  void VisibilityBuffer::rasterize(const int width, const int height, const Ogre::Rect &region, const Ogre::Real offsetX, const Ogre::Real offsetY) {
+    this->width = width;
+    this->height = height;
+    this->region = region;
+    this->offsetX = offsetX;
+    this->offsetY = offsetY;
+    VisibilitySample background;
+    background.triangle = NO_TRIANGLE;
+    background.u = 0.0f;
+    background.v = 0.0f;
+    samples.assign(region.width() * region.height(), background);
+    depths.assign(region.width() * region.height(), FLT_MAX);
+    // sort the triangles into the bands of rows their bounds overlap
+    size_t binCount = (region.height() + BIN_HEIGHT - 1) / BIN_HEIGHT;
+    bins.resize(binCount);
+    for (size_t i = 0; i < binCount; ++i)
+      bins[i].clear();
+    if (slices.empty())
+      return;
+    // only the slices of the rows of the region are visited, with a row of margin on both sides, a triangle in several
+    // of them is taken from the first one
+    int firstSlice = sliceAt(1.0f - 2.0f * (region.bottom + 1 + offsetY) / height);
+    int lastSlice = sliceAt(1.0f - 2.0f * (region.top - 1 + offsetY) / height);
+    for (int slice = firstSlice; slice <= lastSlice; ++slice) {
+      for (size_t j = 0; j < slices[slice].size(); ++j) {
+        Ogre::uint32 i = slices[slice][j];
+        const ScreenTriangle &triangle = screenTriangles.at(i);
+        if (std::max(sliceAt(triangle.minimumY), firstSlice) != slice)
+          continue;
+        // the rows grow downwards, against the y axis of the device coordinates
+        long top = std::max(long(region.top), cellAt((1.0f - triangle.maximumY) * 0.5f, height, offsetY));
+        long bottom = std::min(long(region.bottom), cellAt((1.0f - triangle.minimumY) * 0.5f, height, offsetY) + 2);
+        long left = std::max(long(region.left), cellAt((triangle.minimumX + 1.0f) * 0.5f, width, offsetX));
+        long right = std::min(long(region.right), cellAt((triangle.maximumX + 1.0f) * 0.5f, width, offsetX) + 2);
+        if (top >= bottom || left >= right)
+          continue;
+        for (long bin = (top - region.top) / BIN_HEIGHT; bin <= (bottom - 1 - region.top) / BIN_HEIGHT; ++bin)
+          bins[bin].push_back(i);
+      }
+    }
+    // bands cover distinct samples, so that they can be rasterized in parallel
+#ifndef NO_OMP
+    #pragma omp parallel for schedule(dynamic)
+#endif // !NO_OMP
+    for (int i = 0; i < int(binCount); ++i) {
+      long top = region.top + i * BIN_HEIGHT;
+      long bottom = std::min(long(region.bottom), top + BIN_HEIGHT);
+      for (size_t j = 0; j < bins[i].size(); ++j)
+        rasterize(screenTriangles[bins[i][j]], top, bottom);
+    }
+  }
+
+  void VisibilityBuffer::rasterize(const ScreenTriangle &triangle, const long top, const long bottom) {
+    const Ogre::Real *x = triangle.x;
+    const Ogre::Real *y = triangle.y;
+    long first = std::max(top, cellAt((1.0f - triangle.maximumY) * 0.5f, height, offsetY));
+    long last = std::min(bottom, cellAt((1.0f - triangle.minimumY) * 0.5f, height, offsetY) + 2);
+    long left = std::max(long(region.left), cellAt((triangle.minimumX + 1.0f) * 0.5f, width, offsetX));
+    long right = std::min(long(region.right), cellAt((triangle.maximumX + 1.0f) * 0.5f, width, offsetX) + 2);
+    for (long row = first; row < last; ++row) {
+      // device coordinates of the samples, like the viewport coordinates of the camera rays
+      Ogre::Real py = 1.0f - 2.0f * ((row + offsetY) / height + std::numeric_limits<float>::epsilon());
+      for (long column = left; column < right; ++column) {
+        Ogre::Real px = 2.0f * ((column + offsetX) / width + std::numeric_limits<float>::epsilon()) - 1.0f;
+        // screen space barycentric coordinates, a sample is covered if none is negative
+        Ogre::Real b0 = edge(x[1], y[1], x[2], y[2], px, py) * triangle.inverseArea;
+        if (b0 < 0.0f)
+          continue;
+        Ogre::Real b1 = edge(x[2], y[2], x[0], y[0], px, py) * triangle.inverseArea;
+        if (b1 < 0.0f)
+          continue;
+        Ogre::Real b2 = edge(x[0], y[0], x[1], y[1], px, py) * triangle.inverseArea;
+        if (b2 < 0.0f)
+          continue;
+        // depth is linear in screen space, the nearer triangle wins
+        size_t index = (row - region.top) * region.width() + (column - region.left);
+        Ogre::Real depth = b0 * triangle.z[0] + b1 * triangle.z[1] + b2 * triangle.z[2];
+        if (!(depth < depths[index]))
+          continue;
+        depths[index] = depth;
+        // barycentric coordinates on the triangle, interpolated perspective correct
+        Ogre::Real inverseW = 1.0f / (b0 * triangle.inverseW[0] + b1 * triangle.inverseW[1] + b2 * triangle.inverseW[2]);
+        VisibilitySample &sample = samples[index];
+        sample.triangle = triangle.index;
+        sample.u = (b0 * triangle.u[0] + b1 * triangle.u[1] + b2 * triangle.u[2]) * inverseW;
+        sample.v = (b0 * triangle.v[0] + b1 * triangle.v[1] + b2 * triangle.v[2]) * inverseW;
+      }
+    }
+  }
+
+  const VisibilitySample &VisibilityBuffer::at(const int x, const int y) const {
+    return samples[(y - region.top) * region.width() + (x - region.left)];
+  }
+
+  const size_t VisibilityBuffer::memoryUsage() const {
+    size_t memoryUsage = screenTriangles.capacity() * sizeof(ScreenTriangle) + samples.capacity() * sizeof(VisibilitySample) + depths.capacity() * sizeof(Ogre::Real);
+    for (size_t i = 0; i < bins.size(); ++i)
+      memoryUsage += bins.at(i).capacity() * sizeof(Ogre::uint32);
+    for (size_t i = 0; i < slices.size(); ++i)
+      memoryUsage += slices.at(i).capacity() * sizeof(Ogre::uint32);
+    return memoryUsage;
+  }
+}
@@ -0,0 +1,85 @@
+#ifndef AORTVISIBILITYBUFFER_H
+#define AORTVISIBILITYBUFFER_H
+
+#include <OGRE/OgreCommon.h>
+#include <OGRE/OgrePrerequisites.h>
+
+#include <vector>
+
+// index of the triangle of the samples that see the background
+#define NO_TRIANGLE (0xffffffff)
+
+namespace Ogre {
+  class Camera;
+}
+
+namespace Aort {
+  class Triangle;
+
+  // nearest triangle of a sample and the barycentric coordinates of the sample on it, u belongs to the second and
+  // v to the third vertex like in the ray intersection
+  class VisibilitySample {
+  public:
+    Ogre::uint32 triangle;
+    Ogre::Real u;
+    Ogre::Real v;
+  };
+
+  // primary visibility of a camera rasterized on the cpu, the triangles are projected once for the camera and then
+  // rasterized for each pass of samples, the samples lie where the camera rays of the renderer go through the viewport
+  // and the triangles are clipped at the near plane where the rays start, so that the nearest triangle of a sample is
+  // the one its ray would hit, edges shared by two triangles leave no gaps between them
+  class VisibilityBuffer {
+  public:
+    VisibilityBuffer();
+
+    // projects the triangles through the camera and drops the ones outside its view
+    void setup(const Ogre::Camera *camera, const Triangle *triangles, const size_t count);
+    // finds the nearest triangle of the samples inside the region of a grid of width by height cells, right and bottom
+    // are exclusive, each sample lies at the offset inside its cell, so that sample x is at (x + offsetX) / width
+    void rasterize(const int width, const int height, const Ogre::Rect &region, const Ogre::Real offsetX, const Ogre::Real offsetY);
+
+    // sample of the cell at x and y of the grid, which have to be inside the region of the last rasterize
+    const VisibilitySample &at(const int x, const int y) const;
+
+    const size_t memoryUsage() const;
+
+  private:
+    // a triangle projected into normalized device coordinates, the barycentric coordinates of the vertices are
+    // divided by w so that they are interpolated perspective correct
+    class ScreenTriangle {
+    public:
+      Ogre::Real x[3];
+      Ogre::Real y[3];
+      Ogre::Real z[3];
+      Ogre::Real inverseW[3];
+      Ogre::Real u[3];
+      Ogre::Real v[3];
+      Ogre::Real inverseArea;
+      Ogre::Real minimumX;
+      Ogre::Real maximumX;
+      Ogre::Real minimumY;
+      Ogre::Real maximumY;
+      Ogre::uint32 index;
+    };
+
+    void addTriangle(const Ogre::Vector4 *positions, const Ogre::Vector2 *coordinates, const Ogre::uint32 index);
+    void rasterize(const ScreenTriangle &triangle, const long top, const long bottom);
+
+    std::vector<ScreenTriangle> screenTriangles;
+    // triangles overlapping each horizontal slice of the view, sorted once per setup
+    std::vector<std::vector<Ogre::uint32> > slices;
+    // triangles overlapping each band of rows of the region, the bands are rasterized in parallel
+    std::vector<std::vector<Ogre::uint32> > bins;
+    int width;
+    int height;
+    Ogre::Rect region;
+    Ogre::Real offsetX;
+    Ogre::Real offsetY;
+    // samples and depths of the region in row order
+    std::vector<VisibilitySample> samples;
+    std::vector<Ogre::Real> depths;
+  };
+}
+
+#endif // AORTVISIBILITYBUFFER_H
@@ -1,19 +1,30 @@
 #include "MainWindow.h"
 
+#include "AortImageWriter.h"
 #include "AortRenderer.h"
+#include "AortSequence.h"
 #include "OgreManager.h"
+#include "RenderQueue.h"
 #include "TranslationManager.h"
 
+#include <QCoreApplication>
 #include <QDateTime>
-#include <QDebug>
 #include <QDesktopServices>
+#include <QDockWidget>
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QInputDialog>
+#include <QLabel>
 #include <QLocale>
 #include <QMenu>
 #include <QMessageBox>
 #include <QMouseEvent>
+#include <QProgressDialog>
+#include <QScrollArea>
 #include <QSettings>
+#include <QStatusBar>
 #include <QWheelEvent>
+#include <QTime>
 #include <QTimer>
 #include <QToolButton>
 
@@ -22,9 +33,55 @@
 #include <OGRE/OgreMeshManager.h>
 #include <OGRE/OgreRenderWindow.h>
 #include <OGRE/OgreSceneManager.h>
+#include <OGRE/OgreSceneNode.h>
+#include <OGRE/OgreVector2.h>
 #include <OGRE/OgreViewport.h>
 
-MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), Ui::MainWindow(), mTranslationManager(new TranslationManager()), objectNode(0), camera(0), viewport(0) {
+// circles the camera around a centre at its current distance and height, one revolution over the frames
+class TurntableSource : public Aort::SequenceSource {
+public:
+  TurntableSource(Ogre::Camera *camera, const Ogre::Vector3 &centre, const int frameCount, const QString &path, QProgressDialog *progress) :
+    camera(camera), centre(centre), frameCount(frameCount), path(path), progress(progress) {
+    Ogre::Vector3 offset = camera->getPosition() - centre;
+    radius = Ogre::Vector2(offset.x, offset.z).length();
+    height = offset.y;
+    startAngle = Ogre::Math::ATan2(offset.x, offset.z).valueRadians();
+  }
+
+  // the sequence runs on the gui thread, so the events are processed between the frames to repaint the window and
+  // to take the cancel button of the progress dialog
+  const bool setFrame(const int frame) {
+    progress->setValue(frame);
+    QCoreApplication::processEvents();
+    if (progress->wasCanceled())
+      return false;
+    Ogre::Real angle = startAngle + Ogre::Math::TWO_PI * frame / frameCount;
+    camera->setPosition(centre + Ogre::Vector3(Ogre::Math::Sin(angle) * radius, height, Ogre::Math::Cos(angle) * radius));
+    camera->lookAt(centre);
+    return true;
+  }
+
+  Aort::ImageWriter *createWriter(const int frame) {
+    // number the frames before the extension
+    QFileInfo info(path);
+    QString framePath = info.path() + "/" + info.completeBaseName() + QString("-%1.").arg(frame, 4, 10, QChar('0')) + info.suffix();
+    Aort::ImageFormat format;
+    Aort::ImageFileWriter::formatFromPath(framePath.toStdString(), format);
+    return new Aort::ImageFileWriter(framePath.toStdString(), format);
+  }
+
+private:
+  Ogre::Camera *camera;
+  Ogre::Vector3 centre;
+  int frameCount;
+  QString path;
+  QProgressDialog *progress;
+  Ogre::Real radius;
+  Ogre::Real height;
+  Ogre::Real startAngle;
+};
+
+MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), Ui::MainWindow(), mTranslationManager(new TranslationManager()), renderQueue(new RenderQueue(this)), previewLabel(new QLabel()), objectNode(0), camera(0), viewport(0) {
   setupUi(this);
   // set window title
   setWindowTitle(tr("Untitled - Aort"));
@@ -53,7 +110,9 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), Ui::MainWindow(),
   connect(actionGroupLanguages, SIGNAL(triggered(QAction*)), this, SLOT(translate(QAction*)));
   // main window action handlers
   connect(actionOpen, SIGNAL(triggered()), this, SLOT(open()));
+  connect(actionExport, SIGNAL(triggered()), this, SLOT(exportScene()));
   connect(actionRender, SIGNAL(triggered()), this, SLOT(render()));
+  connect(actionTurntable, SIGNAL(triggered()), this, SLOT(renderTurntable()));
   connect(actionHelp, SIGNAL(triggered()), this, SLOT(help()));
   connect(actionAbout, SIGNAL(triggered()), this, SLOT(about()));
   // ogre widget handlers
@@ -61,11 +120,27 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), Ui::MainWindow(),
   connect(ogreWidget, SIGNAL(mousePressed(QMouseEvent*)), this, SLOT(mousePressed(QMouseEvent*)));
   connect(ogreWidget, SIGNAL(mouseMoved(QMouseEvent*)), this, SLOT(mouseMoved(QMouseEvent*)));
   connect(ogreWidget, SIGNAL(wheelMoved(QWheelEvent*)), this, SLOT(wheelMoved(QWheelEvent*)));
+  // render queue handlers
+  connect(renderQueue, SIGNAL(started(int)), this, SLOT(renderStarted(int)));
+  connect(renderQueue, SIGNAL(progress(int,int,int)), this, SLOT(renderProgress(int,int,int)));
+  connect(renderQueue, SIGNAL(imageUpdated(int,QImage)), this, SLOT(renderImageUpdated(int,QImage)));
+  connect(renderQueue, SIGNAL(finished(int,bool,QString)), this, SLOT(renderFinished(int,bool,QString)));
+  // show the image of the running render in a dock
+  QScrollArea *previewArea = new QScrollArea();
+  previewArea->setWidget(previewLabel);
+  previewArea->setWidgetResizable(true);
+  previewLabel->setAlignment(Qt::AlignCenter);
+  QDockWidget *previewDock = new QDockWidget(tr("Render"), this);
+  previewDock->setObjectName("previewDock");
+  previewDock->setWidget(previewArea);
+  addDockWidget(Qt::RightDockWidgetArea, previewDock);
   // initialize ogre manager
   new OgreManager(this);
 }
 
 MainWindow::~MainWindow() {
+  // wait for the running render, the queue destroys its cameras before ogre is shut down
+  delete renderQueue;
   delete mTranslationManager;
 }
 
@@ -110,17 +185,52 @@ void MainWindow::open() {
   // return if open canceled
   if (path.isNull())
     return;
+  // native scene files contain several instances
+  if (path.toLower().endsWith(".aort")) {
+    // load the scene into a new node
+    Ogre::SceneNode *sceneNode = OgreManager::instance()->sceneManager()->createSceneNode();
+    if (!OgreManager::instance()->loadScene(path, sceneNode)) {
+      OgreManager::instance()->sceneManager()->destroySceneNode(sceneNode);
+      QMessageBox::warning(this, tr("Open File"), tr("Could not load %1.").arg(path));
+      return;
+    }
+    // update window title
+    setWindowTitle(QString("%1 - Aort").arg(path));
+    // delete previous entities
+    objectNode->removeAndDestroyAllChildren();
+    // attach the new scene, instances keep their saved transforms
+    objectNode->addChild(sceneNode);
+    return;
+  }
+  // load the new entity
+  Ogre::Entity *object = OgreManager::instance()->loadMesh(path);
+  if (!object) {
+    QMessageBox::warning(this, tr("Open File"), tr("Could not load %1.").arg(path));
+    return;
+  }
   // update window title
   setWindowTitle(QString("%1 - Aort").arg(path));
   // delete previous entities
   objectNode->removeAndDestroyAllChildren();
-  // load and attach the new entity
-  Ogre::Entity *object = OgreManager::instance()->loadMesh(path);
+  // attach the new entity
   objectNode->createChildSceneNode()->attachObject(object);
   // put object just on the ground
   object->getParentSceneNode()->translate(0, -(object->getWorldBoundingBox(true).getMinimum().y + object->getWorldBoundingBox(true).getSize().y * Ogre::MeshManager::getSingletonPtr()->getBoundsPaddingFactor()), 0.0f);
 }
 
+void MainWindow::exportScene() {
+  QString path = QFileDialog::getSaveFileName(this, tr("Export Scene"), QDesktopServices::storageLocation(QDesktopServices::DocumentsLocation), tr("Aort Scenes (*.aort)"));
+  // return if export canceled
+  if (path.isNull())
+    return;
+  // add the extension if missing
+  if (!path.toLower().endsWith(".aort"))
+    path.append(".aort");
+  // write loaded objects
+  if (!OgreManager::instance()->saveScene(path, objectNode))
+    QMessageBox::warning(this, tr("Export Scene"), tr("Could not save %1.").arg(path));
+}
+
 void MainWindow::translate(QAction *action) {
   mTranslationManager->loadTranslation(action->data().toString());
 }
@@ -130,26 +240,93 @@ void MainWindow::render() {
   int width = 800;
   int height = 545;
   int fsaa = 1;
-  // create renderer
-  Aort::Renderer *renderer = new Aort::Renderer();
-  // do preprocess
-  qDebug() << "Preprocessing finished in" << renderer->preprocess(OgreManager::instance()->sceneManager()->getRootSceneNode()) << "ms";
-  // create buffer
-  uchar *buffer = new uchar[width * fsaa * height * fsaa * 4];
-  // do render
-  int time = renderer->render(camera, width * fsaa, height * fsaa, buffer);
-  // clean up
-  delete renderer;
   // construct default file name
-  QString fileName = QString("render-%1-%2x%3-%4xAA-%5ms.png").arg(QDateTime::currentDateTime().toString("yyyyMMddHHmm")).arg(width).arg(height).arg(fsaa).arg(time);
+  QString fileName = QString("render-%1-%2x%3-%4xAA%5.png").arg(QDateTime::currentDateTime().toString("yyyyMMddHHmm")).arg(width).arg(height).arg(fsaa).arg(actionHeatmap->isChecked() ? "-heatmap" : "");
   // get path from the user
-  QString path = QFileDialog::getSaveFileName(this, tr("Save File"), QDesktopServices::storageLocation(QDesktopServices::DocumentsLocation) + "/" + fileName, tr("Image Files (*.png *.jpg *.jpeg)"));
-  // save image
-  if (!path.isNull())
-    QImage(buffer, width * fsaa, height * fsaa, QImage::Format_ARGB32_Premultiplied).scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation).save(path);
-  // clean up
-  delete buffer;
+  QString path = QFileDialog::getSaveFileName(this, tr("Save File"), QDesktopServices::storageLocation(QDesktopServices::DocumentsLocation) + "/" + fileName, tr("Image Files (*.png *.jpg *.jpeg *.exr *.pfm)"));
+  if (path.isNull())
+    return;
+  // copy the scene and the camera and render them in the background, the scene can be changed meanwhile
+  RenderRequest request;
+  request.path = path;
+  request.width = width;
+  request.height = height;
+  request.supersampling = fsaa;
+  request.heatmap = actionHeatmap->isChecked();
+  renderQueue->enqueue(OgreManager::instance()->sceneManager()->getRootSceneNode(), camera, request);
+  statusBar()->showMessage(tr("%n render(s) queued", "", renderQueue->count()));
+}
+
+void MainWindow::renderTurntable() {
+  // the frames are streamed to the writers, which take colours only
+  if (actionHeatmap->isChecked()) {
+    QMessageBox::warning(this, tr("Render Turntable"), tr("Turntables are rendered in colour, turn off the heatmap first."));
+    return;
+  }
+  // frames have the size of single renders
+  int width = 800;
+  int height = 545;
+  int fsaa = 1;
+  bool ok = false;
+  int frameCount = QInputDialog::getInt(this, tr("Render Turntable"), tr("Frames per turn:"), 36, 1, 3600, 1, &ok);
+  if (!ok)
+    return;
+  // get path from the user, the frames are numbered
+  QString fileName = QString("turntable-%1-%2x%3-%4xAA.png").arg(QDateTime::currentDateTime().toString("yyyyMMddHHmm")).arg(width).arg(height).arg(fsaa);
+  QString path = QFileDialog::getSaveFileName(this, tr("Save Files"), QDesktopServices::storageLocation(QDesktopServices::DocumentsLocation) + "/" + fileName, tr("Image Files (*.png *.exr *.pfm)"));
+  if (path.isNull())
+    return;
+  Aort::ImageFormat format;
+  if (!Aort::ImageFileWriter::formatFromPath(path.toStdString(), format)) {
+    QMessageBox::warning(this, tr("Save Files"), tr("Turntables are saved as png, exr or pfm."));
+    return;
+  }
+  // the frames are extracted on this thread, so the scene is locked while the sequence renders
+  QProgressDialog progress(tr("Rendering turntable..."), tr("Cancel"), 0, frameCount, this);
+  progress.setWindowModality(Qt::WindowModal);
+  Ogre::Vector3 position = camera->getPosition();
+  Ogre::Quaternion orientation = camera->getOrientation();
+  const Ogre::AxisAlignedBox &bounds = objectNode->_getWorldAABB();
+  TurntableSource source(camera, bounds.isFinite() ? bounds.getCenter() : Ogre::Vector3::ZERO, frameCount, path, &progress);
+  Aort::SequenceRenderer sequenceRenderer(OgreManager::instance()->sceneManager()->getRootSceneNode(), camera);
+  QTime time;
+  time.start();
+  int frames = sequenceRenderer.render(&source, 0, frameCount, width, height, fsaa);
+  bool canceled = progress.wasCanceled();
+  progress.setValue(frameCount);
+  // put the camera back
+  camera->setPosition(position);
+  camera->setOrientation(orientation);
+  ogreWidget->update();
+  if (frames < 0)
+    QMessageBox::warning(this, tr("Save Files"), tr("Could not save %1.").arg(path));
+  else if (canceled)
+    statusBar()->showMessage(tr("Turntable canceled after %n frame(s)", "", frames), 5000);
+  else
+    statusBar()->showMessage(tr("Rendered %n frame(s) in %1 ms", "", frames).arg(time.elapsed()), 5000);
+}
+
+void MainWindow::renderStarted(int id) {
+  Q_UNUSED(id);
+  statusBar()->showMessage(tr("Preprocessing, %n render(s) queued", "", renderQueue->count()));
+}
+
+void MainWindow::renderProgress(int id, int rows, int height) {
+  Q_UNUSED(id);
+  statusBar()->showMessage(tr("Rendering %1%, %n render(s) queued", "", renderQueue->count()).arg(rows * 100 / height));
+}
+
+void MainWindow::renderImageUpdated(int id, const QImage &image) {
+  Q_UNUSED(id);
+  previewLabel->setPixmap(QPixmap::fromImage(image));
+}
 
+void MainWindow::renderFinished(int id, bool success, const QString &message) {
+  Q_UNUSED(id);
+  if (success)
+    statusBar()->showMessage(message, 5000);
+  else
+    QMessageBox::warning(this, tr("Save File"), message);
 }
 
 void MainWindow::help() {
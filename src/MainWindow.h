@@ -1,12 +1,15 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include <QImage>
 #include <QMainWindow>
 
 #include <OGRE/OgrePrerequisites.h>
 
 #include "ui_MainWindow.h"
 
+class QLabel;
+class RenderQueue;
 class TranslationManager;
 
 class MainWindow : public QMainWindow, public Ui::MainWindow {
@@ -25,14 +28,22 @@ public slots:
 
 private slots:
   void open();
+  void exportScene();
   void translate(QAction *action);
   void render();
+  void renderTurntable();
   void help();
   void about();
   void windowCreated();
+  void renderStarted(int id);
+  void renderProgress(int id, int rows, int height);
+  void renderImageUpdated(int id, const QImage &image);
+  void renderFinished(int id, bool success, const QString &message);
 
 private:
   TranslationManager *mTranslationManager;
+  RenderQueue *renderQueue;
+  QLabel *previewLabel;
   Ogre::SceneNode *objectNode;
   Ogre::Camera *camera;
   Ogre::Viewport *viewport;
@@ -1,5 +1,11 @@
 #include "OgreManager.h"
 
+#include "AortMaterial.h"
+#include "AortMaterialLibrary.h"
+#include "AortMesh.h"
+#include "AortMeshLibrary.h"
+#include "AortMeshParser.h"
+#include "AortSceneFile.h"
 #include "MainWindow.h"
 
 #include <OGRE/OgreCamera.h>
@@ -11,11 +17,8 @@
 #include <OGRE/OgreRenderWindow.h>
 #include <OGRE/OgreRoot.h>
 #include <OGRE/OgreSceneManager.h>
-#include <OGRE/OgreSubMesh.h>
 
 #include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
 
 #ifdef Q_WS_X11
 #include <QX11Info>
@@ -107,6 +110,8 @@ OgreManager::OgreManager(MainWindow *parent) : QObject(parent), d(new OgreManage
 }
 
 OgreManager::~OgreManager() {
+  // release loaded meshes before ogre is shut down
+  Aort::MeshLibrary::instance()->clear();
   delete d;
 }
 
@@ -148,7 +153,7 @@ const QString OgreManager::supportedFormats() const {
   // get supported extensions
   Assimp::Importer().GetExtensionList(extensions);
   // return as qstring
-  return QString::fromStdString(extensions).replace(";", " ").prepend("*.mesh ");
+  return QString::fromStdString(extensions).replace(";", " ").prepend("*.aort *.mesh ");
 }
 
 Ogre::Entity *OgreManager::loadMesh(const QString &path) {
@@ -162,135 +167,83 @@ Ogre::Entity *OgreManager::loadMesh(const QString &path) {
     // import mesh content into the mesh pointer
     Ogre::MeshSerializer().importMesh(stream, meshPtr.getPointer());
   } else {
-    // try to loading the mesh using assimp
-    Assimp::Importer *importer = new Assimp::Importer();
-    const aiScene *scene = importer->ReadFile(source.c_str(),
-                           aiProcess_CalcTangentSpace |
-                           aiProcess_JoinIdenticalVertices |
-                           aiProcess_Triangulate |
-                           // aiProcess_RemoveComponent |
-                           // aiProcess_GenNormals |
-                           aiProcess_GenSmoothNormals |
-                           // aiProcess_SplitLargeMeshes |
-                           // aiProcess_PreTransformVertices |
-                           // aiProcess_LimitBoneWeights |
-                           // aiProcess_ValidateDataStructure |
-                           aiProcess_ImproveCacheLocality |
-                           aiProcess_RemoveRedundantMaterials |
-                           aiProcess_FixInfacingNormals |
-                           aiProcess_SortByPType |
-                           aiProcess_FindDegenerates |
-                           aiProcess_FindInvalidData |
-                           aiProcess_GenUVCoords |
-                           aiProcess_TransformUVCoords |
-                           // aiProcess_FindInstances |
-                           aiProcess_OptimizeMeshes |
-                           aiProcess_OptimizeGraph |
-                           aiProcess_FlipUVs
-                           // aiProcess_FlipWindingOrder |
-                           // aiProcess_SplitByBoneCount |
-                           // aiProcess_Debone
-                                             );
-    if (scene->HasMaterials()) {
-      // TODO: load materials
-    }
-    Ogre::MeshPtr meshPtr = Ogre::MeshManager::getSingletonPtr()->createManual(source, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
-    Ogre::AxisAlignedBox aabb;
-    if (scene->HasMeshes()) {
-      for (int i = 0; i < scene->mNumMeshes; ++i) {
-        const struct aiMesh *aimesh = scene->mMeshes[i];
-        // primitive contains primitives other than triangles skip
-        // should be use together with aiProcess_SortByPType
-        if (aimesh->mPrimitiveTypes & (aiPrimitiveType_POINT | aiPrimitiveType_LINE | aiPrimitiveType_POLYGON))
-          continue;
-        // create a submesh
-        Ogre::SubMesh *submesh = meshPtr->createSubMesh();
-        // create vertex buffer
-        submesh->useSharedVertices = false;
-        submesh->vertexData = new Ogre::VertexData();
-        submesh->vertexData->vertexStart = 0;
-        submesh->vertexData->vertexCount = aimesh->mNumVertices;
-        // create vertex declaration
-        Ogre::VertexDeclaration* declaration = submesh->vertexData->vertexDeclaration;
-        unsigned short start = 0;
-        size_t offset = 0;
-        // get pointers to the position, normal and texture coordinates arrays
-        aiVector3D *position = aimesh->mVertices;
-        aiVector3D *normal = aimesh->mNormals;
-        aiVector3D *texCoord = aimesh->mTextureCoords[0];
-        // create position element
-        if (position)
-          offset += declaration->addElement(start, offset, Ogre::VET_FLOAT3, Ogre::VES_POSITION).getSize();
-        // create normal element
-        if (normal)
-          offset += declaration->addElement(start, offset, Ogre::VET_FLOAT3, Ogre::VES_NORMAL).getSize();
-        // create texture coords element
-        if (texCoord)
-          offset += declaration->addElement(start, offset, Ogre::VET_FLOAT2, Ogre::VES_TEXTURE_COORDINATES).getSize();
-        // create vertex buffer
-        Ogre::HardwareVertexBufferSharedPtr vertexBuffer = Ogre::HardwareBufferManager::getSingletonPtr()->createVertexBuffer(declaration->getVertexSize(start),
-            submesh->vertexData->vertexCount,
-            Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
-        // get vertex buffer
-        float* vertexData = static_cast<float*>(vertexBuffer->lock(Ogre::HardwareBuffer::HBL_DISCARD));
-        // parse vertices
-        for (size_t j = 0; j < aimesh->mNumVertices; ++j) {
-          // vertex position
-          if (aimesh->HasPositions()) {
-            *vertexData++ = position->x;
-            *vertexData++ = position->y;
-            *vertexData++ = position->z;
-            // next vertex
-            position++;
-            // update bounding box
-            aabb.merge(Ogre::Vector3(position->x, position->y, position->z));
-          }
-          // vertex normal
-          if (aimesh->HasNormals()) {
-            *vertexData++ = normal->x;
-            *vertexData++ = normal->y;
-            *vertexData++ = normal->z;
-            // next vertex
-            normal++;
-          }
-          // texture coordinates
-          if (aimesh->HasTextureCoords(0)) {
-            *vertexData++ = texCoord->x;
-            *vertexData++ = texCoord->y;
-            // next vertex
-            texCoord++;
-          }
-        }
-        vertexBuffer->unlock();
-        // bind the buffer
-        submesh->vertexData->vertexBufferBinding->setBinding(start, vertexBuffer);
-        // create index data
-        submesh->indexData->indexStart = 0;
-        submesh->indexData->indexCount = aimesh->mNumFaces * 3;
-        // get pointer to the face data
-        aiFace *f = aimesh->mFaces;
-        // index buffer
-        submesh->indexData->indexBuffer = Ogre::HardwareBufferManager::getSingletonPtr()->createIndexBuffer(Ogre::HardwareIndexBuffer::IT_32BIT,
-                                          submesh->indexData->indexCount,
-                                          Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
-        Ogre::uint32* idata = static_cast<Ogre::uint32*>(submesh->indexData->indexBuffer->lock(Ogre::HardwareBuffer::HBL_DISCARD));
-        // faces
-        for (size_t j = 0; j < aimesh->mNumFaces; ++j) {
-          *idata++ = f->mIndices[0];
-          *idata++ = f->mIndices[1];
-          *idata++ = f->mIndices[2];
-          // next face
-          f++;
+    // load the mesh using assimp directly into the renderer's mesh library
+    Aort::Mesh *mesh = Aort::MeshLibrary::instance()->load(source);
+    if (!mesh)
+      return 0;
+    // create an ogre mesh from the loaded mesh for the viewport
+    Aort::MeshLibrary::instance()->createOgreMesh(source);
+  }
+  // create and return an entity from the mesh
+  return d->sceneManager->createEntity(source);
+}
+
+bool OgreManager::loadScene(const QString &path, Ogre::SceneNode *parent) {
+  std::vector<Ogre::String> meshNames;
+  std::vector<Aort::SceneInstance> instances;
+  // map the scene file into the mesh library
+  if (!Aort::MeshLibrary::instance()->loadScene(path.toStdString(), meshNames, instances))
+    return false;
+  // create ogre meshes for the viewport
+  for (size_t i = 0; i < meshNames.size(); ++i)
+    if (!Ogre::MeshManager::getSingleton().resourceExists(meshNames.at(i)))
+      Aort::MeshLibrary::instance()->createOgreMesh(meshNames.at(i));
+  // create a node and an entity for each instance
+  for (size_t i = 0; i < instances.size(); ++i) {
+    const Aort::SceneInstance &instance = instances.at(i);
+    // meshes with indices out of range have no ogre mesh
+    if (!Ogre::MeshManager::getSingleton().resourceExists(meshNames.at(instance.mesh)))
+      continue;
+    Ogre::SceneNode *node = parent->createChildSceneNode(instance.position, instance.orientation);
+    node->setScale(instance.scale);
+    node->attachObject(d->sceneManager->createEntity(meshNames.at(instance.mesh)));
+  }
+  return true;
+}
+
+bool OgreManager::saveScene(const QString &path, Ogre::SceneNode *node) {
+  std::vector<Aort::Mesh *> meshes;
+  std::vector<Aort::SceneInstance> instances;
+  // meshes that are not in the mesh library are extracted in world space and deleted after writing
+  std::vector<Aort::Mesh *> extractedMeshes;
+  Aort::MaterialLibrary materialLibrary;
+  std::map<Aort::Mesh *, Ogre::uint32> meshIndices;
+  // collect entities of the node and its children
+  std::vector<Ogre::SceneNode *> nodes;
+  nodes.push_back(node);
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    Ogre::SceneNode *current = nodes.at(i);
+    // queue child nodes
+    for (int j = 0; j < current->numChildren(); ++j)
+      nodes.push_back(static_cast<Ogre::SceneNode *>(current->getChild(j)));
+    // add attached entities
+    for (int j = 0; j < current->numAttachedObjects(); ++j) {
+      if (current->getAttachedObject(j)->getMovableType() != "Entity")
+        continue;
+      Ogre::Entity *entity = static_cast<Ogre::Entity *>(current->getAttachedObject(j));
+      Aort::Mesh *mesh = Aort::MeshLibrary::instance()->getMesh(entity->getMesh()->getName());
+      if (mesh) {
+        // library meshes are stored once and instanced with the node transform
+        if (meshIndices.find(mesh) == meshIndices.end()) {
+          meshIndices[mesh] = meshes.size();
+          meshes.push_back(mesh);
         }
-        submesh->indexData->indexBuffer->unlock();
-        // TODO: assign material
+        instances.push_back(Aort::SceneInstance(meshIndices[mesh], current->_getDerivedPosition(), current->_getDerivedOrientation(), current->_getDerivedScale()));
+      } else {
+        // extract the entity in world space
+        Aort::MeshParser parser(entity, &materialLibrary);
+        parser.parse();
+        mesh = parser.mesh();
+        extractedMeshes.push_back(mesh);
+        instances.push_back(Aort::SceneInstance(meshes.size(), Ogre::Vector3::ZERO, Ogre::Quaternion::IDENTITY, Ogre::Vector3::UNIT_SCALE));
+        meshes.push_back(mesh);
       }
     }
-    meshPtr->_setBounds(aabb);
-    meshPtr->_setBoundingSphereRadius((aabb.getMaximum() - aabb.getMinimum()).length() * 0.5f);
-    // clean up
-    delete importer;
   }
-  // create and return an entity from the mesh
-  return d->sceneManager->createEntity(source);
+  // write the scene
+  bool result = Aort::SceneFile::write(path.toStdString(), meshes, instances);
+  // clean up
+  for (size_t i = 0; i < extractedMeshes.size(); ++i)
+    delete extractedMeshes.at(i);
+  return result;
 }
@@ -25,6 +25,8 @@ public slots:
 
   const QString supportedFormats() const;
   Ogre::Entity *loadMesh(const QString &path);
+  bool loadScene(const QString &path, Ogre::SceneNode *parent);
+  bool saveScene(const QString &path, Ogre::SceneNode *node);
 
 private:
   OgreManagerPrivate *d;
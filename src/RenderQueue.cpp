@@ -0,0 +1,202 @@
+#include "RenderQueue.h"
+
+#include "AortDistributed.h"
+#include "AortImageWriter.h"
+#include "AortRenderer.h"
+
+#include <QFile>
+#include <QFutureWatcher>
+#include <QList>
+#include <QTime>
+#include <QtConcurrentRun>
+
+#include <OGRE/OgreCamera.h>
+#include <OGRE/OgreSceneManager.h>
+#include <OGRE/OgreSceneNode.h>
+
+#include <algorithm>
+
+// milliseconds between the preview images sent while a render is running
+static const int PREVIEW_INTERVAL = 250;
+
+class RenderTask {
+public:
+  RenderTask() : id(0), renderer(0), camera(0) {
+  }
+
+  int id;
+  RenderRequest request;
+  Aort::Renderer *renderer;
+  // copy of the camera of the view, it is only read by the render
+  Ogre::Camera *camera;
+};
+
+class RenderResult {
+public:
+  RenderResult() : success(false) {
+  }
+
+  bool success;
+  QString message;
+};
+
+class RenderQueuePrivate {
+public:
+  RenderQueuePrivate(RenderQueue *q) : q(q), nextId(1) {
+  }
+
+  void start() {
+    if (tasks.isEmpty() || watcher.isRunning())
+      return;
+    emit q->started(tasks.first().id);
+    watcher.setFuture(QtConcurrent::run(this, &RenderQueuePrivate::run, tasks.first()));
+  }
+
+  void release(const RenderTask &task) {
+    delete task.renderer;
+    task.camera->getSceneManager()->destroyCamera(task.camera);
+  }
+
+  // reports the finished rows, a null image is not shown
+  void update(const int id, const int rows, const int height, const QImage &image) {
+    emit q->progress(id, rows, height);
+    if (!image.isNull())
+      emit q->imageUpdated(id, image);
+  }
+
+  // runs on the background thread, only touches the renderer and the camera of the task
+  RenderResult run(RenderTask task) {
+    RenderResult result;
+    const RenderRequest &request = task.request;
+    QTime time;
+    time.start();
+    task.renderer->preprocess(0);
+    Aort::ImageFormat format;
+    if (task.renderer->getRenderMode() == Aort::RM_COLOUR && Aort::ImageFileWriter::formatFromPath(request.path.toStdString(), format)) {
+      // stream the image to the file band by band and show the finished bands
+      Aort::ImageFileWriter fileWriter(request.path.toStdString(), format);
+      ProgressWriter writer(this, task.id, &fileWriter);
+      result.success = task.renderer->render(task.camera, request.width, request.height, &writer, request.supersampling) >= 0;
+    } else {
+      int width = request.width * request.supersampling;
+      int height = request.height * request.supersampling;
+      uchar *buffer = new uchar[width * height * 4];
+      task.renderer->render(task.camera, width, height, buffer);
+      // the buffer is tonemapped into the byte order of a 32-bit argb image, like the preview of the bands
+      QImage image = QImage(buffer, width, height, QImage::Format_ARGB32).scaled(request.width, request.height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+      update(task.id, request.height, request.height, image);
+      result.success = image.save(request.path);
+      // save raw costs next to the image, Aort::CC_COUNT floats per pixel at the render resolution
+      if (result.success && task.renderer->getCostBuffer()) {
+        QFile file(request.path + ".cost.raw");
+        if (file.open(QIODevice::WriteOnly))
+          file.write(reinterpret_cast<const char *>(task.renderer->getCostBuffer()), width * height * Aort::CC_COUNT * sizeof(float));
+      }
+      delete[] buffer;
+    }
+    if (result.success)
+      result.message = RenderQueue::tr("Rendered %1 in %2 ms").arg(request.path).arg(time.elapsed());
+    else
+      result.message = RenderQueue::tr("Could not save %1.").arg(request.path);
+    return result;
+  }
+
+  // passes the bands on to the file and converts them into the preview image
+  class ProgressWriter : public Aort::ImageWriter {
+  public:
+    ProgressWriter(RenderQueuePrivate *d, const int id, Aort::ImageWriter *writer) : d(d), id(id), writer(writer) {
+    }
+
+    const bool begin(const int width, const int height) {
+      image = QImage(width, height, QImage::Format_ARGB32);
+      image.fill(0);
+      time.start();
+      return writer->begin(width, height);
+    }
+
+    const bool write(const int y, const int count, const float *colours) {
+      for (int row = 0; row < count; ++row) {
+        QRgb *scanline = reinterpret_cast<QRgb *>(image.scanLine(y + row));
+        const float *source = colours + row * image.width() * 4;
+        // the writers get rgba floats, qRgba packs them into the argb pixels of the image
+        for (int x = 0; x < image.width(); ++x)
+          scanline[x] = qRgba(channel(source[x * 4 + 0]), channel(source[x * 4 + 1]), channel(source[x * 4 + 2]), channel(source[x * 4 + 3]));
+      }
+      // the last band is always shown
+      bool preview = time.elapsed() >= PREVIEW_INTERVAL || y + count == image.height();
+      d->update(id, y + count, image.height(), preview ? image : QImage());
+      if (preview)
+        time.restart();
+      return writer->write(y, count, colours);
+    }
+
+    const bool end() {
+      return writer->end();
+    }
+
+  private:
+    static int channel(const float value) {
+      return int(Ogre::Math::Clamp(value, 0.0f, 1.0f) * 255);
+    }
+
+    RenderQueuePrivate *d;
+    int id;
+    Aort::ImageWriter *writer;
+    QImage image;
+    QTime time;
+  };
+
+  RenderQueue *q;
+  int nextId;
+  // the first task is running
+  QList<RenderTask> tasks;
+  QFutureWatcher<RenderResult> watcher;
+};
+
+RenderRequest::RenderRequest() : width(800), height(600), supersampling(1), heatmap(false) {
+}
+
+RenderQueue::RenderQueue(QObject *parent) : QObject(parent), d(new RenderQueuePrivate(this)) {
+  connect(&d->watcher, SIGNAL(finished()), this, SLOT(renderFinished()));
+}
+
+RenderQueue::~RenderQueue() {
+  d->watcher.waitForFinished();
+  for (int i = 0; i < d->tasks.size(); ++i)
+    d->release(d->tasks.at(i));
+  delete d;
+}
+
+int RenderQueue::enqueue(Ogre::SceneNode *root, const Ogre::Camera *camera, const RenderRequest &request) {
+  RenderTask task;
+  task.id = d->nextId++;
+  task.request = request;
+  task.request.supersampling = std::max(1, request.supersampling);
+  // copy the scene, the rest of the preprocess runs on the background thread
+  task.renderer = new Aort::Renderer();
+  if (request.heatmap)
+    task.renderer->setRenderMode(Aort::RM_COST);
+  task.renderer->extract(root);
+  // copy the camera, so that the view can move while rendering
+  Aort::RenderJob job;
+  job.width = request.width;
+  job.height = request.height;
+  job.setCamera(camera);
+  task.camera = root->getCreator()->createCamera(QString("RenderQueueCamera%1").arg(task.id).toStdString());
+  job.applyCamera(task.camera);
+  d->tasks.append(task);
+  d->start();
+  return task.id;
+}
+
+const int RenderQueue::count() const {
+  return d->tasks.size();
+}
+
+void RenderQueue::renderFinished() {
+  RenderTask task = d->tasks.takeFirst();
+  RenderResult result = d->watcher.result();
+  d->release(task);
+  emit finished(task.id, result.success, result.message);
+  d->start();
+}
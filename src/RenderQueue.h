@@ -0,0 +1,54 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <QImage>
+#include <QObject>
+#include <QString>
+
+#include <OGRE/OgrePrerequisites.h>
+
+class RenderQueuePrivate;
+
+class RenderRequest {
+public:
+  RenderRequest();
+
+  // the format is picked from the extension, unknown extensions are saved by qt
+  QString path;
+  int width;
+  int height;
+  int supersampling;
+  // renders the cost of the pixels instead of their colours
+  bool heatmap;
+};
+
+// renders images of the scene one after the other on a background thread, the scene and the camera are copied when a
+// render is queued, so the scene can be changed while the renders are running
+class RenderQueue : public QObject {
+  Q_OBJECT
+public:
+  RenderQueue(QObject *parent = 0);
+  ~RenderQueue();
+
+  // copies the scene under root and the camera, has to be called on the thread of ogre, returns the id of the render
+  int enqueue(Ogre::SceneNode *root, const Ogre::Camera *camera, const RenderRequest &request);
+  // renders queued or running
+  const int count() const;
+
+signals:
+  void started(int id);
+  // rows of the image finished so far
+  void progress(int id, int rows, int height);
+  // the image with the rows finished so far, the rest is transparent
+  void imageUpdated(int id, const QImage &image);
+  void finished(int id, bool success, const QString &message);
+
+private slots:
+  void renderFinished();
+
+private:
+  friend class RenderQueuePrivate;
+  RenderQueuePrivate *d;
+};
+
+#endif // RENDERQUEUE_H
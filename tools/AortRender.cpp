@@ -0,0 +1,186 @@
+#include "AortDistributed.h"
+#include "AortImageWriter.h"
+
+#include <QCoreApplication>
+#include <QProcess>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+#include <QTime>
+
+#include <OGRE/OgreCamera.h>
+#include <OGRE/OgreLogManager.h>
+#include <OGRE/OgreMath.h>
+#include <OGRE/OgreRoot.h>
+#include <OGRE/OgreSceneManager.h>
+
+#include <algorithm>
+#include <vector>
+
+void writeUsage(QTextStream &out) {
+  out << "Usage: aort-render [options] <scene> <output>" << endl
+      << "  --worker <host:port>  render on a worker started with aort-worker, can be given several times" << endl
+      << "  --local <count>       start workers on this machine, the cores are shared between them" << endl
+      << "  --port <port>         first port of the local workers (default: 7700)" << endl
+      << "  --width <pixels>      image width (default: 640)" << endl
+      << "  --height <pixels>     image height (default: 480)" << endl
+      << "  --camera <x,y,z>      camera position (default: 0,150,600)" << endl
+      << "  --target <x,y,z>      point the camera looks at (default: 0,100,0)" << endl
+      << "  --fov <degrees>       vertical field of view (default: 45)" << endl
+      << "  --light <x,y,z>       add a point light, the camera position is used if none is given" << endl
+      << "  --samples <count>     samples per pixel (default: 1)" << endl
+      << "  --supersampling <n>   grid of n by n cells per pixel (default: 1)" << endl
+      << "  --exposure <stops>    exposure of png images (default: 0)" << endl
+      << "  --tile <pixels>       edge length of the tiles, at most " << MAX_TILE_SIZE << " (default: 64)" << endl
+      << "  --attempts <count>    tries of a tile before the render fails (default: 3)" << endl
+      << "  --timeout <seconds>   time a worker may take for a tile (default: 120)" << endl
+      << "The scene is an aort scene or a mesh file, it is loaded by the workers, so it has to be available to them" << endl
+      << "at the same path. The format of the output is picked from its extension: png, exr or pfm." << endl;
+}
+
+bool parseVector(const QString &value, Ogre::Vector3 &vector) {
+  QStringList values = value.split(",");
+  if (values.size() != 3)
+    return false;
+  vector = Ogre::Vector3(values.at(0).toFloat(), values.at(1).toFloat(), values.at(2).toFloat());
+  return true;
+}
+
+int main(int argc, char **argv) {
+  QCoreApplication app(argc, argv);
+  QTextStream out(stdout);
+  QTextStream err(stderr);
+  // default settings
+  Aort::RenderJob job;
+  Aort::RenderCoordinator coordinator;
+  Ogre::Vector3 cameraPosition(0.0f, 150.0f, 600.0f);
+  Ogre::Vector3 cameraTarget(0.0f, 100.0f, 0.0f);
+  Ogre::Real fov = 45.0f;
+  Ogre::Real exposure = 0.0f;
+  int localWorkers = 0;
+  int port = 7700;
+  QStringList paths;
+  // parse arguments
+  QStringList arguments = app.arguments();
+  for (int i = 1; i < arguments.size(); ++i) {
+    QString argument = arguments.at(i);
+    QString value = (i + 1 < arguments.size()) ? arguments.at(i + 1) : QString();
+    bool valid = true;
+    if (argument == "--worker") {
+      QStringList address = value.split(":");
+      valid = address.size() == 2 && address.at(1).toInt() > 0;
+      if (valid)
+        coordinator.addWorker(address.at(0), address.at(1).toInt());
+      ++i;
+    } else if (argument == "--local") {
+      localWorkers = std::max(0, value.toInt());
+      ++i;
+    } else if (argument == "--port") {
+      port = value.toInt();
+      ++i;
+    } else if (argument == "--width") {
+      job.width = std::max(1, value.toInt());
+      ++i;
+    } else if (argument == "--height") {
+      job.height = std::max(1, value.toInt());
+      ++i;
+    } else if (argument == "--camera") {
+      valid = parseVector(value, cameraPosition);
+      ++i;
+    } else if (argument == "--target") {
+      valid = parseVector(value, cameraTarget);
+      ++i;
+    } else if (argument == "--fov") {
+      fov = value.toFloat();
+      ++i;
+    } else if (argument == "--light") {
+      Aort::JobLight light;
+      valid = parseVector(value, light.position);
+      job.lights.push_back(light);
+      ++i;
+    } else if (argument == "--samples") {
+      job.samplesPerPixel = std::max(1, value.toInt());
+      ++i;
+    } else if (argument == "--supersampling") {
+      job.supersampling = std::max(1, value.toInt());
+      ++i;
+    } else if (argument == "--exposure") {
+      exposure = value.toFloat();
+      ++i;
+    } else if (argument == "--tile") {
+      coordinator.setTileSize(value.toInt());
+      ++i;
+    } else if (argument == "--attempts") {
+      coordinator.setMaxAttempts(value.toInt());
+      ++i;
+    } else if (argument == "--timeout") {
+      coordinator.setTimeout(std::max(1, value.toInt()) * 1000);
+      ++i;
+    } else if (!argument.startsWith("-")) {
+      paths << argument;
+    } else {
+      valid = false;
+    }
+    if (!valid) {
+      writeUsage(err);
+      return 1;
+    }
+  }
+  Aort::ImageFormat format;
+  if (paths.size() != 2 || !Aort::ImageFileWriter::formatFromPath(paths.at(1).toStdString(), format) || (localWorkers == 0 && coordinator.getWorkerCount() == 0)) {
+    writeUsage(err);
+    return 1;
+  }
+  job.scenePath = paths.at(0).toStdString();
+  // create a silent log before ogre creates the default one
+  Ogre::LogManager *logManager = new Ogre::LogManager();
+  logManager->createLog("aort-render.log", true, false, true);
+  // the camera is the only ogre object needed, no render system is loaded
+  Ogre::Root *root = new Ogre::Root("", "", "");
+  Ogre::SceneManager *sceneManager = root->createSceneManager(Ogre::ST_GENERIC);
+  Ogre::Camera *camera = sceneManager->createCamera("RenderCamera");
+  camera->setNearClipDistance(10.0f);
+  camera->setPosition(cameraPosition);
+  camera->lookAt(cameraTarget);
+  camera->setFOVy(Ogre::Degree(fov));
+  job.setCamera(camera);
+  if (job.lights.empty()) {
+    Aort::JobLight light;
+    light.position = cameraPosition;
+    job.lights.push_back(light);
+  }
+  // start the local workers next to this executable and wait until they listen
+  std::vector<QProcess *> processes;
+  int threads = std::max(1, QThread::idealThreadCount() / std::max(1, localWorkers));
+  for (int i = 0; i < localWorkers; ++i) {
+    QProcess *process = new QProcess();
+    process->start(QCoreApplication::applicationDirPath() + "/aort-worker", QStringList() << "--port" << QString::number(port + i) << "--threads" << QString::number(threads));
+    processes.push_back(process);
+    if (!process->waitForStarted() || !process->waitForReadyRead()) {
+      err << "Could not start a worker on port " << (port + i) << endl;
+      continue;
+    }
+    coordinator.addWorker("127.0.0.1", port + i);
+  }
+  // render
+  QTime time;
+  time.start();
+  Aort::ImageFileWriter writer(paths.at(1).toStdString(), format, exposure);
+  bool result = coordinator.render(job, &writer);
+  int milliseconds = time.elapsed();
+  // stop the local workers
+  for (size_t i = 0; i < processes.size(); ++i) {
+    processes.at(i)->kill();
+    processes.at(i)->waitForFinished();
+    delete processes.at(i);
+  }
+  delete root;
+  delete logManager;
+  if (!result) {
+    err << "Render failed: " << coordinator.getError() << endl;
+    return 1;
+  }
+  out << "Rendered " << paths.at(1) << " on " << coordinator.getWorkerCount() << " workers in " << milliseconds << " ms, "
+      << coordinator.getRetryCount() << " tiles retried" << endl;
+  return 0;
+}
@@ -0,0 +1,109 @@
+#include "AortDistributed.h"
+#include "AortRenderServer.h"
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+
+#include <OGRE/OgreLogManager.h>
+#include <OGRE/OgreRoot.h>
+#include <OGRE/OgreSceneManager.h>
+
+#include <algorithm>
+#include <vector>
+
+void writeUsage(QTextStream &out) {
+  out << "Usage: aort-server [options]" << endl
+      << "  --port <port>         port to listen on (default: 7800)" << endl
+      << "  --public              accept requests from other hosts, not only from the local host" << endl
+      << "  --threads <count>     cores shared by the renders (default: the processor count)" << endl
+      << "  --cache <count>       scenes kept in memory (default: 8)" << endl
+      << "  --scene <id>=<path>   prepare a scene before serving, can be given several times" << endl
+      << "  --light <x,y,z>       add a point light to the scenes given with --scene" << endl
+      << "Requests:" << endl
+      << "  PUT /scenes/<id>?path=<scene>&light=<x,y,z>   prepare a scene" << endl
+      << "  DELETE /scenes/<id>                            release a scene" << endl
+      << "  GET /scenes                                    list the scenes" << endl
+      << "  GET /render/<id>?width=&height=&camera=<x,y,z>&target=<x,y,z>&fov=&samples=&supersampling=&exposure=&format=" << endl;
+}
+
+int main(int argc, char **argv) {
+  QCoreApplication app(argc, argv);
+  QTextStream out(stdout);
+  QTextStream err(stderr);
+  int port = 7800;
+  bool localOnly = true;
+  int threads = 0;
+  int cacheSize = 8;
+  QStringList scenes;
+  std::vector<Aort::JobLight> lights;
+  // parse arguments
+  QStringList arguments = app.arguments();
+  for (int i = 1; i < arguments.size(); ++i) {
+    QString argument = arguments.at(i);
+    QString value = (i + 1 < arguments.size()) ? arguments.at(i + 1) : QString();
+    bool valid = true;
+    if (argument == "--port") {
+      port = value.toInt();
+      ++i;
+    } else if (argument == "--public") {
+      localOnly = false;
+    } else if (argument == "--threads") {
+      threads = std::max(1, value.toInt());
+      ++i;
+    } else if (argument == "--cache") {
+      cacheSize = std::max(1, value.toInt());
+      ++i;
+    } else if (argument == "--scene") {
+      valid = value.contains("=");
+      scenes << value;
+      ++i;
+    } else if (argument == "--light") {
+      QStringList values = value.split(",");
+      valid = values.size() == 3;
+      if (valid) {
+        Aort::JobLight light;
+        light.position = Ogre::Vector3(values.at(0).toFloat(), values.at(1).toFloat(), values.at(2).toFloat());
+        lights.push_back(light);
+      }
+      ++i;
+    } else {
+      valid = false;
+    }
+    if (!valid) {
+      writeUsage(err);
+      return 1;
+    }
+  }
+  // create a silent log before ogre creates the default one
+  Ogre::LogManager *logManager = new Ogre::LogManager();
+  logManager->createLog("aort-server.log", true, false, true);
+  // the cameras are the only ogre objects needed, no render system is loaded
+  Ogre::Root *root = new Ogre::Root("", "", "");
+  Ogre::SceneManager *sceneManager = root->createSceneManager(Ogre::ST_GENERIC);
+  Aort::RenderServer *server = new Aort::RenderServer(sceneManager);
+  if (threads > 0)
+    server->setThreadCount(threads);
+  server->setCacheSize(cacheSize);
+  // prepare the scenes given on the command line
+  for (int i = 0; i < scenes.size(); ++i) {
+    Aort::RenderJob job;
+    job.scenePath = scenes.at(i).section("=", 1).toStdString();
+    job.lights = lights;
+    QString error;
+    if (!server->addScene(scenes.at(i).section("=", 0, 0), job, error)) {
+      err << error << endl;
+      return 1;
+    }
+  }
+  if (!server->listen(port, localOnly)) {
+    err << "Could not listen on port " << port << endl;
+    return 1;
+  }
+  out << "aort-server listening on port " << server->getPort() << endl;
+  server->exec();
+  delete server;
+  delete root;
+  delete logManager;
+  return 0;
+}
@@ -0,0 +1,71 @@
+#include "AortDistributed.h"
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+
+#include <OGRE/OgreCamera.h>
+#include <OGRE/OgreLogManager.h>
+#include <OGRE/OgreRoot.h>
+#include <OGRE/OgreSceneManager.h>
+
+#ifndef NO_OMP
+#include <omp.h>
+#endif // !NO_OMP
+
+void writeUsage(QTextStream &out) {
+  out << "Usage: aort-worker [options]" << endl
+      << "  --port <port>       port to listen on (default: 7700)" << endl
+      << "  --threads <count>   render threads (default: the processor count)" << endl
+      << "  --timeout <ms>      idle time after which a coordinator is dropped (default: 600000)" << endl
+      << "Renders the tiles requested by aort-render, one coordinator at a time." << endl;
+}
+
+int main(int argc, char **argv) {
+  QCoreApplication app(argc, argv);
+  QTextStream out(stdout);
+  QTextStream err(stderr);
+  int port = 7700;
+  int timeout = 600000;
+  // parse arguments
+  QStringList arguments = app.arguments();
+  for (int i = 1; i < arguments.size(); ++i) {
+    if (arguments.at(i) == "--port" && i + 1 < arguments.size()) {
+      port = arguments.at(++i).toInt();
+    } else if (arguments.at(i) == "--threads" && i + 1 < arguments.size()) {
+      int threads = arguments.at(++i).toInt();
+#ifndef NO_OMP
+      if (threads > 0)
+        omp_set_num_threads(threads);
+#endif // !NO_OMP
+    } else if (arguments.at(i) == "--timeout" && i + 1 < arguments.size()) {
+      timeout = arguments.at(++i).toInt();
+      if (timeout <= 0) {
+        writeUsage(err);
+        return 1;
+      }
+    } else {
+      writeUsage(err);
+      return 1;
+    }
+  }
+  // create a silent log before ogre creates the default one
+  Ogre::LogManager *logManager = new Ogre::LogManager();
+  logManager->createLog("aort-worker.log", true, false, true);
+  // the camera is the only ogre object needed, no render system is loaded
+  Ogre::Root *root = new Ogre::Root("", "", "");
+  Ogre::SceneManager *sceneManager = root->createSceneManager(Ogre::ST_GENERIC);
+  Ogre::Camera *camera = sceneManager->createCamera("WorkerCamera");
+  Aort::RenderWorker worker(camera);
+  worker.setTimeout(timeout);
+  if (!worker.listen(port)) {
+    err << "Could not listen on port " << port << endl;
+    return 1;
+  }
+  // the coordinator waits for this line when it starts local workers
+  out << "aort-worker listening on port " << worker.getPort() << endl;
+  worker.exec();
+  delete root;
+  delete logManager;
+  return 0;
+}